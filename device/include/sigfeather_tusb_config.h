@@ -69,7 +69,8 @@ extern "C" {
 
 //------------- CLASS -------------//
 
-#define CFG_TUD_VENDOR            1
+// the data interface is served by an application class driver (usbinterface.cpp)
+#define CFG_TUD_VENDOR            0
 
 #ifdef __cplusplus
 }
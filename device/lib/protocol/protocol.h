@@ -3,19 +3,50 @@
 //! please see LICENSE file in root folder for licensing terms.
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 enum class Command : uint8_t
 {
     Open = 0x01,
     Close = 0x02,
     GetStatus = 0x03,
+    GetCapabilities = 0x04,
+    GetStatistics = 0x05,
     Start = 0x10,
     Stop = 0x11,
+    Rearm = 0x12,                   //!< configures the last requested session again and starts it, see StartResult
     ConfigureSession = 0x21,
-    GetSessionConfiguration = 0x22
+    GetSessionConfiguration = 0x22,
+    ConfigureAndStart = 0x23        //!< ConfigureSession and Start in one request, see StartResult
 };
 
+//! revision of the commands and structures in this file, reported in Capabilities
+static constexpr uint8_t ProtocolVersion = 2;
+
+// Versioned structures start with their size in bytes. Fields are only ever
+// added at the end: a receiver takes the fields of a shorter structure and
+// keeps its defaults for the rest, and ignores fields it does not know, so
+// host and device do not need to be updated together. Every structure fits
+// into one 64 byte control packet, and none is shorter than MinVersionedSize,
+// which tells them from the unversioned structures of protocol version 1.
+static constexpr size_t MinVersionedSize = 16;
+
+//! copies the versioned structure of 'bytes' bytes at 'data' into 'target'.
+//! returns false if the data is not a versioned structure.
+template<typename T>
+inline bool readVersioned(T& target, const void* data, size_t bytes)
+{
+    static_assert(sizeof(T)>=MinVersionedSize && sizeof(T)<=64, "versioned structures must fit a control packet");
+    if (bytes<MinVersionedSize) return false;
+    size_t size=*static_cast<const uint8_t*>(data);
+    if (size<MinVersionedSize || size>bytes) return false;
+    std::memcpy(&target, data, size<sizeof(T) ? size : sizeof(T));
+    target.size=sizeof(T);
+    return true;
+}
+
 enum class Status : uint8_t
 {
     Closed = 0x00,
@@ -27,16 +58,223 @@ enum class Status : uint8_t
 enum class SessionType : uint8_t
 {
     Benchmark = 0x00,
-    SingleBit = 0x01
+    SingleBit = 0x01,       //!< one channel on pin 2, basePin and channelCount are ignored
+    MultiChannel = 0x02,    //!< channelCount contiguous pins starting at basePin
+    Changes = 0x03          //!< like MultiChannel, but only changes are sent, see ChangeRecord
+};
+
+// Sample data layout: every sample clock the PIO shifts channelCount pin
+// levels into a 32 bit word, MSB first, and DMA stores the full words in
+// little-endian byte order. channelCount must be 1, 2, 4, 8, 16 or 32, so a
+// word holds 32/channelCount whole samples:
+//  - the oldest sample of a word occupies its most significant channelCount bits
+//  - within one sample, bit i is the level of pin basePin+i
+// Example with 8 channels: word w holds samples 4w..4w+3, sample 4w+k is byte
+// (3-k) of the word, i.e. bytes are in reverse sample order inside each word.
+// Data always ends on a word boundary, unused samples of the last word are
+// sampled like the others and must be ignored by the host.
+
+// Change-only sessions send a ChangeRecord whenever the pins differ from the
+// last record, and at least every ChangeTimerStart+1 loops. The device adds
+// SessionFlagUnbounded, the host stops the session. The PIO loop runs at
+// sampleRate, which defaults to clk_sys, and reads the pins once every
+// ChangeLoopClocks clocks. Each record's state was read a known number of
+// clocks after the read of the previous record:
+//     base + ChangeLoopClocks*(ChangeTimerStart-timer)
+// base is ChangeExpiredClocks if the previous record repeated the state before
+// it, the timer ran out then, otherwise ChangeRecordClocks. The first record
+// holds the state at time 0, its timer is meaningless. A state before the
+// first record counts as all pins low. In a framed session the record after
+// a gap has no known predecessor, it was read about the gap's timestamp. If
+// the FIFO of the loop stalls, the device ends the session and Stop reports
+// Status::Error.
+struct [[gnu::packed]] ChangeRecord
+{
+    uint32_t timer=0;
+    uint32_t pins=0;        //!< bit i is the level of pin basePin+i
+};
+static_assert(sizeof(ChangeRecord) == 8, "ChangeRecord size mismatch");
+
+static constexpr uint32_t ChangeTimerStart = 0x00ffffff;
+static constexpr uint32_t ChangeLoopClocks = 5;
+static constexpr uint32_t ChangeRecordClocks = 8;
+static constexpr uint32_t ChangeExpiredClocks = 12;
+
+//! condition that starts the capture window of a triggered session
+enum class TriggerType : uint8_t
+{
+    None = 0x00,            //!< capture starts with Command::Start
+    RisingEdge = 0x01,      //!< triggerPin goes from low to high
+    FallingEdge = 0x02,     //!< triggerPin goes from high to low
+    High = 0x03,            //!< triggerPin is high
+    Low = 0x04,             //!< triggerPin is low
+    Pattern = 0x05          //!< the triggerWidth pins starting at triggerPin equal triggerPattern
+};
+
+//! bit flags for SessionConfiguration::flags
+enum SessionFlags : uint8_t
+{
+    SessionFlagUnbounded = 0x01,    //!< sample until stopped, sampleCount and bytesLeft are not used
+    SessionFlagCompressed = 0x02,   //!< sample words are sent run-length encoded, see below.
+                                    //!< the device clears the flag if it cannot compress the session.
+    SessionFlagDeep = 0x04,         //!< sample into the device's PSRAM instead of its SRAM buffer, so a
+                                    //!< one-shot capture may be up to the PSRAM size and faster than USB.
+                                    //!< the device lowers sampleRate to what PSRAM keeps up with, and
+                                    //!< clears the flag without PSRAM or for unbounded and triggered sessions.
+    SessionFlagFramed = 0x08        //!< sample data is sent in frames, see below, so data the device could not
+                                    //!< send in time is reported as a gap instead of ending the session.
+                                    //!< the device clears the flag for compressed sessions.
+};
+
+// Compressed stream layout: a sequence of blocks, each starting with a 32 bit
+// little-endian header word. Bit 31 selects the block kind, bits 0-30 hold a
+// word count n > 0:
+//  - run block (bit 31 set): one sample word follows, it repeats n times
+//  - raw block (bit 31 clear): n sample words follow verbatim
+// Decoding all blocks yields exactly the uncompressed stream, bytesLeft still
+// counts uncompressed bytes. Blocks may be split across USB transfers.
+static constexpr uint32_t CompressedRunFlag = 0x80000000;
+static constexpr uint32_t CompressedCountMask = 0x7fffffff;
+
+// Framed stream layout: a sequence of records, each starting with a 64 byte
+// FrameHeader. A header is one full USB packet, so it never ends a bulk
+// transfer early. Offsets count sample bytes since the start of the session,
+// including lost ones, and bytesLeft still counts sample bytes.
+//  - FrameType::Data: 'bytes' sample bytes from 'offset' on follow the header
+//  - FrameType::Gap: the 'bytes' sample bytes from 'offset' on were lost, nothing
+//    follows. a gap may cover a data record that was sent before, but was found
+//    overwritten by the sampler once its transfer completed.
+//  - FrameType::End: a bounded session is complete, nothing follows
+//  - FrameType::Segment: the next segment of a segmented session starts at
+//    'offset' with 'bytes' sample bytes, nothing follows. the bytes between two
+//    segments are not sent.
+// Data below 'verified' is known to be intact. A receiver holds back data above
+// it, since a later gap may still drop it.
+enum class FrameType : uint8_t
+{
+    Data = 0x01,
+    Gap = 0x02,
+    End = 0x03,
+    Segment = 0x04
+};
+
+static constexpr uint32_t FrameMagic = 0x72464653;     // "SFFr"
+
+struct [[gnu::packed]] FrameHeader
+{
+    uint32_t magic=FrameMagic;
+    FrameType type=FrameType::Data;
+    uint8_t reserved[3]={};
+    uint32_t sequence=0;            //!< counts records from 0, USB does not lose any
+    uint32_t bytes=0;
+    uint64_t offset=0;
+    uint64_t verified=0;
+    uint64_t timestamp=0;           //!< Segment: sample clocks from the start of sampling to the first sample of the segment.
+                                    //!< Gap in a change session: sampleRate clocks from the start to when the gap was
+                                    //!< found, an estimate of when the record behind it was read
+    uint32_t segment=0;             //!< Segment: index of the segment
+    uint8_t padding[20]={};
+};
+static_assert(sizeof(FrameHeader) == 64, "FrameHeader size mismatch");
+
+//! bit flags for Capabilities::flags, the optional session features a device supports
+enum CapabilityFlags : uint32_t
+{
+    CapabilityUnbounded = 0x01,     //!< SessionFlagUnbounded
+    CapabilityCompressed = 0x02,    //!< SessionFlagCompressed
+    CapabilityTriggered = 0x04,     //!< TriggerType other than None
+    CapabilityDeep = 0x08,          //!< SessionFlagDeep
+    CapabilityFramed = 0x10,        //!< SessionFlagFramed
+    CapabilityQuickStart = 0x20,    //!< Command::ConfigureAndStart and Command::Rearm
+    CapabilitySegmented = 0x40,     //!< SessionConfiguration::segmentCount
+    CapabilityChanges = 0x80        //!< SessionType::Changes
+};
+
+//! what a device can do, read once with Command::GetCapabilities so the host
+//! can pick a valid session up front instead of probing with configurations
+struct [[gnu::packed]] Capabilities
+{
+    uint8_t size=sizeof(Capabilities);
+    uint8_t protocolVersion=ProtocolVersion;
+    uint8_t channelCounts=0;        //!< bit n is set if 2^n channels can be sampled
+    uint8_t pinCount=0;             //!< basePin+channelCount must not exceed this
+    uint32_t flags=0;               //!< CapabilityFlags
+    uint32_t systemClock=0;         //!< clk_sys in Hz, also the highest sample rate
+    uint32_t deepBandwidth=0;       //!< bytes per second a deep session can sample, 0 without PSRAM
+    uint64_t sampleBufferSize=0;    //!< bytes a one-shot or benchmark session holds, a trigger window half of it
+    uint64_t deepBufferSize=0;      //!< bytes a deep session holds
 };
+static_assert(sizeof(Capabilities) == 32, "Capabilities size mismatch");
 
+//! a versioned structure, see above
 struct [[gnu::packed]] SessionConfiguration
 {
+    uint8_t size=sizeof(SessionConfiguration);
     SessionType type=SessionType::Benchmark;
-    uint32_t sampleCount=0;
-    uint32_t bytesLeft=0;
+    uint64_t sampleCount=0;
+    uint64_t bytesLeft=0;
+    uint8_t flags=0;
+    uint8_t basePin=0;              //!< first sampled GPIO
+    uint8_t channelCount=1;         //!< number of contiguous GPIOs sampled per clock
+    uint32_t sampleRate=0;          //!< requested samples per second, 0 selects the default of 10kHz.
+                                    //!< the device returns the achieved rate rounded to whole Hz.
+    // filled in by the device:
+    uint32_t systemClock=0;         //!< clk_sys in Hz that drives the sampler
+    uint16_t clockDividerInt=0;     //!< sampler clock divider, 16.8 fixed point. the exact sample rate is
+    uint8_t clockDividerFrac=0;     //!< systemClock*256/(clockDividerInt*256+clockDividerFrac). with a non-zero
+                                    //!< fraction, sample intervals alternate between whole clk_sys periods, so
+                                    //!< each sample is taken up to one clk_sys period off the ideal time.
+    // triggered sessions keep sampling into a ring until the trigger fires, then
+    // send a window of sampleCount samples, preTriggerSamples of them from before
+    // the trigger. the window is limited to half the sample buffer.
+    TriggerType triggerType=TriggerType::None;
+    uint8_t triggerPin=0;
+    uint8_t triggerWidth=1;         //!< pins compared by TriggerType::Pattern
+    uint32_t triggerPattern=0;      //!< bit i is the level of pin triggerPin+i
+    uint64_t preTriggerSamples=0;   //!< rounded down to whole sample words by the device
+    // segmented sessions capture a window of sampleCount samples segmentCount times
+    // without stopping the sampler: at every trigger, re-armed right after the previous
+    // window, or without a trigger every segmentInterval samples. segments are sent as
+    // they complete in a framed stream, the device sets SessionFlagFramed, and
+    // bytesLeft counts the bytes of all segments.
+    uint16_t segmentCount=0;        //!< 0 or 1 for a single capture
+    uint32_t segmentInterval=0;     //!< untriggered segments only, raised to at least the window by the device
+};
+static_assert(sizeof(SessionConfiguration) == 53, "SessionConfiguration size mismatch");
+
+//! data path telemetry of the current or last session, read with
+//! Command::GetStatistics at any time. the counters restart with Command::Start.
+struct [[gnu::packed]] Statistics
+{
+    uint8_t size=sizeof(Statistics);
+    uint8_t reserved[3]={};
+    uint32_t fifoOverflows=0;       //!< polls that found the sampler's PIO RX FIFO had stalled, samples were
+                                    //!< lost each time. several stalls between two polls count once.
+    uint32_t dmaRestarts=0;         //!< times a DMA channel of a continuous session was rewound to its half of the ring
+    uint32_t updateRate=0;          //!< device loop iterations per second, averaged over the session
+    uint32_t maxUpdateGap=0;        //!< longest time between two loop iterations in microseconds
+    uint64_t bytesSent=0;           //!< bytes sent on the data endpoint, compressed bytes for compressed sessions
+    uint64_t peakLag=0;             //!< largest distance in bytes between the sampler and the send position.
+                                    //!< data was overwritten if it exceeds bufferSize.
+    uint64_t bufferSize=0;          //!< bytes of the capture buffer of the session
+    uint64_t lostBytes=0;           //!< sample bytes a framed session reported as gaps
+};
+static_assert(sizeof(Statistics) == 52, "Statistics size mismatch");
+
+static constexpr uint32_t StartResultMagic = 0x74534653;   // "SFSt"
+
+//! Command::ConfigureAndStart and Command::Rearm take no data back, so the
+//! device sends the outcome as the first packet on the data endpoint, ahead of
+//! the sample data. The host needs a single round trip to start a capture.
+struct [[gnu::packed]] StartResult
+{
+    uint32_t magic=StartResultMagic;
+    Status status=Status::Error;    //!< Status::Running if sampling started
+    uint8_t reserved[3]={};
+    uint8_t config[56]={};          //!< the effective SessionConfiguration, a versioned structure
 };
-static_assert(sizeof(SessionConfiguration) == 9, "SessionConfiguration size mismatch");
+static_assert(sizeof(StartResult) == 64, "StartResult size mismatch");
+static_assert(sizeof(SessionConfiguration) <= sizeof(StartResult::config), "SessionConfiguration outgrew StartResult");
 
 class IProtocolHandler
 {
@@ -44,6 +282,8 @@ public:
     virtual ~IProtocolHandler() = default;
 
     virtual Status getStatus() = 0;
+    virtual Capabilities getCapabilities() = 0;
+    virtual Statistics getStatistics() = 0;
     virtual Status open() = 0;
     virtual Status close() = 0;
     virtual Status start() = 0;
@@ -51,5 +291,7 @@ public:
 
     virtual void configureSession(SessionConfiguration& config) = 0;
     virtual SessionConfiguration getSessionConfiguration() = 0;
+    virtual void configureAndStart(SessionConfiguration& config) = 0;
+    virtual void rearm() = 0;
 
 };
\ No newline at end of file
@@ -0,0 +1,124 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "dmaring.h"
+#include <hardware/irq.h>
+
+namespace
+{
+    DMARing* activeRing = nullptr;
+}
+
+DMARing::DMARing()
+{
+    channels[0]=dma_claim_unused_channel(false);
+    channels[1]=dma_claim_unused_channel(false);
+}
+
+DMARing::~DMARing()
+{
+    stop();
+    for (auto& channel : channels)
+    {
+        if (channel>=0) dma_channel_unclaim(channel);
+        channel=-1;
+    }
+}
+
+void DMARing::configure(const volatile void* source, uint dreq)
+{
+    this->source=source;
+    this->dreq=dreq;
+}
+
+bool DMARing::start(void* buffer, size_t bufferSizeInBytes)
+{
+    if (!isValid() || running || activeRing!=nullptr) return false;
+    if (buffer==nullptr || bufferSizeInBytes==0 || (bufferSizeInBytes%8)!=0) return false;
+
+    this->buffer=static_cast<uint32_t*>(buffer);
+    halfWords=bufferSizeInBytes/8;
+    completedHalves=0;
+
+    for (int i=0; i<2; ++i)
+    {
+        auto config=dma_channel_get_default_config(channels[i]);
+        channel_config_set_dreq(&config, dreq);
+        channel_config_set_read_increment(&config, false);
+        channel_config_set_write_increment(&config, true);
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+        channel_config_set_chain_to(&config, channels[1-i]);
+        dma_channel_configure(channels[i], &config, this->buffer+i*halfWords, source, halfWords, false);
+        dma_irqn_acknowledge_channel(IrqIndex, channels[i]);
+        dma_irqn_set_channel_enabled(IrqIndex, channels[i], true);
+    }
+
+    activeRing=this;
+    irq_add_shared_handler(DMA_IRQ_0+IrqIndex, &DMARing::irqHandler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0+IrqIndex, true);
+
+    running=true;
+    dma_channel_start(channels[0]);
+    return true;
+}
+
+void DMARing::stop()
+{
+    if (!running) return;
+    running=false;
+
+    for (auto channel : channels)
+    {
+        // break the chain first, so aborting one channel cannot start the other one
+        auto config=dma_get_channel_config(channel);
+        channel_config_set_chain_to(&config, channel);
+        dma_channel_set_config(channel, &config, false);
+        dma_irqn_set_channel_enabled(IrqIndex, channel, false);
+    }
+    for (auto channel : channels)
+    {
+        dma_channel_abort(channel);
+        dma_irqn_acknowledge_channel(IrqIndex, channel);
+    }
+
+    irq_remove_handler(DMA_IRQ_0+IrqIndex, &DMARing::irqHandler);
+    activeRing=nullptr;
+}
+
+uint64_t DMARing::getBytesWritten() const
+{
+    if (!isValid()) return 0;
+
+    // the half that is being written is the one following all completed halves.
+    // a channel that finished but was not rewound yet still reports 0 words left,
+    // so a late interrupt can only make us report too little, never too much.
+    uint32_t halves=0;
+    uint32_t remaining=0;
+    do
+    {
+        halves=completedHalves;
+        remaining=dma_channel_hw_addr(channels[halves%2])->transfer_count & 0x0fffffff; // upper bits are the count mode on rp2350
+    } while (halves!=completedHalves);
+
+    return (uint64_t(halves)*halfWords + (halfWords-remaining))*4;
+}
+
+void DMARing::handleInterrupt()
+{
+    for (int i=0; i<2; ++i)
+    {
+        if (dma_irqn_get_channel_status(IrqIndex, channels[i]))
+        {
+            dma_irqn_acknowledge_channel(IrqIndex, channels[i]);
+            // rewind without triggering, the other channel will chain back to us
+            dma_channel_set_write_addr(channels[i], buffer+i*halfWords, false);
+            completedHalves=completedHalves+1;
+        }
+    }
+}
+
+void DMARing::irqHandler()
+{
+    if (activeRing) activeRing->handleInterrupt();
+}
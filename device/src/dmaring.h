@@ -0,0 +1,54 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <hardware/dma.h>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+//! Two DMA channels chained to each other, each one filling one half of a
+//! buffer. When a channel finishes, the other one takes over immediately and
+//! an interrupt rewinds the finished channel to the start of its half, so
+//! data keeps flowing into the buffer until stop() is called.
+class DMARing
+{
+public:
+    DMARing();
+    ~DMARing();
+
+    // not copyable or movable, the interrupt handler keeps a pointer to us
+    DMARing(const DMARing&) = delete;
+    DMARing& operator=(const DMARing&) = delete;
+
+    inline bool isValid() const { return channels[0]>=0 && channels[1]>=0; }
+    inline bool isRunning() const { return running; }
+
+    //! read 32 bit words from 'source', paced by 'dreq'
+    void configure(const volatile void* source, uint dreq);
+
+    //! start filling 'buffer' over and over. the size must be a multiple of 8 bytes.
+    bool start(void* buffer, size_t bufferSizeInBytes);
+    void stop();
+
+    //! total number of bytes written since start(), counting every lap around the buffer
+    uint64_t getBytesWritten() const;
+
+    //! number of times a channel had to be rewound to the start of its half
+    inline uint32_t getRestartCount() const { return completedHalves; }
+
+private:
+    static constexpr uint IrqIndex = 1;     // DMA_IRQ_1, leave DMA_IRQ_0 to single transfers
+
+    int channels[2]={-1,-1};
+    const volatile void* source=nullptr;
+    uint dreq=0;
+    uint32_t* buffer=nullptr;
+    uint32_t halfWords=0;
+    volatile uint32_t completedHalves=0;
+    volatile bool running=false;
+
+    void handleInterrupt();
+    static void irqHandler();
+};
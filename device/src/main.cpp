@@ -1,8 +1,16 @@
 #include <pico/status_led.h>
 #include <tusb.h>
-#include "usbinterface.h"
+#include "usbpump.h"
 #include "logging.h"
 #include "sampler.h"
+#include "trigger.h"
+#include "rleencoder.h"
+#include "psram.h"
+#include <hardware/clocks.h>
+#include <pico/multicore.h>
+#include <pico/time.h>
+#include <algorithm>
+#include <cstring>
 #include <memory>
 
 class SigFeather : public IProtocolHandler
@@ -12,6 +20,7 @@ private:
     static constexpr uint32_t LedColorDriverConnected=PICO_COLORED_STATUS_LED_COLOR_FROM_WRGB(0,0,255,0);
     static constexpr uint32_t LedColorSampling=PICO_COLORED_STATUS_LED_COLOR_FROM_WRGB(0,0,0,255);
     static constexpr uint32_t LedColorError=PICO_COLORED_STATUS_LED_COLOR_FROM_WRGB(0,255,0,0);
+    static constexpr uint32_t DefaultSampleRate=10000;
 
 public:
     enum class State
@@ -28,7 +37,7 @@ public:
         state(State::NotConnected),
         sampleBuffer(nullptr),
         sampleBufferSize(0),
-        transferOffset(0),
+        transferred(0),
         currentConfig(),
         sampler(nullptr)
     {
@@ -38,6 +47,13 @@ public:
         {
             fatal("Failed to allocate sample buffer");
         }
+        captureBuffer=sampleBuffer;
+        captureBufferSize=sampleBufferSize;
+        if (psram.init())
+        {
+            Info("PSRAM: %u bytes, DMA writes %u bytes/s, deep capture of 1 channel up to %u Hz",
+                uint32_t(psram.getSize()), psram.getWriteBandwidth(), psram.getMaxSampleRate(1));
+        }
     }
     virtual ~SigFeather() = default;
 
@@ -59,6 +75,32 @@ public:
         }
     }
     
+    Capabilities getCapabilities() override
+    {
+        Capabilities capabilities;
+        for (uint bit=0; bit<6; ++bit)
+        {
+            if (Sampler::isValidChannelCount(1u<<bit)) capabilities.channelCounts|=uint8_t(1u<<bit);
+        }
+        capabilities.pinCount=NUM_BANK0_GPIOS;
+        capabilities.flags=CapabilityUnbounded | CapabilityCompressed | CapabilityTriggered | CapabilityFramed | CapabilityQuickStart | CapabilitySegmented | CapabilityChanges |
+            (psram.isValid() ? CapabilityDeep : 0);
+        capabilities.systemClock=clock_get_hz(clk_sys);
+        capabilities.deepBandwidth=psram.getSustainedBandwidth();
+        capabilities.sampleBufferSize=sampleBufferSize;
+        capabilities.deepBufferSize=psram.getSize();
+        return capabilities;
+    }
+
+    Statistics getStatistics() override
+    {
+        Statistics result=statistics;
+        if (sampler) result.dmaRestarts=sampler->getDmaRestarts();
+        uint64_t elapsed=lastUpdate-sessionStart;
+        result.updateRate=elapsed>0 ? uint32_t(updates*1000000/elapsed) : 0;
+        return result;
+    }
+
     Status open() override
     {
         switch (state)
@@ -147,6 +189,14 @@ public:
             fatal("Unknown state in start: %d", state);
             return Status::Error;
         }
+        sessionFailed=false;
+        if (sessionRejected)
+        {
+            // a session that was running is stopped by now, there is nothing to start
+            colored_status_led_set_on_with_color(LedColorDriverConnected);
+            state=State::DriverConnected;
+            return Status::Error;
+        }
         if (startSampling())
         {
             Info("Sampling (re)started");
@@ -166,7 +216,14 @@ public:
         switch (state)
         {
         case State::Error: return Status::Error; // we do not try to recover from error state
-        case State::DriverConnected: return Status::Opened; // should not happen, but benign
+        case State::DriverConnected:
+            // a session ended by failSession() reports its error once
+            if (sessionFailed)
+            {
+                sessionFailed=false;
+                return Status::Error;
+            }
+            return Status::Opened;
         case State::NotConnected:
         case State::UsbConnected:
             fatal("Unexpected open event while in state %d:", state);
@@ -193,6 +250,8 @@ public:
 
     virtual void configureSession(SessionConfiguration& config)
     {
+        requestedConfig=config;
+        sessionRejected=false;
         switch (config.type)
         {
         case SessionType::Benchmark:
@@ -206,36 +265,190 @@ public:
                 sampleBuffer[i]=static_cast<uint8_t>(i % 251);
             }
             currentConfig.bytesLeft=currentConfig.sampleCount;
-            transferOffset=0;
-            Info("Configured session: type=Benchmark, sampleCount=%u", config.sampleCount);
+            currentConfig.flags=0;
+            currentConfig.segmentCount=0;
+            captureBuffer=sampleBuffer;
+            captureBufferSize=sampleBufferSize;
+            transferred=0;
+            Info("Configured session: type=Benchmark, sampleCount=%u", uint32_t(currentConfig.sampleCount));
             break;
         case SessionType::SingleBit:
+            config.basePin=2; // single bit sessions always sample pin 2
+            config.channelCount=1;
+            // fallthrough
+        case SessionType::MultiChannel:
+        case SessionType::Changes:
         {
+            trigger.reset();
+            sampler.reset();
             currentConfig=config;
-            sampler=std::make_unique<Sampler>(2); // hardcoded pin 2 for now
+            bool changes=currentConfig.type==SessionType::Changes;
+            if (changes)
+            {
+                // change records are streamed until the host stops the session. record
+                // offsets count bytes, so framing works, compression does not.
+                currentConfig.flags=(currentConfig.flags | SessionFlagUnbounded) & ~SessionFlagCompressed;
+                currentConfig.triggerType=TriggerType::None;
+                currentConfig.segmentCount=0;
+            }
+            if (!Sampler::isValidChannelCount(currentConfig.channelCount) ||
+                currentConfig.basePin+currentConfig.channelCount>NUM_BANK0_GPIOS)
+            {
+                reject("Invalid channel configuration: basePin=%u, channelCount=%u", currentConfig.basePin, currentConfig.channelCount);
+                return;
+            }
+            bool unbounded=(currentConfig.flags & SessionFlagUnbounded)!=0;
+            bool triggered=currentConfig.triggerType!=TriggerType::None;
+            bool segmented=currentConfig.segmentCount>1;
+            if (unbounded && (triggered || segmented))
+            {
+                reject("Triggered and segmented sessions cannot be unbounded");
+                return;
+            }
+            // segments are sent as framed records, and gaps are reported in sample
+            // bytes, which a compressed stream does not have
+            if (segmented) currentConfig.flags=(currentConfig.flags & ~SessionFlagCompressed) | SessionFlagFramed;
+            if ((currentConfig.flags & SessionFlagCompressed)!=0) currentConfig.flags&=~SessionFlagFramed;
+            // deep sessions are one-shot captures, rings stay in SRAM
+            if (!psram.isValid() || unbounded || triggered || segmented) currentConfig.flags&=~SessionFlagDeep;
+            if (!segmented) currentConfig.segmentCount=0;
+            bool deep=(currentConfig.flags & SessionFlagDeep)!=0;
+            captureBuffer=deep ? psram.getBuffer() : sampleBuffer;
+            captureBufferSize=deep ? psram.getSize() : sampleBufferSize;
+
+            // a change-only loop resolves changes best at full speed
+            if (currentConfig.sampleRate==0) currentConfig.sampleRate=changes ? clock_get_hz(clk_sys) : DefaultSampleRate;
+            uint32_t maxRate=deep ? psram.getMaxSampleRate(currentConfig.channelCount) : 0;
+            if (deep && currentConfig.sampleRate>maxRate) currentConfig.sampleRate=maxRate;
+            uint16_t divInt=0;
+            uint8_t divFrac=0;
+            currentConfig.systemClock=clock_get_hz(clk_sys);
+            Sampler::findClockDivider(currentConfig.systemClock, currentConfig.sampleRate, divInt, divFrac);
+            uint32_t divider=uint32_t(divInt)*256+divFrac;
+            if (deep && divider<0xffffff && uint64_t(currentConfig.systemClock)*256>uint64_t(maxRate)*divider)
+            {
+                // the closest divider may round above what PSRAM keeps up with
+                ++divider;
+                divInt=static_cast<uint16_t>(divider>>8);
+                divFrac=static_cast<uint8_t>(divider&0xff);
+            }
+            currentConfig.clockDividerInt=divInt;
+            currentConfig.clockDividerFrac=divFrac;
+            currentConfig.sampleRate=static_cast<uint32_t>((uint64_t(currentConfig.systemClock)*256 + getClockDivider()/2) / getClockDivider());
+            sampler=std::make_unique<Sampler>(currentConfig.basePin, currentConfig.channelCount, divInt, divFrac, unbounded || triggered || segmented, changes);
             if (!sampler->isValid())
             {
-                sampler.reset();
-                fatal("Failed to initialize sampler for SingleBit session");
+                reject("Failed to initialize sampler for sampling session");
+                return;
+            }
+            if (triggered)
+            {
+                if (configureTrigger(divInt, divFrac) && segmented) configureSegments();
+                return;
+            }
+            if (segmented)
+            {
+                configureSegments();
                 return;
             }
-            size_t sampleCount=currentConfig.sampleCount;
-            currentConfig.bytesLeft=sampler->prepareSampling(sampleBuffer, sampleBufferSize, sampleCount);
-            currentConfig.sampleCount=static_cast<uint32_t>(sampleCount);
-            Info("Configured session: type=SingleBit, sampleCount=%u, bytes=%u", currentConfig.sampleCount, currentConfig.bytesLeft);
+            if (unbounded)
+            {
+                currentConfig.sampleCount=0;
+                currentConfig.bytesLeft=0;
+                Info("Configured session: basePin=%u, channels=%u, rate=%u, unbounded%s", currentConfig.basePin, currentConfig.channelCount, currentConfig.sampleRate,
+                    changes ? ", changes only" : "");
+                return;
+            }
+            // the buffer holds at most 8 samples per byte, so the count fits size_t after clamping
+            size_t sampleCount=size_t(std::min<uint64_t>(currentConfig.sampleCount, uint64_t(captureBufferSize)*8));
+            currentConfig.bytesLeft=sampler->prepareSampling(captureBuffer, captureBufferSize, sampleCount);
+            currentConfig.sampleCount=sampleCount;
+            Info("Configured session: basePin=%u, channels=%u, rate=%u, sampleCount=%u, bytes=%u%s", currentConfig.basePin, currentConfig.channelCount, currentConfig.sampleRate,
+                uint32_t(currentConfig.sampleCount), uint32_t(currentConfig.bytesLeft), deep ? ", deep" : "");
             return;
         }
         default:
-            fatal("Unknown session type requested: %d", static_cast<uint8_t>(config.type));
+            reject("Unknown session type requested: %d", static_cast<uint8_t>(config.type));
             return;
         }
     }   
 
+    bool configureTrigger(uint16_t divInt, uint8_t divFrac)
+    {
+        // packed fields cannot be forwarded by reference
+        TriggerType type=currentConfig.triggerType;
+        uint pin=currentConfig.triggerPin;
+        uint width=currentConfig.triggerWidth;
+        uint32_t pattern=currentConfig.triggerPattern;
+        trigger=std::make_unique<Trigger>(type, pin, width, pattern, divInt, divFrac);
+        if (!trigger->isValid())
+        {
+            reject("Failed to initialize trigger type %u on pin %u", static_cast<uint8_t>(type), pin);
+            return false;
+        }
+
+        // the window may fill half the buffer, the other half absorbs the
+        // delay until update() notices that the window is complete
+        size_t samplesPerWord=sampler->getSamplesPerWord();
+        size_t maxSamples=(captureBufferSize/2/4)*samplesPerWord;
+        if (currentConfig.sampleCount>maxSamples) currentConfig.sampleCount=maxSamples;
+        if (currentConfig.preTriggerSamples>currentConfig.sampleCount) currentConfig.preTriggerSamples=currentConfig.sampleCount;
+
+        size_t preTriggerWords=currentConfig.preTriggerSamples/samplesPerWord;
+        size_t totalWords=(currentConfig.sampleCount+samplesPerWord-1)/samplesPerWord;
+        currentConfig.preTriggerSamples=preTriggerWords*samplesPerWord;
+        currentConfig.bytesLeft=totalWords*4;
+        preTriggerBytes=preTriggerWords*4;
+        Info("Configured session: basePin=%u, channels=%u, rate=%u, sampleCount=%u, bytes=%u, trigger=%u on pin %u, pre=%u",
+            currentConfig.basePin, currentConfig.channelCount, currentConfig.sampleRate, uint32_t(currentConfig.sampleCount), uint32_t(currentConfig.bytesLeft),
+            static_cast<uint8_t>(currentConfig.triggerType), currentConfig.triggerPin, uint32_t(currentConfig.preTriggerSamples));
+        return true;
+    }
+
+    //! segmented sessions: sizes the window of untriggered segments like
+    //! configureTrigger() does, and the interval between them
+    void configureSegments()
+    {
+        size_t samplesPerWord=sampler->getSamplesPerWord();
+        if (!trigger)
+        {
+            size_t maxSamples=(captureBufferSize/2/4)*samplesPerWord;
+            if (currentConfig.sampleCount>maxSamples) currentConfig.sampleCount=maxSamples;
+            currentConfig.preTriggerSamples=0;
+            currentConfig.bytesLeft=(currentConfig.sampleCount+samplesPerWord-1)/samplesPerWord*4;
+            preTriggerBytes=0;
+        }
+        segmentBytes=currentConfig.bytesLeft;
+        // segments follow each other in the stream, so each holds whole sample words
+        currentConfig.sampleCount=segmentBytes/4*samplesPerWord;
+        currentConfig.bytesLeft*=currentConfig.segmentCount;
+        // timed segments start on whole words and never overlap
+        uint64_t intervalWords=(uint64_t(currentConfig.segmentInterval)+samplesPerWord-1)/samplesPerWord;
+        segmentInterval=std::max<uint64_t>(intervalWords*4, segmentBytes);
+        currentConfig.segmentInterval=uint32_t(std::min<uint64_t>(segmentInterval/4*samplesPerWord, UINT32_MAX));
+        if (trigger) currentConfig.segmentInterval=0;
+        Info("Configured %u segments of %u bytes%s", currentConfig.segmentCount, uint32_t(segmentBytes), trigger ? ", triggered" : "");
+    }
+
     virtual SessionConfiguration getSessionConfiguration()
     {
        return currentConfig;
     }
 
+    void configureAndStart(SessionConfiguration& config) override
+    {
+        configureSession(config);
+        sendStartResult(start());
+    }
+
+    void rearm() override
+    {
+        // the device may have changed the last configuration, so start over from the request
+        SessionConfiguration config=requestedConfig;
+        configureSession(config);
+        sendStartResult(start());
+    }
+
     // interface for main()
     inline State getState() const { return state; }
 
@@ -292,6 +505,39 @@ public:
         Info("USB BUS disconnected");
     }
 
+    //! refuses a session the host asked for. unlike fatal() the device stays
+    //! usable, start() reports Status::Error until a valid session is configured.
+    void reject(const char* message,...)
+    {
+        va_list args;
+        va_start(args, message);
+        ErrorV(message,args);
+        va_end(args);
+
+        trigger.reset();
+        sampler.reset();
+        sessionRejected=true;
+    }
+
+    //! ends a running session the device cannot continue. unlike fatal() the
+    //! device stays usable, the host's Stop reports Status::Error once.
+    void failSession(const char* message,...)
+    {
+        va_list args;
+        va_start(args, message);
+        ErrorV(message,args);
+        va_end(args);
+
+        if (!stopSampling())
+        {
+            fatal("Failed to stop sampling after a session failed");
+            return;
+        }
+        colored_status_led_set_on_with_color(LedColorDriverConnected);
+        state=State::DriverConnected;
+        sessionFailed=true;
+    }
+
     void fatal(const char* message,...)
     {
         va_list args;
@@ -303,53 +549,420 @@ public:
         state=State::Error;        
     }
 
+    void setPump(UsbPump& usbPump)
+    {
+        pump=&usbPump;
+    }
+
+    //! called in the core0 loop: accounts for the regions core1 has sent and
+    //! queues the next ones
     void update()
     {
         if (state==State::Sampling)
         {
-            if (currentConfig.bytesLeft==0)
+            updateStatistics();
+            if (state==State::Sampling) collectCompleted();
+        }
+        if (state==State::Sampling) transmitNext();
+    }
+
+private:
+    State state;
+    uint8_t* sampleBuffer;
+    size_t sampleBufferSize=0;
+    Psram psram;
+    uint8_t* captureBuffer=nullptr;     // sampleBuffer, or the PSRAM for deep sessions
+    size_t captureBufferSize=0;
+    uint64_t transferred=0;     // bytes sent since start, in continuous mode this wraps around captureBuffer
+    SessionConfiguration currentConfig{};
+    SessionConfiguration requestedConfig{};     // as the host sent it, for rearm()
+    StartResult startResult{};
+    bool startResultQueued=false;   // its completion comes ahead of the session's regions
+    bool sessionRejected=false;     // the last configureSession() was refused, see reject()
+    bool sessionFailed=false;       // the last session was ended by failSession()
+    std::unique_ptr<Sampler> sampler;
+    std::unique_ptr<Trigger> trigger;
+    RleEncoder encoder;
+    uint64_t preTriggerBytes=0;
+    uint64_t windowEnd=0;       // sampler byte count at which a triggered window is complete
+    bool waitingForTrigger=false;
+    UsbPump* pump=nullptr;
+    uint32_t queuedRegions=0;       // handed to core1 and not completed yet
+    uint64_t queuedBytes=0;         // sample bytes in those regions, uncompressed sessions only
+    Statistics statistics{};        // of the current or last session, see getStatistics()
+    uint64_t sessionStart=0;        // time_us_64() at start
+    uint64_t lastUpdate=0;          // time_us_64() of the last update() while sampling
+    uint64_t updates=0;             // update() calls while sampling
+
+    // framed sessions, see protocol.h. record i uses slot i%MaxQueuedRegions,
+    // which is free again since at most MaxQueuedRegions records are queued.
+    struct QueuedRecord
+    {
+        uint64_t offset;
+        uint32_t bytes;
+        bool data;
+    };
+    FrameHeader frameHeaders[UsbPump::MaxQueuedRegions]{};
+    QueuedRecord queuedRecords[UsbPump::MaxQueuedRegions]{};
+    uint32_t frameSequence=0;       // records queued since start
+    uint64_t streamStart=0;         // sampler byte count of offset 0, the window start of a triggered session
+    uint64_t nextOffset=0;          // sampler byte count of the next data record
+    uint64_t verifiedOffset=0;      // all data records below were sent intact
+    bool endQueued=false;
+
+    // segmented sessions: segments start while earlier ones are still being
+    // sent, so their start positions wait in a small ring. the trigger is only
+    // re-armed while the ring has room.
+    static constexpr uint32_t MaxPendingSegments=16;
+    uint64_t segmentStarts[MaxPendingSegments]{};
+    uint64_t segmentBytes=0;        // sample bytes of one segment
+    uint64_t segmentInterval=0;     // bytes from one untriggered segment to the next
+    uint32_t segmentsStarted=0;     // start positions recorded
+    uint32_t segmentsQueued=0;      // Segment records queued
+    uint64_t armPosition=0;         // sampler byte count from which the next segment may start
+    uint64_t segmentEnd=0;          // sampler byte count at which the segment being sent ends
+
+    //! loop timing and FIFO stalls, once per update() while sampling
+    void updateStatistics()
+    {
+        uint64_t now=time_us_64();
+        uint64_t gap=now-lastUpdate;
+        if (gap>statistics.maxUpdateGap) statistics.maxUpdateGap=uint32_t(std::min<uint64_t>(gap, UINT32_MAX));
+        lastUpdate=now;
+        ++updates;
+        if (sampler && sampler->checkFifoOverflow())
+        {
+            ++statistics.fifoOverflows;
+            // a stalled change loop no longer knows how much time passed
+            if (sampler->isChangesOnly()) failSession("Change records were delayed by a full FIFO");
+        }
+    }
+
+    //! arms the trigger once enough pre-trigger data is sampled and positions the
+    //! transfer at the start of the window once it fired. returns true when
+    //! window data may be sent.
+    bool updateTrigger()
+    {
+        if (waitingForTrigger)
+        {
+            if (!trigger->isTriggered())
+            {
+                if (!trigger->isArmed() && sampler->getBytesAvailable()>=preTriggerBytes)
+                {
+                    if (!trigger->arm(*sampler))
+                    {
+                        fatal("Failed to arm trigger");
+                    }
+                }
+                return false;
+            }
+
+            // the trigger is never armed before preTriggerBytes were sampled, so this cannot underflow
+            transferred=trigger->getPosition()-preTriggerBytes;
+            windowEnd=transferred+currentConfig.bytesLeft;
+            streamStart=nextOffset=verifiedOffset=transferred;
+            waitingForTrigger=false;
+            Info("Triggered at sample word %u", uint32_t(trigger->getPosition()/4));
+        }
+        if (sampler->isRunning() && sampler->getBytesAvailable()>=windowEnd)
+        {
+            sampler->stop();
+        }
+        return true;
+    }
+
+    //! segmented sessions: records where each segment starts and re-arms the
+    //! trigger as soon as the sampler has left the previous window and sampled
+    //! the next pre-trigger data, so the dead time between two segments is the
+    //! pre-trigger time plus one pass of the core0 loop
+    void updateSegments()
+    {
+        uint64_t produced=sampler->getBytesAvailable();
+        if (segmentsStarted==currentConfig.segmentCount)
+        {
+            if (sampler->isRunning() && produced>=armPosition-preTriggerBytes) sampler->stop();
+            return;
+        }
+        if (segmentsStarted-segmentsQueued==MaxPendingSegments) return;
+
+        uint64_t start=0;
+        if (!trigger)
+        {
+            start=uint64_t(segmentsStarted)*segmentInterval;
+            if (produced<start) return;
+        }
+        else if (trigger->isArmed() && trigger->isTriggered())
+        {
+            // the trigger is never armed before the pre-trigger data behind the last window was sampled
+            start=trigger->getPosition()-preTriggerBytes;
+            trigger->disarm();
+        }
+        else
+        {
+            if (!trigger->isArmed() && produced>=armPosition && !trigger->arm(*sampler))
             {
-                tud_vendor_n_write_flush(0);
-                stop();
+                fatal("Failed to arm trigger");
+            }
+            return;
+        }
+        segmentStarts[segmentsStarted%MaxPendingSegments]=start;
+        ++segmentsStarted;
+        armPosition=start+segmentBytes+preTriggerBytes;
+    }
+
+    //! segmented sessions: queues the Segment record of the next segment that
+    //! started and moves the transfer to it
+    bool startNextSegment()
+    {
+        if (segmentsQueued==segmentsStarted) return false;
+        uint64_t start=segmentStarts[segmentsQueued%MaxPendingSegments];
+        // the timestamp counts sample clocks since sampling started
+        uint64_t timestamp=start*8/currentConfig.channelCount;
+        if (!queueRecord(FrameType::Segment, start, uint32_t(segmentBytes), nullptr, timestamp, segmentsQueued)) return false;
+        nextOffset=start;
+        segmentEnd=start+segmentBytes;
+        ++segmentsQueued;
+        return true;
+    }
+
+    //! takes the regions core1 has finished sending in the order they were queued
+    void collectCompleted()
+    {
+        bool compressed=(currentConfig.flags & SessionFlagCompressed)!=0;
+        bool framed=(currentConfig.flags & SessionFlagFramed)!=0;
+        uint32_t bytes=0;
+        bool success=false;
+        while (pump->takeCompleted(bytes, success))
+        {
+            if (!success)
+            {
+                fatal("USB transfer failed after %u bytes", bytes);
                 return;
             }
+            if (startResultQueued)
+            {
+                startResultQueued=false;
+                continue;
+            }
+            if (framed)
+            {
+                // records complete in the order they were queued
+                QueuedRecord record=queuedRecords[(frameSequence-queuedRegions)%UsbPump::MaxQueuedRegions];
+                --queuedRegions;
+                statistics.bytesSent+=sizeof(FrameHeader)+bytes;
+                if (record.data) completeRecord(record);
+                continue;
+            }
+            --queuedRegions;
+            statistics.bytesSent+=bytes;
+            if (compressed)
+            {
+                encoder.consume(bytes);
+                continue;
+            }
+            // the region was read by the USB controller until now, so it must still be intact
+            if (sampler && sampler->isContinuous() && sampler->getBytesAvailable()-transferred>captureBufferSize)
+            {
+                fatal("Sampler overwrote data while it was being transferred");
+                return;
+            }
+            transferred+=bytes;
+            queuedBytes-=bytes;
+            if ((currentConfig.flags & SessionFlagUnbounded)==0) currentConfig.bytesLeft-=bytes;
+        }
+    }
+
+    //! framed sessions: queues a record, the header of record i lives in slot
+    //! i%MaxQueuedRegions until it was sent
+    bool queueRecord(FrameType type, uint64_t offset, uint32_t bytes, const uint8_t* data, uint64_t timestamp=0, uint32_t segment=0)
+    {
+        uint32_t slot=frameSequence%UsbPump::MaxQueuedRegions;
+        FrameHeader& header=frameHeaders[slot];
+        header=FrameHeader{};
+        header.type=type;
+        header.sequence=frameSequence;
+        header.bytes=bytes;
+        header.offset=offset-streamStart;
+        header.verified=verifiedOffset-streamStart;
+        header.timestamp=timestamp;
+        header.segment=segment;
+        if (!pump->submit(data, type==FrameType::Data ? bytes : 0, reinterpret_cast<const uint8_t*>(&header), sizeof(header))) return false;
+        queuedRecords[slot]=QueuedRecord{offset, bytes, type==FrameType::Data};
+        ++frameSequence;
+        ++queuedRegions;
+        return true;
+    }
+
+    //! framed sessions: a data record was sent. the sampler may have overwritten
+    //! it while it was read, then a gap takes it back.
+    void completeRecord(const QueuedRecord& record)
+    {
+        queuedBytes-=record.bytes;
+        transferred=record.offset+record.bytes;
+        verifiedOffset=transferred;
+        if ((currentConfig.flags & SessionFlagUnbounded)==0) currentConfig.bytesLeft-=record.bytes;
+        if (sampler && sampler->isContinuous() && sampler->getBytesAvailable()-record.offset>captureBufferSize)
+        {
+            statistics.lostBytes+=record.bytes;
+            // a completion just freed a slot
+            if (!queueRecord(FrameType::Gap, record.offset, record.bytes, nullptr, getChangeTimestamp()))
+            {
+                fatal("Failed to queue a gap record");
+            }
+        }
+    }
+
+    //! framed sessions: the sampler overwrote data before it was queued, so
+    //! report a gap and resume with half a buffer of headroom, but never beyond
+    //! 'remaining' bytes
+    bool skipOverrun(uint64_t produced, bool unbounded, uint64_t remaining)
+    {
+        // a change session resumes at its newest record, which is close to the
+        // time the gap record carries
+        uint64_t resume=sampler->isChangesOnly() ? produced/sizeof(ChangeRecord)*sizeof(ChangeRecord)-sizeof(ChangeRecord) : produced-captureBufferSize/2;
+        uint64_t lost=std::min<uint64_t>(resume-nextOffset, 0xfffffffc);
+        if (!unbounded) lost=std::min(lost, remaining);
+        if (lost==0) return false;
+        if (!queueRecord(FrameType::Gap, nextOffset, uint32_t(lost), nullptr, getChangeTimestamp())) return false;
+        nextOffset+=lost;
+        statistics.lostBytes+=lost;
+        if (!unbounded) currentConfig.bytesLeft-=lost;
+        return true;
+    }
 
-            size_t available=0;
+    //! queues sampled regions of the sample buffer or the encoder output for
+    //! core1, or stops the session once all data was sent
+    void transmitNext()
+    {
+        bool unbounded=(currentConfig.flags & SessionFlagUnbounded)!=0;
+        bool compressed=(currentConfig.flags & SessionFlagCompressed)!=0;
+        bool framed=(currentConfig.flags & SessionFlagFramed)!=0;
+        // bytesLeft only drops to 0 once the last region completed
+        if (!unbounded && currentConfig.bytesLeft==0 && encoder.isEmpty())
+        {
+            // a framed session ends with an End record behind any gap records
+            if (framed && !endQueued)
+            {
+                if (queuedRegions==0) endQueued=queueRecord(FrameType::End, nextOffset, 0, nullptr);
+                return;
+            }
+            if (queuedRegions==0 && !startResultQueued) stop();
+            return;
+        }
+
+        bool segmented=currentConfig.segmentCount>1;
+        if (segmented) updateSegments();
+        else if (trigger && !updateTrigger()) return;
+
+        while (queuedRegions<UsbPump::MaxQueuedRegions)
+        {
+            if (segmented && nextOffset==segmentEnd)
+            {
+                if (!startNextSegment()) return;
+                continue;
+            }
+            // uncompressed regions are queued back to back, so the next one starts behind them
+            uint64_t next=framed ? nextOffset : transferred+queuedBytes;
+            uint64_t available=0;
+            // data left to queue: in the segment being sent, or in the whole session
+            uint64_t remaining=segmented ? segmentEnd-next : currentConfig.bytesLeft-queuedBytes;
             if (sampler && sampler->isValid())
             {
-                // debug
-                Sampler* samplerPtr=sampler.get();
-                available=samplerPtr->getBytesAvailable();
-                if (available<transferOffset)
+                uint64_t produced=sampler->getBytesAvailable();
+                if (produced<transferred)
+                {
+                    fatal("Sampler reported less available bytes (%u) than already transferred (%u)", uint32_t(produced), uint32_t(transferred));
+                    return;
+                }
+                if (produced-transferred>statistics.peakLag) statistics.peakLag=produced-transferred;
+                if (framed && produced-next>captureBufferSize)
+                {
+                    if (!skipOverrun(produced, unbounded, remaining)) return;
+                    continue;
+                }
+                if (!framed && produced-transferred>captureBufferSize)
                 {
-                    fatal("Sampler reported less available bytes (%u) than already transferred (%u)", available, transferOffset);
+                    fatal("Sampler overran the USB transfer by %u bytes", uint32_t(produced-transferred-captureBufferSize));
                     return;
                 }
-                available-=transferOffset;
+                available=produced-next;
             }
             else if (currentConfig.type==SessionType::Benchmark)
             {
-                available=currentConfig.bytesLeft;
+                available=currentConfig.bytesLeft-queuedBytes;
+            }
+            if (!unbounded && available>remaining) available=remaining;
+            // the sampler wraps around in continuous mode, so never send across the end of the buffer
+            size_t offset=next%captureBufferSize;
+            if (available>captureBufferSize-offset) available=captureBufferSize-offset;
+            if (compressed)
+            {
+                sendCompressed(offset, available, unbounded);
+                return;
             }
-            if (available>currentConfig.bytesLeft) available=currentConfig.bytesLeft;
-            if (available==0) return;
-            uint32_t max=tud_vendor_n_write_available(0);
-            if (available>max) available=max;
             if (available==0) return;
- 
-            tud_vendor_n_write(0, sampleBuffer+transferOffset, available);
-            transferOffset+=available;
-            currentConfig.bytesLeft-=available;
+
+            uint32_t bytes=uint32_t(std::min<uint64_t>(available, USBInterface::MaxTransferBytes));
+            if (framed)
+            {
+                if (!queueRecord(FrameType::Data, next, bytes, captureBuffer+offset)) return;
+                nextOffset+=bytes;
+                queuedBytes+=bytes;
+                continue;
+            }
+            if (!pump->submit(captureBuffer+offset, bytes)) return;
+            ++queuedRegions;
+            queuedBytes+=bytes;
         }
     }
 
-private:
-    State state;
-    uint8_t* sampleBuffer;
-    size_t sampleBufferSize=0;
-    size_t transferOffset=0;
-    SessionConfiguration currentConfig{};
-    std::unique_ptr<Sampler> sampler;
+    //! encodes whole sample words at 'offset' once all previously encoded data
+    //! was sent, then starts sending the encoded data. 'transferred'
+    //! and bytesLeft count the sample bytes consumed by the encoder.
+    void sendCompressed(size_t offset, uint64_t available, bool unbounded)
+    {
+        // the staging buffer is sent in one region, so only one is queued at a time
+        if (queuedRegions>0) return;
+        if (encoder.isEmpty() && available>=4)
+        {
+            size_t words=encoder.encode(reinterpret_cast<const uint32_t*>(captureBuffer+offset), available/4);
+            if (sampler->isContinuous() && sampler->getBytesAvailable()-transferred>captureBufferSize)
+            {
+                fatal("Sampler overwrote data while it was being compressed");
+                return;
+            }
+            transferred+=words*4;
+            if (!unbounded) currentConfig.bytesLeft-=words*4;
+        }
+
+        // the staged blocks are sent in place, collectCompleted() consumes them
+        size_t pending=encoder.getPendingBytes();
+        if (pending==0) return;
+        if (pump->submit(encoder.getPendingData(), uint32_t(pending))) ++queuedRegions;
+    }
+
+    //! queues the outcome of a quick start ahead of the sample data. the result
+    //! is sent even if the session failed to start, the host waits for it.
+    void sendStartResult(Status status)
+    {
+        startResult=StartResult{};
+        startResult.status=status;
+        std::memcpy(startResult.config, &currentConfig, sizeof(currentConfig));
+        startResultQueued=pump->submit(nullptr, 0, reinterpret_cast<const uint8_t*>(&startResult), sizeof(startResult)) &&
+            status==Status::Running;
+    }
+
+    //! change sessions: sampler clocks since the session started, an estimate of
+    //! the time of the newest record for a gap record
+    uint64_t getChangeTimestamp() const
+    {
+        if (!sampler || !sampler->isChangesOnly()) return 0;
+        uint64_t elapsed=time_us_64()-sessionStart;
+        return elapsed/1000000*currentConfig.sampleRate + elapsed%1000000*currentConfig.sampleRate/1000000;
+    }
+
+    //! sampler clock divider of the current session in 1/256 steps
+    inline uint32_t getClockDivider() const { return uint32_t(currentConfig.clockDividerInt)*256+currentConfig.clockDividerFrac; }
 
     bool openDriver()
     {
@@ -371,39 +984,85 @@ private:
             currentConfig.bytesLeft=currentConfig.sampleCount;
             break;
         case SessionType::SingleBit:
+        case SessionType::MultiChannel:
+        case SessionType::Changes:
+        {
             if (!sampler || !sampler->isValid())
             {
-                fatal("Sampler not initialized for SingleBit session");
+                fatal("Sampler not initialized for sampling session");
                 sampler=nullptr;
                 return false;
             }
             if (sampler->isRunning())
             {
-                fatal("Sampler already running when starting SingleBit session");
+                fatal("Sampler already running when starting sampling session");
                 return false;
             }
-            size_t sampleCount=currentConfig.sampleCount;
-            sampler->startSampling(sampleBuffer, sampleBufferSize, sampleCount);
+            if (sampler->isContinuous())
+            {
+                if (!sampler->startContinuous(captureBuffer, captureBufferSize))
+                {
+                    fatal("Sampler could not start continuous sampling");
+                    return false;
+                }
+                waitingForTrigger=(trigger!=nullptr) && currentConfig.segmentCount<=1;
+                break;
+            }
+            size_t sampleCount=size_t(currentConfig.sampleCount);
+            sampler->startSampling(captureBuffer, captureBufferSize, sampleCount);
             if (sampleCount!=currentConfig.sampleCount)
             {
-                fatal("Sampler could not start full sampling session, expected %u samples, got %u samples", currentConfig.sampleCount, sampleCount);
+                fatal("Sampler could not start full sampling session, expected %u samples, got %u samples", uint32_t(currentConfig.sampleCount), uint32_t(sampleCount));
                 return false;
             }
             break;
         }
-        transferOffset=0;
+        default:
+            // configureSession rejects unknown types, so this is a session type it accepts but cannot start
+            fatal("No way to start session type %u", unsigned(currentConfig.type));
+            return false;
+        }
+        transferred=0;
+        queuedRegions=0;
+        queuedBytes=0;
+        encoder.reset();
+        frameSequence=0;
+        streamStart=nextOffset=verifiedOffset=0;
+        endQueued=false;
+        segmentsStarted=segmentsQueued=0;
+        armPosition=preTriggerBytes;
+        segmentEnd=0;
+        statistics=Statistics{};
+        statistics.bufferSize=captureBufferSize;
+        sessionStart=lastUpdate=time_us_64();
+        updates=0;
         return true;
     }
 
     bool stopSampling()
     {
-        // stop data acquisition
+        // stop data acquisition. a transfer still running on core1 reads
+        // memory that stays allocated, its completion is not reported.
+        pump->cancel();
+        queuedRegions=0;
+        queuedBytes=0;
+        startResultQueued=false;
+        if (sampler) statistics.dmaRestarts=sampler->getDmaRestarts();
+        trigger=nullptr;
         sampler=nullptr;
+        encoder.reset();
         return true;
     }
 };
 
-SigFeather* globalInstance=nullptr;
+UsbPump* globalPump=nullptr;
+
+// core1 only services USB, so sample data leaves the device with a steady
+// latency no matter what core0 is busy with
+void core1Main()
+{
+    globalPump->run();
+}
 
 int main(void)
 {
@@ -415,19 +1074,22 @@ int main(void)
     Info("--- New Session ---");
 
     SigFeather sigFeather;
-    globalInstance=&sigFeather;
-    USBInterface interface(sigFeather);
-
-    tusb_rhport_init_t dev_init = {
-        .role = TUSB_ROLE_DEVICE,
-        .speed = TUSB_SPEED_AUTO
-    };
-    tusb_init(0, &dev_init); // initialize device stack on roothub port 0
+    UsbPump pump;
+    globalPump=&pump;
+    sigFeather.setPump(pump);
+    multicore_launch_core1(core1Main);
 
+    uint32_t connectionEvents=0;
     while (true)
     {
+        // mounts and unmounts alternate, starting with a mount
+        for (; connectionEvents!=pump.getConnectionEvents(); ++connectionEvents)
+        {
+            if (connectionEvents%2==0) sigFeather.usbConnected();
+            else sigFeather.usbDisconnected();
+        }
+        pump.serveControl(sigFeather);
         sigFeather.update();
-        tud_task();
     }
 }
 
@@ -440,17 +1102,15 @@ void USB0_IRQHandler(void) {
 }
 
 
-// Invoked when device is mounted
+// Invoked when device is mounted, on core1
 void tud_mount_cb(void)
 {
-    globalInstance->usbConnected();
+    globalPump->connectionChanged();
 }
 
 void tud_umount_cb(void)
 {
-    globalInstance->usbDisconnected();
+    globalPump->connectionChanged();
 }
 
 }
-
-
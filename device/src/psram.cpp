@@ -0,0 +1,169 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "psram.h"
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/gpio.h>
+#include <hardware/sync.h>
+#include <hardware/structs/qmi.h>
+#include <hardware/structs/xip_ctrl.h>
+#include <pico/time.h>
+#include <algorithm>
+
+namespace
+{
+    constexpr uint8_t CommandExitQuad = 0xf5;
+    constexpr uint8_t CommandReadId = 0x9f;
+    constexpr uint8_t CommandEnterQuad = 0x35;
+    constexpr uint8_t CommandQuadRead = 0xeb;
+    constexpr uint8_t CommandQuadWrite = 0x38;
+    constexpr uint8_t KnownGoodDie = 0x5d;
+
+    constexpr uint32_t MaxSelectTime = 8000;   // ns, the chip refreshes while deselected
+    constexpr uint32_t MinDeselectTime = 18;   // ns
+
+    // inlined, so it runs from RAM like its callers
+    __force_inline void waitWhileBusy()
+    {
+        while ((qmi_hw->direct_csr & QMI_DIRECT_CSR_BUSY_BITS)!=0) {}
+    }
+}
+
+bool Psram::init(uint csPin)
+{
+    size=detect(csPin);
+    if (size==0) return false;
+    writeBandwidth=measureWriteBandwidth();
+    return true;
+}
+
+uint32_t Psram::getMaxSampleRate(uint channelCount) const
+{
+    uint64_t rate=uint64_t(getSustainedBandwidth())*8/std::max(channelCount, 1u);
+    return uint32_t(std::min<uint64_t>(rate, clock_get_hz(clk_sys)));
+}
+
+// runs from RAM, flash is not accessible while the QMI is in direct mode
+size_t __no_inline_not_in_flash_func(Psram::detect)(uint csPin)
+{
+    gpio_set_function(csPin, GPIO_FUNC_XIP_CS1);
+    uint32_t interrupts=save_and_disable_interrupts();
+
+    qmi_hw->direct_csr=30<<QMI_DIRECT_CSR_CLKDIV_LSB | QMI_DIRECT_CSR_EN_BITS;
+    // the cooldown of the last XIP access must expire first
+    waitWhileBusy();
+
+    // leave quad mode in case the chip was set up before, e.g. by a warm reset
+    qmi_hw->direct_csr|=QMI_DIRECT_CSR_ASSERT_CS1N_BITS;
+    qmi_hw->direct_tx=QMI_DIRECT_TX_OE_BITS | QMI_DIRECT_TX_IWIDTH_VALUE_Q<<QMI_DIRECT_TX_IWIDTH_LSB | CommandExitQuad;
+    waitWhileBusy();
+    (void)qmi_hw->direct_rx;
+    qmi_hw->direct_csr&=~QMI_DIRECT_CSR_ASSERT_CS1N_BITS;
+
+    // read id: command, 3 address bytes, manufacturer id, known good die, extended id
+    qmi_hw->direct_csr|=QMI_DIRECT_CSR_ASSERT_CS1N_BITS;
+    uint8_t kgd=0;
+    uint8_t eid=0;
+    for (int i=0; i<7; ++i)
+    {
+        qmi_hw->direct_tx=(i==0 ? CommandReadId : 0xff);
+        while ((qmi_hw->direct_csr & QMI_DIRECT_CSR_TXEMPTY_BITS)==0) {}
+        waitWhileBusy();
+        uint8_t value=uint8_t(qmi_hw->direct_rx);
+        if (i==5) kgd=value;
+        else if (i==6) eid=value;
+    }
+    qmi_hw->direct_csr&=~(QMI_DIRECT_CSR_ASSERT_CS1N_BITS | QMI_DIRECT_CSR_EN_BITS);
+
+    size_t detected=0;
+    if (kgd==KnownGoodDie)
+    {
+        // the top 3 bits of the extended id encode the density, except for
+        // the APS6404L whose id 0x26 reads like a 4MB part
+        switch (eid==0x26 ? 2 : eid>>5)
+        {
+        case 0: detected=2*1024*1024; break;
+        case 1: detected=4*1024*1024; break;
+        case 2: detected=8*1024*1024; break;
+        default: detected=1024*1024; break;
+        }
+
+        qmi_hw->direct_csr=30<<QMI_DIRECT_CSR_CLKDIV_LSB | QMI_DIRECT_CSR_EN_BITS;
+        waitWhileBusy();
+        qmi_hw->direct_csr|=QMI_DIRECT_CSR_ASSERT_CS1N_BITS;
+        qmi_hw->direct_tx=QMI_DIRECT_TX_NOPUSH_BITS | CommandEnterQuad;
+        waitWhileBusy();
+        qmi_hw->direct_csr&=~(QMI_DIRECT_CSR_ASSERT_CS1N_BITS | QMI_DIRECT_CSR_EN_BITS);
+
+        configureTiming();
+        xip_ctrl_hw->ctrl|=XIP_CTRL_WRITABLE_M1_BITS;
+    }
+
+    restore_interrupts(interrupts);
+    return detected;
+}
+
+// only called once direct mode is off again
+void __no_inline_not_in_flash_func(Psram::configureTiming)()
+{
+    uint32_t systemClock=clock_get_hz(clk_sys);
+    uint32_t divider=(systemClock+MaxClock-1)/MaxClock;
+    if (divider==1 && systemClock>100000000) divider=2;
+    uint32_t rxDelay=divider;
+    if (systemClock/divider>100000000) ++rxDelay;
+
+    // max select is counted in 64 clk_sys cycles, min deselect in clk_sys cycles
+    uint64_t periodFs=1000000000000000ull/systemClock;
+    uint32_t maxSelect=uint32_t(uint64_t(MaxSelectTime/64)*1000000/periodFs);
+    uint32_t minDeselect=uint32_t((uint64_t(MinDeselectTime)*1000000+periodFs-1)/periodFs)-(divider+1)/2;
+
+    qmi_hw->m[1].timing=1<<QMI_M1_TIMING_COOLDOWN_LSB |
+        QMI_M1_TIMING_PAGEBREAK_VALUE_1024<<QMI_M1_TIMING_PAGEBREAK_LSB |
+        maxSelect<<QMI_M1_TIMING_MAX_SELECT_LSB |
+        minDeselect<<QMI_M1_TIMING_MIN_DESELECT_LSB |
+        rxDelay<<QMI_M1_TIMING_RXDELAY_LSB |
+        divider<<QMI_M1_TIMING_CLKDIV_LSB;
+
+    // quad command, address and data; reads wait 6 clocks after the address
+    qmi_hw->m[1].rfmt=QMI_M1_RFMT_PREFIX_WIDTH_VALUE_Q<<QMI_M1_RFMT_PREFIX_WIDTH_LSB |
+        QMI_M1_RFMT_ADDR_WIDTH_VALUE_Q<<QMI_M1_RFMT_ADDR_WIDTH_LSB |
+        QMI_M1_RFMT_SUFFIX_WIDTH_VALUE_Q<<QMI_M1_RFMT_SUFFIX_WIDTH_LSB |
+        QMI_M1_RFMT_DUMMY_WIDTH_VALUE_Q<<QMI_M1_RFMT_DUMMY_WIDTH_LSB |
+        QMI_M1_RFMT_DATA_WIDTH_VALUE_Q<<QMI_M1_RFMT_DATA_WIDTH_LSB |
+        QMI_M1_RFMT_DUMMY_LEN_VALUE_24<<QMI_M1_RFMT_DUMMY_LEN_LSB |
+        QMI_M1_RFMT_PREFIX_LEN_VALUE_8<<QMI_M1_RFMT_PREFIX_LEN_LSB |
+        QMI_M1_RFMT_SUFFIX_LEN_VALUE_NONE<<QMI_M1_RFMT_SUFFIX_LEN_LSB;
+    qmi_hw->m[1].rcmd=CommandQuadRead<<QMI_M1_RCMD_PREFIX_LSB;
+    qmi_hw->m[1].wfmt=QMI_M1_WFMT_PREFIX_WIDTH_VALUE_Q<<QMI_M1_WFMT_PREFIX_WIDTH_LSB |
+        QMI_M1_WFMT_ADDR_WIDTH_VALUE_Q<<QMI_M1_WFMT_ADDR_WIDTH_LSB |
+        QMI_M1_WFMT_SUFFIX_WIDTH_VALUE_Q<<QMI_M1_WFMT_SUFFIX_WIDTH_LSB |
+        QMI_M1_WFMT_DUMMY_WIDTH_VALUE_Q<<QMI_M1_WFMT_DUMMY_WIDTH_LSB |
+        QMI_M1_WFMT_DATA_WIDTH_VALUE_Q<<QMI_M1_WFMT_DATA_WIDTH_LSB |
+        QMI_M1_WFMT_PREFIX_LEN_VALUE_8<<QMI_M1_WFMT_PREFIX_LEN_LSB |
+        QMI_M1_WFMT_SUFFIX_LEN_VALUE_NONE<<QMI_M1_WFMT_SUFFIX_LEN_LSB;
+    qmi_hw->m[1].wcmd=CommandQuadWrite<<QMI_M1_WCMD_PREFIX_LSB;
+}
+
+uint32_t Psram::measureWriteBandwidth() const
+{
+    // the same way the sampler writes: unpaced 32 bit DMA writes to the uncached window
+    constexpr uint32_t Words=64*1024;
+    static const uint32_t pattern=0xa5a5a5a5;
+    int channel=dma_claim_unused_channel(false);
+    if (channel<0) return 0;
+
+    dma_channel_config config=dma_channel_get_default_config(channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, true);
+    uint64_t start=time_us_64();
+    dma_channel_configure(channel, &config, getBuffer(), &pattern, std::min<uint32_t>(Words, size/4), true);
+    dma_channel_wait_for_finish_blocking(channel);
+    uint64_t elapsed=time_us_64()-start;
+    dma_channel_unclaim(channel);
+
+    if (elapsed==0) return 0;
+    return uint32_t(uint64_t(std::min<uint32_t>(Words, size/4))*4*1000000/elapsed);
+}
@@ -0,0 +1,53 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <pico/types.h>
+#include <cstdint>
+#include <cstddef>
+
+//! QSPI PSRAM on the second XIP chip select, like the 8MB APS6404 of the
+//! Feather RP2350. init() sets up QMI window M1 for quad reads and writes and
+//! measures how fast DMA can write to it, which bounds the sample rate of a
+//! capture that goes straight into PSRAM.
+//!
+//! The memory is used through the uncached XIP alias: a capture of several
+//! megabytes would otherwise evict the flash code both cores run from the
+//! shared XIP cache.
+class Psram
+{
+public:
+    static constexpr uint DefaultCsPin = 8;                 // PSRAM chip select of the Feather RP2350
+    static constexpr uintptr_t UncachedBase = 0x15000000;   // XIP_NOCACHE_NOALLOC_BASE, window of chip select 1
+    static constexpr uint32_t MaxClock = 133000000;         // APS6404 quad mode limit
+
+    Psram() = default;
+
+    // not copyable
+    Psram(const Psram&) = delete;
+    Psram& operator=(const Psram&) = delete;
+
+    //! detects the chip on 'csPin' and configures it for the current
+    //! clk_sys. returns false if no PSRAM answers.
+    bool init(uint csPin=DefaultCsPin);
+
+    inline bool isValid() const { return size>0; }
+    inline size_t getSize() const { return size; }
+    inline uint8_t* getBuffer() const { return isValid() ? reinterpret_cast<uint8_t*>(UncachedBase) : nullptr; }
+
+    //! DMA write throughput measured by init()
+    inline uint32_t getWriteBandwidth() const { return writeBandwidth; }
+    //! bytes per second a capture can write while USB reads it back, with a margin for refresh
+    inline uint32_t getSustainedBandwidth() const { return uint32_t(uint64_t(writeBandwidth)*3/4); }
+    //! highest sample rate at which a capture of 'channelCount' channels keeps up
+    uint32_t getMaxSampleRate(uint channelCount) const;
+
+private:
+    size_t size=0;
+    uint32_t writeBandwidth=0;      // bytes per second
+
+    static size_t detect(uint csPin);
+    static void configureTiming();
+    uint32_t measureWriteBandwidth() const;
+};
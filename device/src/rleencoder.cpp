@@ -0,0 +1,55 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "rleencoder.h"
+#include "protocol.h"
+
+void RleEncoder::reset()
+{
+    staged=0;
+    sent=0;
+}
+
+size_t RleEncoder::encode(const uint32_t* input, size_t words)
+{
+    if (!isEmpty()) return 0;
+    staged=0;
+    sent=0;
+
+    size_t rawHeader=StagingWords;  // index of the open raw block header, StagingWords if none
+    size_t i=0;
+    while (i<words)
+    {
+        uint32_t value=input[i];
+        size_t end=i+1;
+        while (end<words && input[end]==value && end-i<CompressedCountMask) ++end;
+        size_t count=end-i;
+
+        if (count>=MinRunWords)
+        {
+            if (staged+2>StagingWords) break;
+            staging[staged++]=CompressedRunFlag | uint32_t(count);
+            staging[staged++]=value;
+            rawHeader=StagingWords;
+        }
+        else
+        {
+            if (rawHeader==StagingWords)
+            {
+                if (staged+2>StagingWords) break;
+                rawHeader=staged++;
+                staging[rawHeader]=0;
+            }
+            if (count>StagingWords-staged) count=StagingWords-staged;
+            if (count==0) break;
+            for (size_t j=0; j<count; ++j)
+            {
+                staging[staged++]=value;
+            }
+            staging[rawHeader]+=uint32_t(count);
+        }
+        i+=count;
+    }
+    return i;
+}
@@ -0,0 +1,42 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+//! Run-length encodes sample words into blocks as described in protocol.h.
+//! Encoded blocks are staged in an internal buffer, so the sample buffer
+//! region is released as soon as it is encoded and USB can take the encoded
+//! data at its own pace. Runs shorter than MinRunWords are kept in raw
+//! blocks, so incompressible data grows by one header word per staging
+//! buffer at most.
+class RleEncoder
+{
+public:
+    static constexpr size_t StagingWords = 256;
+    static constexpr size_t MinRunWords = 3;   // a shorter run costs no less as run block than inside a raw block
+
+    RleEncoder() = default;
+
+    // not copyable
+    RleEncoder(const RleEncoder&) = delete;
+    RleEncoder& operator=(const RleEncoder&) = delete;
+
+    void reset();
+
+    //! encodes words from 'input' until the staging buffer is full, but only
+    //! if all staged data was sent. returns the number of input words consumed.
+    size_t encode(const uint32_t* input, size_t words);
+
+    inline bool isEmpty() const { return sent==staged*4; }
+    inline const uint8_t* getPendingData() const { return reinterpret_cast<const uint8_t*>(staging)+sent; }
+    inline size_t getPendingBytes() const { return staged*4-sent; }
+    inline void consume(size_t bytes) { sent+=bytes; }
+
+private:
+    uint32_t staging[StagingWords];
+    size_t staged=0;    // words in staging
+    size_t sent=0;      // bytes of staging already handed to USB
+};
@@ -0,0 +1,57 @@
+// -------------------------------------------------- //
+// This file is autogenerated by pioasm; do not edit! //
+// -------------------------------------------------- //
+
+#pragma once
+
+#if !PICO_NO_HARDWARE
+#include "hardware/pio.h"
+#endif
+
+// ------------- //
+// sampleChanges //
+// ------------- //
+
+#define sampleChanges_wrap_target 7
+#define sampleChanges_wrap 12
+#define sampleChanges_pio_version 1
+
+static const uint16_t sampleChanges_program_instructions[] = {
+    0xa041, //  0: mov    y, x
+    0x40e0, //  1: in     osr, 32
+    0x4040, //  2: in     y, 32
+    0xa022, //  3: mov    x, y
+    0xa0cb, //  4: mov    isr, ~null
+    0x4068, //  5: in     null, 8
+    0xa0e6, //  6: mov    osr, isr
+            //     .wrap_target
+    0xa040, //  7: mov    y, pins
+    0x00a1, //  8: jmp    x != y, 1
+    0xa047, //  9: mov    y, osr
+    0x008c, // 10: jmp    y--, 12
+    0x0000, // 11: jmp    0
+    0xa0e2, // 12: mov    osr, y
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program sampleChanges_program = {
+    .instructions = sampleChanges_program_instructions,
+    .length = 13,
+    .origin = -1,
+    .pio_version = sampleChanges_pio_version,
+#if PICO_PIO_VERSION > 0
+    .used_gpio_ranges = 0x0
+#endif
+};
+
+static inline pio_sm_config sampleChanges_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + sampleChanges_wrap_target, offset + sampleChanges_wrap);
+    sm_config_set_in_pin_count(&c, 32);
+    sm_config_set_in_shift(&c, 1, 1, 32);
+    sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_RX);
+    return c;
+}
+#endif
+
@@ -4,38 +4,92 @@
 
 #include "sampler.h"
 #include "samplePin.pio.h"
+#include "sampleChanges.pio.h"
 #include <stdexcept>
 #include <hardware/gpio.h>
+#include <hardware/clocks.h>
 
-Sampler::Sampler(uint pinNumber) :
+namespace
+{
+    //! samplePin is written for a single pin. the bit count of its one 'in'
+    //! instruction is patched here, so one program covers every channel count.
+    const pio_program* getSampleProgram(uint channelCount)
+    {
+        static uint16_t instructions[6][count_of(samplePin_program_instructions)];
+        static pio_program programs[6];
+
+        uint index=0;
+        while ((1u<<index)<channelCount) ++index;
+        if (index>=6 || (1u<<index)!=channelCount) return nullptr;
+
+        if (programs[index].length==0)
+        {
+            for (uint i=0; i<count_of(samplePin_program_instructions); ++i)
+            {
+                instructions[index][i]=samplePin_program_instructions[i];
+            }
+            instructions[index][0]=pio_encode_in(pio_pins, channelCount); // 32 encodes as 0
+            programs[index]=samplePin_program;
+            programs[index].instructions=instructions[index];
+        }
+        return &programs[index];
+    }
+}
+
+Sampler::Sampler(uint basePin, uint channelCount, uint16_t divInt, uint8_t divFrac, bool continuous, bool changesOnly) :
     pio(nullptr),
     sm(0),
     offset(0),
-    pinNumber(pinNumber),
-    dma(false)
+    basePin(basePin),
+    channelCount(channelCount),
+    dma(false),
+    ring(continuous || changesOnly ? std::make_unique<DMARing>() : nullptr),
+    changesOnly(changesOnly)
 {
     if (!dma.isValid())
     {
         return;
     }
 
+    if (!isValidChannelCount(channelCount)) return;
+    program=changesOnly ? &sampleChanges_program : getSampleProgram(channelCount);
+    if (program==nullptr)
+    {
+        return;
+    }
+
     // claim PIO instance
-    if (!pio_claim_free_sm_and_add_program_for_gpio_range(&samplePin_program, &pio, &sm, &offset, pinNumber, 1, true))
+    if (!pio_claim_free_sm_and_add_program_for_gpio_range(program, &pio, &sm, &offset, basePin, channelCount, true))
     {
         pio=nullptr;
         return;
     }
 
-    pio_sm_config c = samplePin_program_get_default_config(offset);
-    sm_config_set_in_pins(&c, pinNumber); // we will set the pin later
-    sm_config_set_clkdiv_int_frac8(&c, 150*100, 0); // 10khz
-    pio_sm_init(pio, sm, offset + samplePin_wrap_target, &c);
+    pio_sm_config c = changesOnly ? sampleChanges_program_get_default_config(offset) : samplePin_program_get_default_config(offset);
+    sm_config_set_in_pins(&c, basePin);
+    sm_config_set_in_pin_count(&c, channelCount);
+    sm_config_set_clkdiv_int_frac8(&c, divInt, divFrac);
+    pio_sm_init(pio, sm, offset + (changesOnly ? sampleChanges_wrap_target : samplePin_wrap_target), &c);
+    if (changesOnly)
+    {
+        // an expired timer and no reported state make the first pass report the pins
+        pio_sm_exec(pio, sm, pio_encode_mov(pio_x, pio_null));
+        pio_sm_exec(pio, sm, pio_encode_mov(pio_osr, pio_null));
+    }
 
-    gpio_set_dir(pinNumber, GPIO_IN);
-    gpio_set_function(pinNumber, static_cast<gpio_function_t>(pio_get_funcsel(pio)));
-    gpio_set_pulls(pinNumber, false, false);
+    for (uint pin=basePin; pin<basePin+channelCount; ++pin)
+    {
+        gpio_set_dir(pin, GPIO_IN);
+        gpio_set_function(pin, static_cast<gpio_function_t>(pio_get_funcsel(pio)));
+        gpio_set_pulls(pin, false, false);
+    }
 
     // configure DMA
+    if (ring)
+    {
+        ring->configure(&pio->rxf[sm], pio_get_dreq(pio, sm, false));
+        return;
+    }
     auto config = dma.getDefaultConfig();
     channel_config_set_dreq(&config, pio_get_dreq(pio, sm, false));
     channel_config_set_read_increment(&config, false);
@@ -48,15 +102,40 @@ Sampler::~Sampler()
 {
     if (pio!=nullptr)
     {
+        if (ring) ring->stop();
         dma.stop();
         pio_sm_set_enabled(pio, sm, false);
         pio_sm_clear_fifos(pio, sm);
-        gpio_set_input_enabled(pinNumber, false);
-        pio_remove_program_and_unclaim_sm(&samplePin_program, pio, sm, offset);
+        setInputsEnabled(false);
+        pio_remove_program_and_unclaim_sm(program, pio, sm, offset);
         pio = nullptr;
     }
 }
 
+void Sampler::findClockDivider(uint32_t systemClock, uint32_t sampleRate, uint16_t& divInt, uint8_t& divFrac)
+{
+    constexpr uint64_t minDivider=1*256;
+    constexpr uint64_t maxDivider=65535*256+255;
+
+    uint64_t scaled=uint64_t(systemClock)*256;
+    uint64_t divider=sampleRate>0 ? scaled/sampleRate : maxDivider;
+    if (divider<minDivider)
+    {
+        divider=minDivider; // we cannot sample faster than clk_sys
+    }
+    else if (divider<maxDivider)
+    {
+        // d=floor(S/R) gives a rate at or above the requested one, d+1 one below it.
+        // pick the closer one by comparing S/d-R with R-S/(d+1), both multiplied by d*(d+1)
+        uint64_t product=uint64_t(sampleRate)*divider*(divider+1);
+        if (product-scaled*divider < scaled*(divider+1)-product) ++divider;
+    }
+    if (divider>maxDivider) divider=maxDivider;
+
+    divInt=static_cast<uint16_t>(divider>>8);
+    divFrac=static_cast<uint8_t>(divider&0xff);
+}
+
 size_t Sampler::prepareSampling(void* buffer, size_t bufferSizeInBytes, size_t& sampleCount)
 {
     if (bufferSizeInBytes == 0 || buffer == nullptr)
@@ -64,11 +143,12 @@ size_t Sampler::prepareSampling(void* buffer, size_t bufferSizeInBytes, size_t&
         return 0;
     }
 
-    size_t requiredWords = (sampleCount+31)/32;
+    size_t samplesPerWord = getSamplesPerWord();
+    size_t requiredWords = (sampleCount+samplesPerWord-1)/samplesPerWord;
     if (bufferSizeInBytes < requiredWords*4)
     {
         auto maxWords = bufferSizeInBytes / 4;
-        sampleCount = maxWords * 32;
+        sampleCount = maxWords * samplesPerWord;
         requiredWords = maxWords;
     }
     return requiredWords * 4;
@@ -80,23 +160,82 @@ void Sampler::startSampling(void* buffer, size_t bufferSizeInBytes, size_t& samp
 
     // start sampling
     expectedTransferCount=requiredWords;
-    gpio_set_input_enabled(pinNumber, true);
+    stopped=false;
+    setInputsEnabled(true);
+    pio->fdebug=getStallMask(); // write 1 to clear
     pio_sm_set_enabled(pio, sm, true);
     dma.transferToBufferNow(buffer, requiredWords);
 }
 
-volatile size_t Sampler::getBytesAvailable() const
+bool Sampler::startContinuous(void* buffer, size_t bufferSizeInBytes)
+{
+    if (!ring || pio==nullptr) return false;
+
+    stopped=false;
+    setInputsEnabled(true);
+    if (!ring->start(buffer, bufferSizeInBytes))
+    {
+        setInputsEnabled(false);
+        return false;
+    }
+    pio->fdebug=getStallMask();
+    pio_sm_set_enabled(pio, sm, true);
+    return true;
+}
+
+void Sampler::stop()
+{
+    if (pio==nullptr || stopped) return;
+
+    // stop producing first, so everything up to our snapshot has reached memory
+    pio_sm_set_enabled(pio, sm, false);
+    bytesAtStop=getBytesAvailable();
+    stopped=true;
+    if (ring) ring->stop();
+    else dma.stop();
+    setInputsEnabled(false);
+}
+
+uint64_t Sampler::getBytesAvailable() const
 {
     if (pio==nullptr)
     {
         return 0;
     }
 
+    if (stopped)
+    {
+        return bytesAtStop;
+    }
+
+    if (ring)
+    {
+        return ring->getBytesWritten();
+    }
+
     if (!dma.isRunning())
     {
         pio_sm_set_enabled(pio, sm, false); // stop PIO when DMA is done
-        gpio_set_input_enabled(pinNumber, false);
+        setInputsEnabled(false);
         return expectedTransferCount*4;
     }
     return (expectedTransferCount - dma.getTransferCount())*4;
+}
+
+bool Sampler::checkFifoOverflow()
+{
+    // once one-shot DMA has all its words the FIFO runs full on purpose, so
+    // only a stall seen while DMA still runs means lost samples
+    if (pio==nullptr || stopped || !isRunning()) return false;
+    if ((pio->fdebug & getStallMask())==0) return false;
+    pio->fdebug=getStallMask();
+    return true;
+}
+
+void Sampler::setInputsEnabled(bool enabled) const
+{
+    for (uint pin=basePin; pin<basePin+channelCount; ++pin)
+    {
+        gpio_set_input_enabled(pin, enabled);
+    }
 }
\ No newline at end of file
@@ -5,11 +5,20 @@
 
 #include <hardware/pio.h>
 #include "dmatransfer.h"
+#include "dmaring.h"
+#include <memory>
 
 class Sampler
 {
 public:
-    Sampler(uint pinNumber);
+    //! samples 'channelCount' contiguous pins starting at 'basePin' per clock,
+    //! channelCount must divide 32 (see isValidChannelCount()). the sample
+    //! clock is clk_sys divided by divInt+divFrac/256, see findClockDivider().
+    //! a continuous sampler fills its buffer over and over until destroyed,
+    //! otherwise sampling stops once the requested sample count is reached.
+    //! 'changesOnly' samplers write change records instead of samples (see
+    //! protocol.h), they are always continuous.
+    Sampler(uint basePin, uint channelCount, uint16_t divInt, uint8_t divFrac, bool continuous=false, bool changesOnly=false);
     ~Sampler();
 
     // not copyable
@@ -22,28 +31,76 @@ public:
         std::swap(pio, rhs.pio);
         std::swap(sm, rhs.sm);
         std::swap(offset, rhs.offset);
+        std::swap(program, rhs.program);
+        std::swap(basePin, rhs.basePin);
+        std::swap(channelCount, rhs.channelCount);
         std::swap(dma, rhs.dma);
+        std::swap(ring, rhs.ring);
+        std::swap(expectedTransferCount, rhs.expectedTransferCount);
+        std::swap(stopped, rhs.stopped);
+        std::swap(bytesAtStop, rhs.bytesAtStop);
+        std::swap(changesOnly, rhs.changesOnly);
         return *this;
     }
     Sampler(Sampler&& rhs) : pio(std::exchange(rhs.pio, nullptr)),
                              sm(std::exchange(rhs.sm, 0)),
                              offset(std::exchange(rhs.offset, 0)),
-                             dma(std::move(rhs.dma))
+                             program(rhs.program),
+                             basePin(rhs.basePin),
+                             channelCount(rhs.channelCount),
+                             dma(std::move(rhs.dma)),
+                             ring(std::move(rhs.ring)),
+                             expectedTransferCount(rhs.expectedTransferCount),
+                             stopped(rhs.stopped),
+                             bytesAtStop(rhs.bytesAtStop),
+                             changesOnly(rhs.changesOnly)
     {
     }
 
-    inline bool isValid() const { return dma.isValid() && pio!=nullptr; }
-    inline bool isRunning() const { return dma.isRunning(); }
+    inline bool isValid() const { return (ring ? ring->isValid() : dma.isValid()) && pio!=nullptr; }
+    inline bool isRunning() const { return ring ? ring->isRunning() : dma.isRunning(); }
+    inline bool isContinuous() const { return ring!=nullptr; }
+    inline bool isChangesOnly() const { return changesOnly; }
+    inline uint getSamplesPerWord() const { return 32/channelCount; }
+
+    static constexpr bool isValidChannelCount(uint channels) { return channels>0 && channels<=32 && (32%channels)==0; }
+
+    //! pick the 16.8 fixed point divider whose resulting rate is closest to 'sampleRate'
+    //! for a given 'systemClock'. rates above systemClock are clamped to it.
+    static void findClockDivider(uint32_t systemClock, uint32_t sampleRate, uint16_t& divInt, uint8_t& divFrac);
 
     size_t prepareSampling(void* buffer, size_t bufferSizeInBytes, size_t& sampleCount);
     void startSampling(void* buffer, size_t bufferSizeInBytes, size_t& sampleCount);
-    volatile size_t getBytesAvailable() const;
+    //! continuous mode only: sample into 'buffer' as a ring until the sampler is stopped or destroyed
+    bool startContinuous(void* buffer, size_t bufferSizeInBytes);
+    //! stop sampling, data sampled so far stays available
+    void stop();
+
+    //! total number of bytes sampled since start. in continuous mode this keeps
+    //! growing past the buffer size, data lives at (bytes % bufferSizeInBytes).
+    uint64_t getBytesAvailable() const;
+
+    //! true if the PIO stalled on a full RX FIFO since the last call, i.e.
+    //! DMA fell behind and samples were lost. the stall flag is sticky, so
+    //! several stalls between two calls are reported once.
+    bool checkFifoOverflow();
+    //! continuous mode only: number of times the DMA ring rewound a channel
+    inline uint32_t getDmaRestarts() const { return ring ? ring->getRestartCount() : 0; }
 
 private:
+    void setInputsEnabled(bool enabled) const;
+    inline uint32_t getStallMask() const { return 1u<<(PIO_FDEBUG_RXSTALL_LSB+sm); }
+
     PIO pio;
     uint sm;
     uint offset;
-    uint pinNumber;
+    const pio_program* program=nullptr;
+    uint basePin;
+    uint channelCount;
     DMATransfer dma;
+    std::unique_ptr<DMARing> ring;
     uint32_t expectedTransferCount=0;
+    bool stopped=false;
+    uint64_t bytesAtStop=0;
+    bool changesOnly=false;
 };
\ No newline at end of file
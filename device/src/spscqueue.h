@@ -0,0 +1,52 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//! Fixed size queue between exactly one producer and one consumer, e.g. the
+//! two cores. Neither side ever blocks or takes a lock: the producer only
+//! writes 'head', the consumer only writes 'tail', and the release/acquire
+//! pairs order the item copies against them.
+template<typename T, size_t Capacity>
+class SpscQueue
+{
+public:
+    static_assert(Capacity>0 && (Capacity & (Capacity-1))==0, "capacity must be a power of two");
+
+    SpscQueue() = default;
+
+    // not copyable
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    //! producer side, returns false if the queue is full
+    bool push(const T& item)
+    {
+        uint32_t h=head.load(std::memory_order_relaxed);
+        if (h-tail.load(std::memory_order_acquire)>=Capacity) return false;
+        items[h & (Capacity-1)]=item;
+        head.store(h+1, std::memory_order_release);
+        return true;
+    }
+
+    //! consumer side, returns false if the queue is empty
+    bool pop(T& item)
+    {
+        uint32_t t=tail.load(std::memory_order_relaxed);
+        if (t==head.load(std::memory_order_acquire)) return false;
+        item=items[t & (Capacity-1)];
+        tail.store(t+1, std::memory_order_release);
+        return true;
+    }
+
+    inline bool isEmpty() const { return head.load(std::memory_order_acquire)==tail.load(std::memory_order_acquire); }
+
+private:
+    T items[Capacity];
+    std::atomic<uint32_t> head{0};      // free running, only written by the producer
+    std::atomic<uint32_t> tail{0};      // free running, only written by the consumer
+};
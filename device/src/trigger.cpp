@@ -0,0 +1,141 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "trigger.h"
+#include "trigger.pio.h"
+#include <hardware/gpio.h>
+#include <hardware/irq.h>
+
+namespace
+{
+    Trigger* activeTrigger = nullptr;
+
+    const pio_program* getTriggerProgram(TriggerType type)
+    {
+        switch (type)
+        {
+        case TriggerType::RisingEdge: return &triggerRising_program;
+        case TriggerType::FallingEdge: return &triggerFalling_program;
+        case TriggerType::High: return &triggerHigh_program;
+        case TriggerType::Low: return &triggerLow_program;
+        case TriggerType::Pattern: return &triggerPattern_program;
+        case TriggerType::None:
+        default:
+            return nullptr;
+        }
+    }
+}
+
+Trigger::Trigger(TriggerType type, uint pin, uint width, uint32_t pattern, uint16_t divInt, uint8_t divFrac) :
+    program(getTriggerProgram(type)),
+    pin(pin),
+    width(type==TriggerType::Pattern ? width : 1),
+    pattern(pattern)
+{
+    if (program==nullptr || this->width==0 || this->width>32)
+    {
+        return;
+    }
+
+    if (!pio_claim_free_sm_and_add_program_for_gpio_range(program, &pio, &sm, &offset, pin, this->width, true))
+    {
+        pio=nullptr;
+        return;
+    }
+
+    // all programs start at 0 and do not wrap, so any default config will do
+    pio_sm_config c = triggerRising_program_get_default_config(offset);
+    sm_config_set_wrap(&c, offset, offset + program->length - 1);
+    sm_config_set_in_pins(&c, pin);
+    sm_config_set_in_pin_count(&c, this->width);
+    if (program==&triggerPattern_program)
+    {
+        // compare at least once per sample: two cycles of a whole divider of at most
+        // half the sampler's never take longer than its shortest sample period
+        if (uint32_t(divInt)*256+divFrac<MinPatternDivider)
+        {
+            pio_remove_program_and_unclaim_sm(program, pio, sm, offset);
+            pio=nullptr;
+            return;
+        }
+        divInt=divInt/2;
+        divFrac=0;
+    }
+    sm_config_set_clkdiv_int_frac8(&c, divInt, divFrac);
+    pio_sm_init(pio, sm, offset, &c);
+
+    // the sampler may own the pins, but every PIO can read any input
+    for (uint i=pin; i<pin+this->width; ++i)
+    {
+        gpio_set_input_enabled(i, true);
+    }
+}
+
+Trigger::~Trigger()
+{
+    if (pio!=nullptr)
+    {
+        disarm();
+        pio_remove_program_and_unclaim_sm(program, pio, sm, offset);
+        pio = nullptr;
+    }
+}
+
+bool Trigger::arm(const Sampler& sampler)
+{
+    if (pio==nullptr || armed || activeTrigger!=nullptr) return false;
+    if (!sampler.isContinuous() || !sampler.isRunning()) return false;
+
+    this->sampler=&sampler;
+    triggered=false;
+    position=0;
+
+    pio_interrupt_clear(pio, sm);
+    pio_set_irqn_source_enabled(pio, 0, static_cast<pio_interrupt_source>(pis_interrupt0 + sm), true);
+    activeTrigger=this;
+    irq_add_shared_handler(pio_get_irq_num(pio, 0), &Trigger::irqHandler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(pio_get_irq_num(pio, 0), true);
+
+    armed=true;
+    pio_sm_clear_fifos(pio, sm);
+    pio_sm_restart(pio, sm);
+    pio_sm_exec(pio, sm, pio_encode_jmp(offset));
+    if (program==&triggerPattern_program)
+    {
+        pio_sm_put(pio, sm, pattern & (width<32 ? (1u<<width)-1 : 0xffffffffu));
+    }
+    pio_sm_set_enabled(pio, sm, true);
+    return true;
+}
+
+void Trigger::disarm()
+{
+    if (!armed) return;
+
+    pio_sm_set_enabled(pio, sm, false);
+    pio_set_irqn_source_enabled(pio, 0, static_cast<pio_interrupt_source>(pis_interrupt0 + sm), false);
+    irq_remove_handler(pio_get_irq_num(pio, 0), &Trigger::irqHandler);
+    pio_interrupt_clear(pio, sm);
+    activeTrigger=nullptr;
+    armed=false;
+}
+
+void Trigger::handleInterrupt()
+{
+    if (!pio_interrupt_get(pio, sm)) return;
+
+    // take the timestamp first, everything else can wait
+    if (!triggered)
+    {
+        position=sampler->getBytesAvailable();
+        triggered=true;
+    }
+    pio_interrupt_clear(pio, sm);
+    pio_sm_set_enabled(pio, sm, false);
+}
+
+void Trigger::irqHandler()
+{
+    if (activeTrigger) activeTrigger->handleInterrupt();
+}
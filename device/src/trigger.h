@@ -0,0 +1,58 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <hardware/pio.h>
+#include "protocol.h"
+#include "sampler.h"
+
+//! Watches for a trigger condition in its own PIO state machine, running on
+//! the same clock divider as the Sampler. When the condition is met, the
+//! state machine raises an interrupt and the handler records how far the
+//! sampler had written at that moment. The position is accurate to the
+//! sample word being written when the interrupt is served.
+//!
+//! The pattern compare loop takes two cycles, so a pattern trigger runs at
+//! least twice as fast as the sampler and sees a pattern that lasts a single
+//! sample. This needs a sample clock divider of at least MinPatternDivider.
+class Trigger
+{
+public:
+    static constexpr uint32_t MinPatternDivider = 2*256;    // 16.8 fixed point, like the sampler's divider
+
+    Trigger(TriggerType type, uint pin, uint width, uint32_t pattern, uint16_t divInt, uint8_t divFrac);
+    ~Trigger();
+
+    // not copyable or movable, the interrupt handler keeps a pointer to us
+    Trigger(const Trigger&) = delete;
+    Trigger& operator=(const Trigger&) = delete;
+
+    inline bool isValid() const { return pio!=nullptr; }
+
+    //! start watching. 'sampler' must be running in continuous mode
+    bool arm(const Sampler& sampler);
+    void disarm();
+
+    inline bool isArmed() const { return armed; }
+    inline bool isTriggered() const { return triggered; }
+    //! sampler byte count (see Sampler::getBytesAvailable()) when the trigger fired
+    inline uint64_t getPosition() const { return position; }
+
+private:
+    PIO pio=nullptr;
+    uint sm=0;
+    uint offset=0;
+    const pio_program* program=nullptr;
+    uint pin=0;
+    uint width=1;
+    uint32_t pattern=0;
+
+    const Sampler* sampler=nullptr;
+    volatile bool armed=false;
+    volatile bool triggered=false;
+    volatile uint64_t position=0;
+
+    void handleInterrupt();
+    static void irqHandler();
+};
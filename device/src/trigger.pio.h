@@ -0,0 +1,185 @@
+// -------------------------------------------------- //
+// This file is autogenerated by pioasm; do not edit! //
+// -------------------------------------------------- //
+
+#pragma once
+
+#if !PICO_NO_HARDWARE
+#include "hardware/pio.h"
+#endif
+
+// ------------- //
+// triggerRising //
+// ------------- //
+
+#define triggerRising_wrap_target 0
+#define triggerRising_wrap 3
+#define triggerRising_pio_version 1
+
+static const uint16_t triggerRising_program_instructions[] = {
+            //     .wrap_target
+    0x2020, //  0: wait   0 pin, 0
+    0x20a0, //  1: wait   1 pin, 0
+    0xc010, //  2: irq    nowait 0 rel
+    0x0003, //  3: jmp    3
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program triggerRising_program = {
+    .instructions = triggerRising_program_instructions,
+    .length = 4,
+    .origin = -1,
+    .pio_version = triggerRising_pio_version,
+#if PICO_PIO_VERSION > 0
+    .used_gpio_ranges = 0x0
+#endif
+};
+
+static inline pio_sm_config triggerRising_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + triggerRising_wrap_target, offset + triggerRising_wrap);
+    return c;
+}
+#endif
+
+// -------------- //
+// triggerFalling //
+// -------------- //
+
+#define triggerFalling_wrap_target 0
+#define triggerFalling_wrap 3
+#define triggerFalling_pio_version 1
+
+static const uint16_t triggerFalling_program_instructions[] = {
+            //     .wrap_target
+    0x20a0, //  0: wait   1 pin, 0
+    0x2020, //  1: wait   0 pin, 0
+    0xc010, //  2: irq    nowait 0 rel
+    0x0003, //  3: jmp    3
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program triggerFalling_program = {
+    .instructions = triggerFalling_program_instructions,
+    .length = 4,
+    .origin = -1,
+    .pio_version = triggerFalling_pio_version,
+#if PICO_PIO_VERSION > 0
+    .used_gpio_ranges = 0x0
+#endif
+};
+
+static inline pio_sm_config triggerFalling_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + triggerFalling_wrap_target, offset + triggerFalling_wrap);
+    return c;
+}
+#endif
+
+// ----------- //
+// triggerHigh //
+// ----------- //
+
+#define triggerHigh_wrap_target 0
+#define triggerHigh_wrap 2
+#define triggerHigh_pio_version 1
+
+static const uint16_t triggerHigh_program_instructions[] = {
+            //     .wrap_target
+    0x20a0, //  0: wait   1 pin, 0
+    0xc010, //  1: irq    nowait 0 rel
+    0x0002, //  2: jmp    2
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program triggerHigh_program = {
+    .instructions = triggerHigh_program_instructions,
+    .length = 3,
+    .origin = -1,
+    .pio_version = triggerHigh_pio_version,
+#if PICO_PIO_VERSION > 0
+    .used_gpio_ranges = 0x0
+#endif
+};
+
+static inline pio_sm_config triggerHigh_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + triggerHigh_wrap_target, offset + triggerHigh_wrap);
+    return c;
+}
+#endif
+
+// ---------- //
+// triggerLow //
+// ---------- //
+
+#define triggerLow_wrap_target 0
+#define triggerLow_wrap 2
+#define triggerLow_pio_version 1
+
+static const uint16_t triggerLow_program_instructions[] = {
+            //     .wrap_target
+    0x2020, //  0: wait   0 pin, 0
+    0xc010, //  1: irq    nowait 0 rel
+    0x0002, //  2: jmp    2
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program triggerLow_program = {
+    .instructions = triggerLow_program_instructions,
+    .length = 3,
+    .origin = -1,
+    .pio_version = triggerLow_pio_version,
+#if PICO_PIO_VERSION > 0
+    .used_gpio_ranges = 0x0
+#endif
+};
+
+static inline pio_sm_config triggerLow_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + triggerLow_wrap_target, offset + triggerLow_wrap);
+    return c;
+}
+#endif
+
+// -------------- //
+// triggerPattern //
+// -------------- //
+
+#define triggerPattern_wrap_target 0
+#define triggerPattern_wrap 5
+#define triggerPattern_pio_version 1
+
+static const uint16_t triggerPattern_program_instructions[] = {
+            //     .wrap_target
+    0x80a0, //  0: pull   block
+    0xa047, //  1: mov    y, osr
+    0xa020, //  2: mov    x, pins
+    0x00a2, //  3: jmp    x != y, 2
+    0xc010, //  4: irq    nowait 0 rel
+    0x0005, //  5: jmp    5
+            //     .wrap
+};
+
+#if !PICO_NO_HARDWARE
+static const struct pio_program triggerPattern_program = {
+    .instructions = triggerPattern_program_instructions,
+    .length = 6,
+    .origin = -1,
+    .pio_version = triggerPattern_pio_version,
+#if PICO_PIO_VERSION > 0
+    .used_gpio_ranges = 0x0
+#endif
+};
+
+static inline pio_sm_config triggerPattern_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + triggerPattern_wrap_target, offset + triggerPattern_wrap);
+    return c;
+}
+#endif
+
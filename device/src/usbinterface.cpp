@@ -3,7 +3,9 @@
 //! please see LICENSE file in root folder for licensing terms.
 
 #include <tusb.h>
+#include <device/usbd_pvt.h>
 #include <pico/unique_id.h>
+#include <algorithm>
 #include "usbinterface.h"
 #include "logging.h"
 #include "usbstrings.h"
@@ -16,8 +18,9 @@
 
 USBInterface* USBInterface::instance = nullptr;
 
-USBInterface::USBInterface(IProtocolHandler& handler) :
-    handler(handler)
+USBInterface::USBInterface(IProtocolHandler& handler, ITransmitHandler& transmitHandler) :
+    handler(handler),
+    transmitHandler(transmitHandler)
 {
     instance = this;
 }
@@ -28,6 +31,12 @@ bool USBInterface::reportStatus(uint8_t rhport, tusb_control_request_t const* re
     return tud_control_xfer(rhport, request, &response, sizeof(response));
 }
 
+template<typename T>
+bool USBInterface::sendVersioned(uint8_t rhport, tusb_control_request_t const* request, T& data)
+{
+    // a host that knows fewer fields asks for fewer bytes
+    return tud_control_xfer(rhport, request, &data, std::min<uint16_t>(request->wLength, sizeof(data)));
+}
 
 bool USBInterface::handleControlTransfer(uint8_t rhport, uint8_t stage, tusb_control_request_t const* request)
 {
@@ -49,13 +58,29 @@ bool USBInterface::handleControlTransfer(uint8_t rhport, uint8_t stage, tusb_con
         case Command::Stop:     return reportStatus(rhport, request, handler.stop());
         case Command::GetStatus: return reportStatus(rhport, request, handler.getStatus());
 
+        case Command::Rearm:
+            handler.rearm();
+            return tud_control_status(rhport, request);
+
         case Command::ConfigureSession:
-            return tud_control_xfer(rhport, request, dataBuffer, sizeof(SessionConfiguration));
+        case Command::ConfigureAndStart:
+            // hosts may send an older or newer configuration, see readVersioned()
+            return tud_control_xfer(rhport, request, dataBuffer, std::min<uint16_t>(request->wLength, sizeof(dataBuffer)));
 
         case Command::GetSessionConfiguration:
             {
                 SessionConfiguration config=handler.getSessionConfiguration();
-                return tud_control_xfer(rhport, request, reinterpret_cast<uint8_t*>(&config), sizeof(config));
+                return sendVersioned(rhport, request, config);
+            }
+        case Command::GetCapabilities:
+            {
+                Capabilities capabilities=handler.getCapabilities();
+                return sendVersioned(rhport, request, capabilities);
+            }
+        case Command::GetStatistics:
+            {
+                Statistics statistics=handler.getStatistics();
+                return sendVersioned(rhport, request, statistics);
             }
         default:
             return false;
@@ -67,8 +92,19 @@ bool USBInterface::handleControlTransfer(uint8_t rhport, uint8_t stage, tusb_con
         switch ( cmd )
         {
         case Command::ConfigureSession:
-            handler.configureSession(*reinterpret_cast<SessionConfiguration*>(dataBuffer));
-            break;
+            {
+                SessionConfiguration config;
+                if (!readVersioned(config, dataBuffer, std::min<uint16_t>(request->wLength, sizeof(dataBuffer)))) return false;
+                handler.configureSession(config);
+                break;
+            }
+        case Command::ConfigureAndStart:
+            {
+                SessionConfiguration config;
+                if (!readVersioned(config, dataBuffer, std::min<uint16_t>(request->wLength, sizeof(dataBuffer)))) return false;
+                handler.configureAndStart(config);
+                break;
+            }
         default:
             break;
         }
@@ -81,11 +117,91 @@ bool USBInterface::handleControlTransfer(uint8_t rhport, uint8_t stage, tusb_con
     }
 }
 
+bool USBInterface::transmit(const uint8_t* data, uint32_t bytes)
+{
+    if (!endpointOpen || transmitting || bytes==0) return false;
+    if (bytes>MaxTransferBytes) bytes=MaxTransferBytes;
+
+    uint8_t endpoint=TUSB_DIR_IN_MASK | EndpointAddress;
+    if (!usbd_edpt_claim(rhport, endpoint)) return false;
+    // the controller driver reads the data straight from 'data' packet by packet
+    transmitting=usbd_edpt_xfer(rhport, endpoint, const_cast<uint8_t*>(data), uint16_t(bytes));
+    if (!transmitting) usbd_edpt_release(rhport, endpoint);
+    return transmitting;
+}
+
 bool USBInterface::transferComplete(uint8_t rhport, xfer_result_t result, uint32_t xferred_bytes)
 {
+#if LOG_USB_TRANSFERS
+    Info("transferComplete(rhport=%u, result=%u, bytes=%u)", rhport, result, xferred_bytes);
+#endif
+    transmitting=false;
+    transmitHandler.transmitComplete(result==XFER_RESULT_SUCCESS, xferred_bytes);
     return true;
 }
 
+//--------------------------------------------------------------------+
+// TinyUSB application class driver
+//--------------------------------------------------------------------+
+
+// The data interface is served by our own class driver instead of the vendor
+// class, so bulk data is sent from the sample buffer without passing through
+// the vendor TX FIFO. Requests to the interface reach handleControlTransfer().
+struct DriverCallbacks
+{
+    static void init()
+    {
+    }
+
+    static bool deinit()
+    {
+        return true;
+    }
+
+    static void reset(uint8_t rhport)
+    {
+        USBInterface::instance->endpointOpen=false;
+        USBInterface::instance->transmitting=false;
+    }
+
+    static uint16_t open(uint8_t rhport, tusb_desc_interface_t const* interface, uint16_t maxLength)
+    {
+        if (interface->bInterfaceClass!=TUSB_CLASS_VENDOR_SPECIFIC || interface->bInterfaceNumber!=USBInterface::InterfaceId)
+        {
+            return 0;
+        }
+
+        uint16_t length=sizeof(tusb_desc_interface_t);
+        uint8_t const* descriptor=tu_desc_next(interface);
+        for (uint8_t i=0; i<interface->bNumEndpoints; ++i)
+        {
+            if (length+sizeof(tusb_desc_endpoint_t)>maxLength || tu_desc_type(descriptor)!=TUSB_DESC_ENDPOINT) return 0;
+            if (!usbd_edpt_open(rhport, reinterpret_cast<tusb_desc_endpoint_t const*>(descriptor))) return 0;
+            length+=tu_desc_len(descriptor);
+            descriptor=tu_desc_next(descriptor);
+        }
+        USBInterface::instance->rhport=rhport;
+        USBInterface::instance->endpointOpen=true;
+        USBInterface::instance->transmitting=false;
+        return length;
+    }
+
+    static bool control(uint8_t rhport, uint8_t stage, tusb_control_request_t const* request)
+    {
+#if LOG_USB_TRANSFERS
+        Info("control(rhport=%u, stage=%u, request=%u bytes", rhport, stage, sizeof(tusb_control_request_t));
+        Hexdump(request, sizeof(tusb_control_request_t));
+#endif
+        return USBInterface::instance->handleControlTransfer(rhport, stage, request);
+    }
+
+    static bool transfer(uint8_t rhport, uint8_t endpoint, xfer_result_t result, uint32_t bytes)
+    {
+        if (endpoint!=(TUSB_DIR_IN_MASK | USBInterface::EndpointAddress)) return false;
+        return USBInterface::instance->transferComplete(rhport, result, bytes);
+    }
+};
+
 //--------------------------------------------------------------------+
 // TinyUSB Descriptors
 //--------------------------------------------------------------------+
@@ -185,14 +301,22 @@ const uint8_t* tud_descriptor_configuration_cb(uint8_t index)
 }
 
 
-bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const* request)
+// Invoked by the device stack to find application class drivers
+usbd_class_driver_t const* usbd_app_driver_get_cb(uint8_t* driverCount)
 {
-#if LOG_USB_TRANSFERS
-    Info("tud_vendor_control_xfer_cb(rhport=%u, stage=%u, request=%u bytes", rhport, stage, sizeof(tusb_control_request_t));
-    Hexdump(request, sizeof(tusb_control_request_t));
-#endif
- 
-    return USBInterface::instance->handleControlTransfer(rhport, stage, request);
+    static usbd_class_driver_t const driver =
+    {
+        .name            = "SigFeather",
+        .init            = DriverCallbacks::init,
+        .deinit          = DriverCallbacks::deinit,
+        .reset           = DriverCallbacks::reset,
+        .open            = DriverCallbacks::open,
+        .control_xfer_cb = DriverCallbacks::control,
+        .xfer_cb         = DriverCallbacks::transfer,
+        .sof             = nullptr
+    };
+    *driverCount=1;
+    return &driver;
 }
 
 } // end extern "C"
@@ -5,6 +5,16 @@
 
 #include "protocol.h"
 
+//! receives the completion of transfers started with USBInterface::transmit()
+class ITransmitHandler
+{
+public:
+    virtual ~ITransmitHandler() = default;
+
+    //! 'bytes' were sent. called from tud_task(), a new transfer may be started here.
+    virtual void transmitComplete(bool success, uint32_t bytes) = 0;
+};
+
 class USBInterface
 {
 public:
@@ -14,17 +24,33 @@ public:
     static constexpr uint8_t ResetInterfaceId = 1;
     static constexpr uint8_t EndpointAddress = 1;
 
+    static constexpr uint32_t MaxTransferBytes = 32768;    // usbd_edpt_xfer() takes 16 bit lengths, keep whole packets
+
 public:
-    USBInterface(IProtocolHandler& handler);
+    USBInterface(IProtocolHandler& handler, ITransmitHandler& transmitHandler);
+
+    //! starts sending 'bytes' from 'data' on the data endpoint without copying
+    //! them. 'data' must stay untouched until the transmit handler is called.
+    //! returns false if a transfer is still running or the endpoint is not
+    //! open; at most MaxTransferBytes are sent.
+    bool transmit(const uint8_t* data, uint32_t bytes);
+    inline bool isTransmitting() const { return transmitting; }
 
 private:
     bool reportStatus(uint8_t rhport, tusb_control_request_t const* request, Status status);
+    template<typename T>
+    bool sendVersioned(uint8_t rhport, tusb_control_request_t const* request, T& data);
     bool handleControlTransfer(uint8_t rhport, uint8_t stage, tusb_control_request_t const* request);
     bool transferComplete(uint8_t rhport, xfer_result_t result, uint32_t xferred_bytes);
 
     IProtocolHandler& handler;
-    
-    friend bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_request_t const * request);
+    ITransmitHandler& transmitHandler;
+    uint8_t rhport=0;
+    bool endpointOpen=false;
+    bool transmitting=false;
+
+    // TinyUSB application class driver, see usbinterface.cpp
+    friend struct DriverCallbacks;
     static USBInterface* instance;
 };
 
@@ -0,0 +1,163 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "usbpump.h"
+#include <pico/platform.h>
+
+void UsbPump::run()
+{
+    USBInterface interface(*this, *this);
+    usb=&interface;
+
+    // the USB interrupt is enabled on the core that initializes the stack
+    tusb_rhport_init_t dev_init = {
+        .role = TUSB_ROLE_DEVICE,
+        .speed = TUSB_SPEED_AUTO
+    };
+    tusb_init(0, &dev_init); // initialize device stack on roothub port 0
+
+    while (true)
+    {
+        tud_task();
+        pump();
+    }
+}
+
+void UsbPump::connectionChanged()
+{
+    connectionEvents.fetch_add(1, std::memory_order_release);
+}
+
+void UsbPump::pump()
+{
+    while (!usb->isTransmitting() && regions.pop(current))
+    {
+        // regions of a cancelled session are dropped without a completion
+        if (current.session!=session.load(std::memory_order_acquire)) continue;
+        sendingHeader=current.header!=nullptr;
+        bool started=sendingHeader ? usb->transmit(current.header, current.headerBytes) : usb->transmit(current.data, current.bytes);
+        if (!started)
+        {
+            completions.push(Completion{0, current.session, false});
+        }
+    }
+}
+
+void UsbPump::transmitComplete(bool success, uint32_t bytes)
+{
+    if (sendingHeader)
+    {
+        // the data follows right away, the region completes with it
+        sendingHeader=false;
+        if (success && current.bytes>0)
+        {
+            if (usb->transmit(current.data, current.bytes)) return;
+            success=false;
+        }
+        bytes=0;
+    }
+    completions.push(Completion{bytes, current.session, success});
+    pump();
+}
+
+bool UsbPump::submit(const uint8_t* data, uint32_t bytes, const uint8_t* header, uint32_t headerBytes)
+{
+    if (bytes>USBInterface::MaxTransferBytes) bytes=USBInterface::MaxTransferBytes;
+    return regions.push(Region{header, headerBytes, data, bytes, session.load(std::memory_order_relaxed)});
+}
+
+bool UsbPump::takeCompleted(uint32_t& bytes, bool& success)
+{
+    Completion completion;
+    uint32_t currentSession=session.load(std::memory_order_relaxed);
+    while (completions.pop(completion))
+    {
+        if (completion.session!=currentSession) continue;
+        bytes=completion.bytes;
+        success=completion.success;
+        return true;
+    }
+    return false;
+}
+
+void UsbPump::cancel()
+{
+    session.fetch_add(1, std::memory_order_release);
+}
+
+void UsbPump::serveControl(IProtocolHandler& target)
+{
+    Request pending=request.load(std::memory_order_acquire);
+    switch (pending)
+    {
+    case Request::None:             return;
+    case Request::GetStatus:        mailboxStatus=target.getStatus(); break;
+    case Request::GetCapabilities:  mailboxCapabilities=target.getCapabilities(); break;
+    case Request::GetStatistics:    mailboxStatistics=target.getStatistics(); break;
+    case Request::Open:             mailboxStatus=target.open(); break;
+    case Request::Close:            mailboxStatus=target.close(); break;
+    case Request::Start:            mailboxStatus=target.start(); break;
+    case Request::Stop:             mailboxStatus=target.stop(); break;
+    case Request::ConfigureSession: target.configureSession(mailboxConfig); break;
+    case Request::GetSessionConfiguration: mailboxConfig=target.getSessionConfiguration(); break;
+    case Request::ConfigureAndStart: target.configureAndStart(mailboxConfig); break;
+    case Request::Rearm:            target.rearm(); break;
+    }
+    request.store(Request::None, std::memory_order_release);
+}
+
+Status UsbPump::call(Request pending)
+{
+    // control requests are rare and core0 serves them between sampler updates,
+    // so waiting here delays the data endpoint only briefly
+    request.store(pending, std::memory_order_release);
+    while (request.load(std::memory_order_acquire)!=Request::None)
+    {
+        tight_loop_contents();
+    }
+    return mailboxStatus;
+}
+
+Status UsbPump::getStatus()     { return call(Request::GetStatus); }
+Status UsbPump::open()          { return call(Request::Open); }
+Status UsbPump::close()         { return call(Request::Close); }
+Status UsbPump::start()         { return call(Request::Start); }
+Status UsbPump::stop()          { return call(Request::Stop); }
+
+Capabilities UsbPump::getCapabilities()
+{
+    call(Request::GetCapabilities);
+    return mailboxCapabilities;
+}
+
+Statistics UsbPump::getStatistics()
+{
+    call(Request::GetStatistics);
+    return mailboxStatistics;
+}
+
+void UsbPump::configureSession(SessionConfiguration& config)
+{
+    mailboxConfig=config;
+    call(Request::ConfigureSession);
+    config=mailboxConfig;
+}
+
+SessionConfiguration UsbPump::getSessionConfiguration()
+{
+    call(Request::GetSessionConfiguration);
+    return mailboxConfig;
+}
+
+void UsbPump::configureAndStart(SessionConfiguration& config)
+{
+    mailboxConfig=config;
+    call(Request::ConfigureAndStart);
+    config=mailboxConfig;
+}
+
+void UsbPump::rearm()
+{
+    call(Request::Rearm);
+}
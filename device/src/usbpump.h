@@ -0,0 +1,118 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <tusb.h>
+#include <atomic>
+#include "usbinterface.h"
+#include "spscqueue.h"
+
+//! Runs the USB device stack on core1 and moves sample data to the host,
+//! while core0 keeps session control, the sampler and the trigger.
+//!
+//! Core0 queues regions of sample memory that are ready to send with submit()
+//! and collects the finished ones in order with takeCompleted(); core1 starts
+//! the next region as soon as a transfer completes. Control requests arrive on
+//! core1 and are passed to core0 through a mailbox: core1 waits until core0
+//! picked them up in serveControl(), so the handler only ever runs on core0.
+class UsbPump : public IProtocolHandler, public ITransmitHandler
+{
+public:
+    static constexpr size_t MaxQueuedRegions = 4;   // per session, leaves room for a completion of a cancelled one
+
+    UsbPump() = default;
+
+    // not copyable, the interface keeps a reference to us
+    UsbPump(const UsbPump&) = delete;
+    UsbPump& operator=(const UsbPump&) = delete;
+
+    //! core1: initializes TinyUSB on the calling core and services it forever
+    [[noreturn]] void run();
+    //! core1: called from the TinyUSB mount and unmount callbacks
+    void connectionChanged();
+
+    //! core0: handles a pending control request with 'target'
+    void serveControl(IProtocolHandler& target);
+    //! core0: counts mounts and unmounts, even counts are disconnected
+    inline uint32_t getConnectionEvents() const { return connectionEvents.load(std::memory_order_acquire); }
+
+    //! core0: queues 'bytes' from 'data' for sending, at most
+    //! USBInterface::MaxTransferBytes, after 'headerBytes' from 'header' if
+    //! given. both must stay untouched until the region was returned by
+    //! takeCompleted(), which reports the data bytes only. 'data' may be
+    //! empty if there is a header.
+    bool submit(const uint8_t* data, uint32_t bytes, const uint8_t* header=nullptr, uint32_t headerBytes=0);
+    //! core0: returns the next finished region of the current session
+    bool takeCompleted(uint32_t& bytes, bool& success);
+    //! core0: drops all queued regions. a transfer that is already running
+    //! keeps reading its region, its completion is not reported.
+    void cancel();
+
+    // IProtocolHandler, called on core1 and forwarded to core0
+    Status getStatus() override;
+    Capabilities getCapabilities() override;
+    Statistics getStatistics() override;
+    Status open() override;
+    Status close() override;
+    Status start() override;
+    Status stop() override;
+    void configureSession(SessionConfiguration& config) override;
+    SessionConfiguration getSessionConfiguration() override;
+    void configureAndStart(SessionConfiguration& config) override;
+    void rearm() override;
+
+    // ITransmitHandler, core1
+    void transmitComplete(bool success, uint32_t bytes) override;
+
+private:
+    enum class Request : uint8_t
+    {
+        None,
+        GetStatus,
+        GetCapabilities,
+        GetStatistics,
+        Open,
+        Close,
+        Start,
+        Stop,
+        ConfigureSession,
+        GetSessionConfiguration,
+        ConfigureAndStart,
+        Rearm
+    };
+
+    struct Region
+    {
+        const uint8_t* header;
+        uint32_t headerBytes;
+        const uint8_t* data;
+        uint32_t bytes;
+        uint32_t session;
+    };
+
+    struct Completion
+    {
+        uint32_t bytes;
+        uint32_t session;
+        bool success;
+    };
+
+    USBInterface* usb=nullptr;
+    Region current{};                               // running transfer, core1 only
+    bool sendingHeader=false;                       // the header of 'current' is being sent, core1 only
+    SpscQueue<Region, 8> regions;                   // core0 to core1
+    SpscQueue<Completion, 8> completions;           // core1 to core0
+    std::atomic<uint32_t> session{0};               // only written by core0
+    std::atomic<uint32_t> connectionEvents{0};      // only written by core1
+
+    // control mailbox, 'request' is set by core1 and reset by core0 once served
+    std::atomic<Request> request{Request::None};
+    SessionConfiguration mailboxConfig{};
+    Capabilities mailboxCapabilities{};
+    Statistics mailboxStatistics{};
+    Status mailboxStatus=Status::Error;
+
+    Status call(Request pending);
+    void pump();
+};
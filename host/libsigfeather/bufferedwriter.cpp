@@ -0,0 +1,80 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "bufferedwriter.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+BufferedWriter::BufferedWriter(const std::string& path, size_t bufferSize) :
+    file(std::fopen(path.c_str(), "wb")),
+    buffer(std::max<size_t>(bufferSize, 64))
+{
+    if (file==nullptr)
+    {
+        throw std::runtime_error("cannot create "+path);
+    }
+    // we buffer ourselves
+    std::setvbuf(file, nullptr, _IONBF, 0);
+}
+
+BufferedWriter::~BufferedWriter()
+{
+    close();
+}
+
+void BufferedWriter::write(const void* data, size_t bytes)
+{
+    const char* text=static_cast<const char*>(data);
+    if (bytes>buffer.size()-used)
+    {
+        flush();
+        // large blocks go straight to the file
+        if (bytes>=buffer.size())
+        {
+            if (file!=nullptr && std::fwrite(text, 1, bytes, file)!=bytes) error=true;
+            position+=bytes;
+            return;
+        }
+    }
+    std::memcpy(buffer.data()+used, text, bytes);
+    used+=bytes;
+}
+
+void BufferedWriter::writeNumber(uint64_t value)
+{
+    char text[24];
+    auto result=std::to_chars(text, text+sizeof(text), value);
+    write(text, result.ptr-text);
+}
+
+void BufferedWriter::writeLE16(uint16_t value)
+{
+    char bytes[2]={char(value), char(value>>8)};
+    write(bytes, 2);
+}
+
+void BufferedWriter::writeLE32(uint32_t value)
+{
+    char bytes[4]={char(value), char(value>>8), char(value>>16), char(value>>24)};
+    write(bytes, 4);
+}
+
+void BufferedWriter::flush()
+{
+    if (used==0) return;
+    if (file!=nullptr && std::fwrite(buffer.data(), 1, used, file)!=used) error=true;
+    position+=used;
+    used=0;
+}
+
+bool BufferedWriter::close()
+{
+    if (file==nullptr) return !error;
+    flush();
+    if (std::fclose(file)!=0) error=true;
+    file=nullptr;
+    return !error;
+}
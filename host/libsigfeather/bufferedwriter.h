@@ -0,0 +1,53 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//! Writes a file through a large buffer with cheap inline appends, so
+//! exporters can emit text or binary records per sample or per edge without
+//! the overhead of iostream formatting.
+class BufferedWriter
+{
+public:
+    //! throws std::runtime_error if the file cannot be created
+    explicit BufferedWriter(const std::string& path, size_t bufferSize=1024*1024);
+    ~BufferedWriter();
+
+    // not copyable
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    inline void put(char c)
+    {
+        if (used==buffer.size()) flush();
+        buffer[used++]=c;
+    }
+    inline void write(std::string_view text) { write(text.data(), text.size()); }
+    void write(const void* data, size_t bytes);
+    //! decimal without leading zeros
+    void writeNumber(uint64_t value);
+    void writeLE16(uint16_t value);
+    void writeLE32(uint32_t value);
+
+    //! bytes written so far, including buffered ones
+    inline uint64_t getPosition() const { return position+used; }
+    inline bool hasError() const { return error; }
+
+    void flush();
+    //! flushes and closes the file, returns false if any write failed
+    bool close();
+
+private:
+    std::FILE* file=nullptr;
+    std::vector<char> buffer;
+    size_t used=0;
+    uint64_t position=0;        // bytes handed to the file
+    bool error=false;
+};
@@ -0,0 +1,105 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "bufferpool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+    constexpr size_t HugePageSize=2*1024*1024;
+
+    inline size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value+alignment-1)/alignment*alignment;
+    }
+}
+
+BufferPool::BufferPool(std::shared_ptr<libusb_device_handle> handle, size_t bufferSize, bool hugePages) :
+    state(std::make_shared<State>())
+{
+    state->handle=std::move(handle);
+    state->bufferSize=bufferSize;
+    state->fallback=(hugePages && bufferSize>=HugePageSize) ? Memory::HugePages : Memory::Pages;
+    state->memory=state->handle ? Memory::Device : state->fallback;
+    size_t alignment=state->fallback==Memory::HugePages ? HugePageSize : size_t(sysconf(_SC_PAGESIZE));
+    state->allocationSize=alignUp(std::max<size_t>(bufferSize, 1), alignment);
+}
+
+SigFeather::BufferView BufferPool::acquire()
+{
+    Block block;
+    {
+        std::scoped_lock lock(state->mutex);
+        if (!state->idle.empty())
+        {
+            block=state->idle.back();
+            state->idle.pop_back();
+        }
+        else
+        {
+            block=state->allocate();
+        }
+    }
+    // the deleter holds the pool state, so the buffer can always be given back
+    std::shared_ptr<uint8_t> memory(block.data, [owner=state, block](uint8_t*) { owner->release(block); });
+    return SigFeather::BufferView(std::move(memory), state->bufferSize);
+}
+
+BufferPool::Memory BufferPool::getMemory() const
+{
+    std::scoped_lock lock(state->mutex);
+    return state->memory;
+}
+
+const char* BufferPool::getMemoryName(Memory memory)
+{
+    switch (memory)
+    {
+    case Memory::Device: return "usbfs device memory";
+    case Memory::HugePages: return "huge pages";
+    case Memory::Pages: return "pages";
+    default: return "unknown";
+    }
+}
+
+BufferPool::Block BufferPool::State::allocate()
+{
+    Block block;
+    if (memory==Memory::Device)
+    {
+        block.data=libusb_dev_mem_alloc(handle.get(), bufferSize);
+        block.memory=Memory::Device;
+        if (block.data) return block;
+        // not supported by this platform or out of usbfs memory, do not try again
+        memory=fallback;
+    }
+
+    size_t alignment=memory==Memory::HugePages ? HugePageSize : size_t(sysconf(_SC_PAGESIZE));
+    block.data=static_cast<uint8_t*>(std::aligned_alloc(alignment, allocationSize));
+    block.memory=memory;
+    if (!block.data) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    if (memory==Memory::HugePages) madvise(block.data, allocationSize, MADV_HUGEPAGE);
+#endif
+    return block;
+}
+
+void BufferPool::State::release(const Block& block)
+{
+    std::scoped_lock lock(mutex);
+    idle.push_back(block);
+}
+
+BufferPool::State::~State()
+{
+    for (const auto& block : idle)
+    {
+        if (block.memory==Memory::Device) libusb_dev_mem_free(handle.get(), block.data, bufferSize);
+        else std::free(block.data);
+    }
+}
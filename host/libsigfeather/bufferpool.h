@@ -0,0 +1,71 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <libusb.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "sigfeather.h"
+
+//! Hands out fixed size buffers for USB transfers and keeps them for reuse,
+//! so a capture neither allocates nor clears memory. Buffers come from
+//! libusb_dev_mem_alloc() where the kernel supports it: usbfs then moves
+//! the data straight into them instead of copying it from a kernel buffer.
+//! Otherwise they are page aligned heap memory that is never cleared,
+//! optionally backed by transparent huge pages.
+//!
+//! Buffers are returned as BufferViews and go back to the pool when the
+//! last view of them is gone. The views keep the pool and the device
+//! handle alive, so they may outlive the pool object and the device.
+class BufferPool
+{
+public:
+    enum class Memory
+    {
+        Device,             //!< usbfs zero-copy memory
+        HugePages,          //!< heap memory advised to use huge pages
+        Pages               //!< page aligned heap memory
+    };
+
+    //! 'handle' is used for device memory, pass nullptr to use heap memory only.
+    //! huge pages are only used for buffers of at least one huge page.
+    BufferPool(std::shared_ptr<libusb_device_handle> handle, size_t bufferSize, bool hugePages=false);
+
+    // not copyable
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    //! an idle buffer or a new one, throws std::bad_alloc if none can be allocated
+    SigFeather::BufferView acquire();
+
+    inline size_t getBufferSize() const { return state->bufferSize; }
+    //! where new buffers come from, device memory falls back to heap memory once it fails
+    Memory getMemory() const;
+    static const char* getMemoryName(Memory memory);
+
+private:
+    struct Block
+    {
+        uint8_t* data=nullptr;
+        Memory memory=Memory::Pages;
+    };
+
+    struct State
+    {
+        std::shared_ptr<libusb_device_handle> handle;
+        size_t bufferSize=0;
+        size_t allocationSize=0;        // bufferSize rounded up to the alignment
+        Memory memory=Memory::Pages;
+        Memory fallback=Memory::Pages;  // used once device memory fails
+        std::mutex mutex;
+        std::vector<Block> idle;
+
+        ~State();
+        Block allocate();
+        void release(const Block& block);
+    };
+
+    std::shared_ptr<State> state;
+};
@@ -0,0 +1,348 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "capturefile.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value+alignment-1)/alignment*alignment;
+    }
+}
+
+CaptureFileWriter::CaptureFileWriter(const std::string& path, size_t chunkSize) :
+    file(path, std::ios::binary | std::ios::trunc)
+{
+    if (!file)
+    {
+        throw std::runtime_error("cannot create capture file "+path);
+    }
+    header.chunkSize=alignUp(std::max<size_t>(chunkSize, 4), 4);
+}
+
+void CaptureFileWriter::onStart(const SigFeather::CaptureInfo& info)
+{
+    std::memcpy(header.magic, CaptureFile::Magic, sizeof(header.magic));
+    header.chunkStride=alignUp(sizeof(CaptureFile::ChunkHeader)+header.chunkSize, CaptureFile::Alignment);
+    header.dataOffset=CaptureFile::Alignment;
+    header.sampleRate=info.sampleRate;
+    header.clockDivider=info.clockDivider;
+    header.jitter=info.jitter;
+    header.systemClock=info.systemClock;
+    header.channels=info.channels;
+    header.basePin=info.basePin;
+    header.flags=(info.unbounded ? CaptureFile::FlagUnbounded : 0) | (info.triggered ? CaptureFile::FlagTriggered : 0);
+    header.triggerSample=info.triggerSample;
+    header.segmentInterval=uint32_t(info.segmentInterval);
+    samplesLimit=info.unbounded ? std::numeric_limits<size_t>::max() : info.samples;
+
+    // the header is rewritten with the totals and the index position by finish()
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    chunk.clear();
+    chunk.reserve(header.chunkSize);
+    index.clear();
+    marks.clear();
+    if (!file) error=true;
+}
+
+bool CaptureFileWriter::onData(const uint8_t* data, size_t bytes)
+{
+    if (error) return false;
+    return append(data, bytes);
+}
+
+void CaptureFileWriter::onGap(size_t offset, size_t bytes)
+{
+    if (error) return;
+    marks.push_back(CaptureFile::Mark{CaptureFile::MarkType::Gap, 0, offset, bytes});
+    append(nullptr, bytes);
+}
+
+void CaptureFileWriter::onSegment(size_t index, size_t offset, uint64_t timestamp)
+{
+    marks.push_back(CaptureFile::Mark{CaptureFile::MarkType::Segment, uint32_t(index), offset, 0, timestamp});
+}
+
+void CaptureFileWriter::onEnd(size_t totalBytes)
+{
+    finish();
+}
+
+void CaptureFileWriter::onError(const std::string& message)
+{
+    finish();
+}
+
+bool CaptureFileWriter::append(const uint8_t* data, size_t bytes)
+{
+    // no data appends zeros
+    while (bytes>0)
+    {
+        size_t fill=std::min<size_t>(bytes, header.chunkSize-chunk.size());
+        if (data!=nullptr)
+        {
+            chunk.insert(chunk.end(), data, data+fill);
+            data+=fill;
+        }
+        else
+        {
+            chunk.resize(chunk.size()+fill, 0);
+        }
+        bytes-=fill;
+        if (chunk.size()==header.chunkSize && !writeChunk()) return false;
+    }
+    return true;
+}
+
+bool CaptureFileWriter::writeChunk()
+{
+    uint64_t samplesPerChunk=header.chunkSize*8/header.channels;
+    CaptureFile::ChunkHeader chunkHeader;
+    chunkHeader.bytes=static_cast<uint32_t>(chunk.size());
+    chunkHeader.index=index.size();
+    chunkHeader.firstSample=index.size()*samplesPerChunk;
+    chunkHeader.samples=std::min<uint64_t>(chunk.size()*8/header.channels, samplesLimit-std::min<uint64_t>(samplesLimit, chunkHeader.firstSample));
+
+    uint64_t offset=header.dataOffset+index.size()*header.chunkStride;
+    file.seekp(offset);
+    file.write(reinterpret_cast<const char*>(&chunkHeader), sizeof(chunkHeader));
+    file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    if (!file)
+    {
+        error=true;
+        return false;
+    }
+
+    CaptureFile::IndexEntry entry;
+    entry.firstSample=chunkHeader.firstSample;
+    entry.offset=offset+sizeof(chunkHeader);
+    entry.bytes=chunk.size();
+    index.push_back(entry);
+    header.samples=chunkHeader.firstSample+chunkHeader.samples;
+    header.bytes+=chunk.size();
+    chunk.clear();
+    return true;
+}
+
+void CaptureFileWriter::finish()
+{
+    if (!file.is_open()) return;
+    if (!chunk.empty() && !error) writeChunk();
+
+    // the index follows the payload of the last chunk, the marks follow the index
+    uint64_t offset=index.empty() ? header.dataOffset : index.back().offset+index.back().bytes;
+    file.seekp(offset);
+    file.write(reinterpret_cast<const char*>(index.data()), index.size()*sizeof(CaptureFile::IndexEntry));
+    file.write(reinterpret_cast<const char*>(marks.data()), marks.size()*sizeof(CaptureFile::Mark));
+    header.chunkCount=index.size();
+    header.indexOffset=offset;
+    header.markOffset=marks.empty() ? 0 : offset+index.size()*sizeof(CaptureFile::IndexEntry);
+    header.markCount=uint32_t(marks.size());
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+    if (!file) error=true;
+}
+
+CaptureFileReader::CaptureFileReader(const std::string& path)
+{
+    int fd=::open(path.c_str(), O_RDONLY);
+    if (fd<0) throw std::runtime_error("cannot open capture file "+path);
+    struct stat status;
+    if (::fstat(fd, &status)!=0 || size_t(status.st_size)<sizeof(CaptureFile::Header))
+    {
+        ::close(fd);
+        throw std::runtime_error(path+" is not a capture file");
+    }
+    size=size_t(status.st_size);
+    void* address=::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping keeps the file referenced
+    ::close(fd);
+    if (address==MAP_FAILED) throw std::runtime_error("cannot map capture file "+path);
+    mapping=static_cast<const uint8_t*>(address);
+
+    std::memcpy(&header, mapping, sizeof(header));
+    if (std::memcmp(header.magic, CaptureFile::Magic, sizeof(header.magic))!=0 || header.version==0 || header.version>CaptureFile::Version ||
+        header.channels==0 || header.channels>32 || (32%header.channels)!=0 ||
+        header.chunkSize==0 || (header.chunkSize%4)!=0 || header.chunkStride<header.chunkSize+sizeof(CaptureFile::ChunkHeader))
+    {
+        ::munmap(const_cast<uint8_t*>(mapping), size);
+        throw std::runtime_error(path+" is not a supported capture file");
+    }
+    samplesPerChunk=header.chunkSize*8/header.channels;
+
+    bool indexValid=header.indexOffset!=0 && header.indexOffset<=size &&
+        header.chunkCount<=(size-header.indexOffset)/sizeof(CaptureFile::IndexEntry);
+    if (indexValid)
+    {
+        index.resize(header.chunkCount);
+        std::memcpy(index.data(), mapping+header.indexOffset, index.size()*sizeof(CaptureFile::IndexEntry));
+        for (const auto& entry : index)
+        {
+            if (entry.offset>size || entry.bytes>size-entry.offset) indexValid=false;
+        }
+    }
+    if (!indexValid)
+    {
+        header.indexOffset=0;
+        rebuildIndex();
+    }
+    // version 1 files have zeros there
+    if (indexValid && header.markOffset!=0 && header.markOffset<=size &&
+        header.markCount<=(size-header.markOffset)/sizeof(CaptureFile::Mark))
+    {
+        marks.resize(header.markCount);
+        std::memcpy(marks.data(), mapping+header.markOffset, marks.size()*sizeof(CaptureFile::Mark));
+    }
+
+    info.samples=header.samples;
+    info.bytes=header.bytes;
+    info.unbounded=(header.flags & CaptureFile::FlagUnbounded)!=0;
+    info.basePin=header.basePin;
+    info.channels=header.channels;
+    info.sampleRate=header.sampleRate;
+    info.systemClock=header.systemClock;
+    info.clockDivider=header.clockDivider;
+    info.jitter=header.jitter;
+    info.triggered=(header.flags & CaptureFile::FlagTriggered)!=0;
+    info.triggerSample=header.triggerSample;
+    info.segments=size_t(std::count_if(marks.begin(), marks.end(), [](const auto& mark) { return mark.type==CaptureFile::MarkType::Segment; }));
+    info.segmentInterval=header.segmentInterval;
+}
+
+CaptureFileReader::~CaptureFileReader()
+{
+    if (mapping!=nullptr) ::munmap(const_cast<uint8_t*>(mapping), size);
+}
+
+void CaptureFileReader::rebuildIndex()
+{
+    // chunks are written in order, so the first gap ends the capture
+    index.clear();
+    header.samples=0;
+    header.bytes=0;
+    for (uint64_t offset=header.dataOffset; offset+sizeof(CaptureFile::ChunkHeader)<=size; offset+=header.chunkStride)
+    {
+        CaptureFile::ChunkHeader chunk;
+        std::memcpy(&chunk, mapping+offset, sizeof(chunk));
+        uint64_t payload=offset+sizeof(chunk);
+        if (chunk.magic!=CaptureFile::ChunkMagic || chunk.index!=index.size() || chunk.bytes>header.chunkSize ||
+            chunk.bytes>size-payload)
+        {
+            break;
+        }
+        CaptureFile::IndexEntry entry;
+        entry.firstSample=chunk.firstSample;
+        entry.offset=payload;
+        entry.bytes=chunk.bytes;
+        index.push_back(entry);
+        header.samples=chunk.firstSample+chunk.samples;
+        header.bytes+=chunk.bytes;
+        if (chunk.bytes<header.chunkSize) break;
+    }
+    header.chunkCount=index.size();
+}
+
+CaptureFileReader::ChunkView CaptureFileReader::getChunk(size_t chunk) const
+{
+    if (chunk>=index.size()) return ChunkView();
+    const auto& entry=index[chunk];
+    ChunkView view;
+    view.firstSample=entry.firstSample;
+    view.samples=std::min<uint64_t>(entry.bytes*8/header.channels, header.samples-std::min(header.samples, entry.firstSample));
+    view.data=mapping+entry.offset;
+    view.bytes=entry.bytes;
+    return view;
+}
+
+size_t CaptureFileReader::findChunk(uint64_t sample) const
+{
+    if (sample>=header.samples || index.empty()) return index.size();
+    auto holds=[this, sample](size_t chunk)
+    {
+        ChunkView view=getChunk(chunk);
+        return view.firstSample<=sample && sample-view.firstSample<view.samples;
+    };
+    // all chunks but the last are full, so the division finds the chunk in a well formed file
+    size_t chunk=std::min<size_t>(sample/samplesPerChunk, index.size()-1);
+    if (holds(chunk)) return chunk;
+    // otherwise search the index, it is in stream order
+    auto next=std::upper_bound(index.begin(), index.end(), sample,
+        [](uint64_t value, const CaptureFile::IndexEntry& entry) { return value<entry.firstSample; });
+    if (next==index.begin()) return index.size();
+    chunk=size_t(next-index.begin())-1;
+    return holds(chunk) ? chunk : index.size();
+}
+
+CaptureFileReader::ChunkView CaptureFileReader::view(uint64_t sample) const
+{
+    ChunkView view=getChunk(findChunk(sample));
+    if (view.data==nullptr) return view;
+
+    uint64_t samplesPerWord=32/header.channels;
+    uint64_t words=(sample-view.firstSample)/samplesPerWord;
+    view.firstSample+=words*samplesPerWord;
+    view.samples-=words*samplesPerWord;
+    view.data+=words*4;
+    view.bytes-=words*4;
+    return view;
+}
+
+size_t CaptureFileReader::replay(SigFeather::ISampleSink& sink) const
+{
+    sink.onStart(info);
+    size_t total=0;
+    uint64_t offset=0;              // stream offset, counting the stored gaps
+    uint64_t gapEnd=0;
+    size_t next=0;
+    auto passMarks=[&]()
+    {
+        for (; next<marks.size() && marks[next].offset<=offset; ++next)
+        {
+            const auto& mark=marks[next];
+            if (mark.type==CaptureFile::MarkType::Gap)
+            {
+                sink.onGap(size_t(mark.offset), size_t(mark.bytes));
+                gapEnd=std::max(gapEnd, mark.offset+mark.bytes);
+            }
+            else if (mark.type==CaptureFile::MarkType::Segment)
+            {
+                sink.onSegment(mark.segment, size_t(mark.offset), mark.timestamp);
+            }
+        }
+    };
+
+    bool more=true;
+    for (size_t chunk=0; chunk<index.size() && more; ++chunk)
+    {
+        ChunkView view=getChunk(chunk);
+        for (size_t done=0; done<view.bytes && more;)
+        {
+            // pass data up to the next mark, skip the zeros of a gap
+            passMarks();
+            uint64_t piece=view.bytes-done;
+            if (next<marks.size()) piece=std::min(piece, marks[next].offset-offset);
+            if (offset<gapEnd) piece=std::min(piece, gapEnd-offset);
+            else
+            {
+                total+=piece;
+                more=sink.onData(view.data+done, size_t(piece));
+            }
+            done+=piece;
+            offset+=piece;
+        }
+    }
+    if (more) passMarks();
+    sink.onEnd(total);
+    return total;
+}
@@ -0,0 +1,193 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "capturewriter.h"
+#include "sigfeather.h"
+
+// Capture file (.sfcap) layout, all values little-endian:
+//  - CaptureFileHeader at offset 0, the first chunk starts at dataOffset
+//  - data chunks every chunkStride bytes: a CaptureChunkHeader followed by up
+//    to chunkSize bytes of packed sample words as received from the device.
+//    every chunk but the last is full, so chunk n holds the samples from
+//    n*chunkSize*8/channels on and any sample is found without searching.
+//  - the index, one CaptureIndexEntry per chunk, at indexOffset
+//  - since version 2, one CaptureMark per gap and segment at markOffset.
+//    the bytes a framed capture lost are stored as zeros and marked as a
+//    gap, so samples keep their positions.
+// indexOffset is written last. A file with indexOffset 0 was not closed
+// properly; its chunks are still found by their headers, its marks are lost.
+namespace CaptureFile
+{
+    static constexpr char Magic[8]={'S','F','C','A','P','\r','\n','\x1a'};
+    static constexpr uint32_t Version=2;
+    static constexpr uint32_t ChunkMagic=0x4b434653;       // "SFCK"
+    static constexpr size_t DefaultChunkSize=1024*1024;
+    static constexpr size_t Alignment=4096;                // chunks start on pages
+
+    enum Flags : uint8_t
+    {
+        FlagUnbounded = 0x01,
+        FlagTriggered = 0x02
+    };
+
+    enum class MarkType : uint32_t
+    {
+        Gap = 1,                        //!< 'bytes' bytes at 'offset' were lost
+        Segment = 2                     //!< segment 'segment' starts at 'offset', taken at 'timestamp'
+    };
+
+    struct [[gnu::packed]] Header
+    {
+        char magic[8]={};
+        uint32_t version=Version;
+        uint32_t headerSize=sizeof(Header);
+        uint64_t chunkSize=0;           //!< payload bytes per chunk, a multiple of 4
+        uint64_t chunkStride=0;         //!< bytes from one chunk header to the next
+        uint64_t dataOffset=0;
+        uint64_t indexOffset=0;         //!< 0 while the capture is being written
+        uint64_t chunkCount=0;
+        uint64_t samples=0;
+        uint64_t bytes=0;               //!< payload bytes in all chunks
+        double sampleRate=0;
+        double clockDivider=0;
+        double jitter=0;
+        uint32_t systemClock=0;
+        uint8_t channels=1;
+        uint8_t basePin=0;
+        uint8_t flags=0;
+        uint8_t reserved=0;
+        uint64_t triggerSample=0;
+        uint64_t markOffset=0;          //!< 0 without marks
+        uint32_t markCount=0;
+        uint32_t segmentInterval=0;     //!< CaptureInfo::segmentInterval
+    };
+    static_assert(sizeof(Header)==128, "capture file header size mismatch");
+
+    struct [[gnu::packed]] ChunkHeader
+    {
+        uint32_t magic=ChunkMagic;
+        uint32_t bytes=0;               //!< payload bytes in this chunk
+        uint64_t index=0;
+        uint64_t firstSample=0;
+        uint64_t samples=0;
+    };
+    static_assert(sizeof(ChunkHeader)==32, "capture chunk header size mismatch");
+
+    struct [[gnu::packed]] IndexEntry
+    {
+        uint64_t firstSample=0;
+        uint64_t offset=0;              //!< file offset of the payload
+        uint64_t bytes=0;
+    };
+    static_assert(sizeof(IndexEntry)==24, "capture index entry size mismatch");
+
+    struct [[gnu::packed]] Mark
+    {
+        MarkType type=MarkType::Gap;
+        uint32_t segment=0;
+        uint64_t offset=0;              //!< payload byte, counting the bytes of earlier gaps
+        uint64_t bytes=0;
+        uint64_t timestamp=0;           //!< sample clocks since sampling started
+    };
+    static_assert(sizeof(Mark)==32, "capture mark size mismatch");
+}
+
+//! Writes a capture to a .sfcap file while it is streamed. The file is
+//! opened by the constructor, so a bad path fails before sampling starts.
+class CaptureFileWriter : public ICaptureWriter
+{
+public:
+    //! 'chunkSize' is rounded up to whole sample words
+    explicit CaptureFileWriter(const std::string& path, size_t chunkSize=CaptureFile::DefaultChunkSize);
+
+    // not copyable
+    CaptureFileWriter(const CaptureFileWriter&) = delete;
+    CaptureFileWriter& operator=(const CaptureFileWriter&) = delete;
+
+    bool hasError() const override { return error; }
+
+    // ISampleSink
+    void onStart(const SigFeather::CaptureInfo& info) override;
+    bool onData(const uint8_t* data, size_t bytes) override;
+    //! stores the lost bytes as zeros and marks them
+    void onGap(size_t offset, size_t bytes) override;
+    void onSegment(size_t index, size_t offset, uint64_t timestamp) override;
+    //! writes the last chunk and the index. a capture that ended with an
+    //! error is closed the same way, holding the data received until then.
+    void onEnd(size_t totalBytes) override;
+    void onError(const std::string& message) override;
+
+private:
+    std::ofstream file;
+    CaptureFile::Header header;
+    std::vector<uint8_t> chunk;
+    std::vector<CaptureFile::IndexEntry> index;
+    std::vector<CaptureFile::Mark> marks;
+    size_t samplesLimit=0;          // bounded captures end on a partial word
+    bool error=false;
+
+    bool append(const uint8_t* data, size_t bytes);
+    bool writeChunk();
+    void finish();
+};
+
+//! Opens a .sfcap file by mapping it into memory. Chunks are returned as
+//! views into the mapping, so reading is zero-copy and any sample position
+//! is reached without touching the rest of the file.
+class CaptureFileReader
+{
+public:
+    //! a contiguous piece of packed sample data, valid while the reader lives
+    struct ChunkView
+    {
+        uint64_t firstSample=0;
+        uint64_t samples=0;
+        const uint8_t* data=nullptr;    //!< starts on a sample word
+        size_t bytes=0;
+    };
+
+    //! throws std::runtime_error if the file cannot be mapped or is not a capture
+    explicit CaptureFileReader(const std::string& path);
+    ~CaptureFileReader();
+
+    // not copyable
+    CaptureFileReader(const CaptureFileReader&) = delete;
+    CaptureFileReader& operator=(const CaptureFileReader&) = delete;
+
+    //! the capture as it was streamed, 'bytes' is the payload in the file
+    inline const SigFeather::CaptureInfo& getInfo() const { return info; }
+    inline uint64_t getSampleCount() const { return header.samples; }
+    inline size_t getChunkCount() const { return index.size(); }
+    //! false if the index was rebuilt from the chunk headers
+    inline bool isComplete() const { return header.indexOffset!=0; }
+    //! gaps and segments in stream order
+    inline const std::vector<CaptureFile::Mark>& getMarks() const { return marks; }
+
+    ChunkView getChunk(size_t chunk) const;
+    //! chunk holding 'sample', or getChunkCount() if it is beyond the capture
+    size_t findChunk(uint64_t sample) const;
+    //! data from the word holding 'sample' to the end of its chunk
+    ChunkView view(uint64_t sample) const;
+
+    //! feeds the capture to 'sink' like IDevice::stream() would, with its gaps and
+    //! segments. the zeros stored for a gap are not passed on. returns the bytes passed
+    size_t replay(SigFeather::ISampleSink& sink) const;
+
+private:
+    const uint8_t* mapping=nullptr;
+    size_t size=0;
+    CaptureFile::Header header;
+    std::vector<CaptureFile::IndexEntry> index;
+    std::vector<CaptureFile::Mark> marks;
+    SigFeather::CaptureInfo info;
+    uint64_t samplesPerChunk=0;
+
+    void rebuildIndex();
+};
@@ -0,0 +1,223 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "capturegroup.h"
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include "edgeextractor.h"
+#include "wordaligner.h"
+
+namespace
+{
+    //! passes a capture on to the sink of its device and records the result,
+    //! including the first level change on the sync channel
+    class DeviceSink : public SigFeather::ISampleSink
+    {
+    public:
+        DeviceSink(SigFeather::ISampleSink& sink, int syncChannel, CaptureGroup::DeviceResult& result) :
+            sink(sink),
+            syncChannel(syncChannel),
+            result(result)
+        {
+        }
+
+        void onStart(const SigFeather::CaptureInfo& info) override
+        {
+            result.info=info;
+            if (syncChannel>=0 && syncChannel<info.channels)
+            {
+                edges=std::make_unique<EdgeExtractor>(info.channels);
+                sampleLimit=info.unbounded ? std::numeric_limits<uint64_t>::max() : info.samples;
+            }
+            sink.onStart(info);
+        }
+
+        bool onData(const uint8_t* data, size_t bytes) override
+        {
+            scan(data, bytes);
+            return sink.onData(data, bytes);
+        }
+
+        //! the device passes transfers here, the wrapped sink may keep them too
+        bool onBuffer(const SigFeather::BufferView& buffer) override
+        {
+            scan(buffer.data(), buffer.size());
+            return sink.onBuffer(buffer);
+        }
+
+        void onGap(size_t offset, size_t bytes) override
+        {
+            // sample positions after a gap no longer match the other devices
+            edges=nullptr;
+            sink.onGap(offset, bytes);
+        }
+
+        void onSegment(size_t index, size_t offset, uint64_t timestamp) override
+        {
+            // so do sample positions in later segments
+            if (index>0) edges=nullptr;
+            sink.onSegment(index, offset, timestamp);
+        }
+
+        void onChange(uint64_t clock, uint32_t pins) override
+        {
+            sink.onChange(clock, pins);
+        }
+
+        void onEnd(size_t totalBytes) override
+        {
+            result.bytes=totalBytes;
+            sink.onEnd(totalBytes);
+        }
+
+        void onError(const std::string& message) override
+        {
+            result.error=message;
+            sink.onError(message);
+        }
+
+    private:
+        SigFeather::ISampleSink& sink;
+        int syncChannel;
+        CaptureGroup::DeviceResult& result;
+        std::unique_ptr<EdgeExtractor> edges;
+        WordAligner aligner;
+        uint64_t sampleLimit=0;
+
+        //! only looks for the sync edge until it was found
+        inline void scan(const uint8_t* data, size_t bytes)
+        {
+            if (edges) aligner.push(data, bytes, [this](const uint8_t* words, size_t count) { return findSync(words, count); });
+        }
+
+        bool findSync(const uint8_t* words, size_t bytes)
+        {
+            uint64_t samples=std::min<uint64_t>(bytes*8/edges->getChannels(), sampleLimit-edges->getSampleCount());
+            if (samples==0) return true;
+            edges->push(words, samples);
+            // the transition at sample 0 only reports the initial level
+            for (const auto& transition : edges->getTransitions(syncChannel))
+            {
+                if (transition.sample==0) continue;
+                result.syncSample=transition.sample;
+                result.synchronized=true;
+                edges=nullptr;
+                return false;
+            }
+            edges->clear();
+            return true;
+        }
+    };
+
+    //! holds every device back until all are configured, then releases them
+    //! at once. spins instead of sleeping, waking threads would add skew.
+    class StartBarrier
+    {
+    public:
+        explicit StartBarrier(size_t count) :
+            count(count)
+        {
+        }
+
+        //! returns false if the start was cancelled
+        bool wait()
+        {
+            ++arrived;
+            while (arrived.load()<count && !cancelled.load()) std::this_thread::yield();
+            return !cancelled.load();
+        }
+
+        //! releases waiting devices without starting them, for a device that failed before it arrived
+        inline void cancel() { cancelled=true; }
+
+    private:
+        size_t count;
+        std::atomic<size_t> arrived=0;
+        std::atomic<bool> cancelled=false;
+    };
+}
+
+CaptureGroup::CaptureGroup(std::vector<SigFeather::DeviceHandle> devices) :
+    devices(std::move(devices))
+{
+}
+
+void CaptureGroup::open()
+{
+    for (auto& device : devices)
+    {
+        if (!device->isOpen()) device->open();
+    }
+}
+
+void CaptureGroup::close()
+{
+    for (auto& device : devices)
+    {
+        device->close();
+    }
+}
+
+std::vector<CaptureGroup::DeviceResult> CaptureGroup::stream(const SigFeather::CaptureSettings& settings, const std::vector<SigFeather::ISampleSink*>& sinks)
+{
+    if (sinks.size()!=devices.size())
+    {
+        throw std::invalid_argument("a capture group needs one sink per device");
+    }
+
+    std::vector<DeviceResult> results(devices.size());
+    std::vector<std::unique_ptr<DeviceSink>> deviceSinks;
+    for (size_t i=0; i<devices.size(); ++i)
+    {
+        results[i].serialNumber=devices[i]->getSerialNumber();
+        deviceSinks.push_back(std::make_unique<DeviceSink>(*sinks[i], syncChannel, results[i]));
+    }
+
+    StartBarrier barrier(devices.size());
+    std::vector<std::thread> threads;
+    for (size_t i=0; i<devices.size(); ++i)
+    {
+        threads.emplace_back([this, i, &settings, &results, &deviceSinks, &barrier]()
+            {
+                bool arrived=false;
+                try
+                {
+                    devices[i]->stream(settings, *deviceSinks[i], [&arrived, &barrier]()
+                        {
+                            arrived=true;
+                            return barrier.wait();
+                        });
+                }
+                catch (const std::exception& ex)
+                {
+                    results[i].error=ex.what();
+                }
+                if (!arrived) barrier.cancel();
+            });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    // offsets relative to the first device, measured on the sync channel where it changed on both
+    const DeviceResult& reference=results[0];
+    for (auto& result : results)
+    {
+        if (result.synchronized && reference.synchronized)
+        {
+            result.offset=int64_t(reference.syncSample)-int64_t(result.syncSample);
+        }
+        else
+        {
+            result.synchronized=false;
+            result.offset=std::llround((result.info.startTime-reference.info.startTime)*reference.info.sampleRate);
+        }
+    }
+    return results;
+}
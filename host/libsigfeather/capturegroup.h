@@ -0,0 +1,66 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sigfeather.h"
+
+//! Captures from several SigFeathers at once to get more channels and more
+//! USB bandwidth than one board offers; boards on separate host controllers
+//! do not share bandwidth. All devices get the same settings, each is
+//! configured and drained on its own thread, and sampling is started on all
+//! of them together once every device is configured, so the start skew is
+//! down to the spread of a single control request.
+//!
+//! The remaining offset between the boards is estimated per capture and
+//! reported as a sample offset relative to the first device:
+//!  - from host timestamps taken around each start request, always available
+//!    but only good to the USB round trip of some 100us
+//!  - from a sync channel: a pin wired to the same signal on every board.
+//!    the first level change on it is the same instant on all boards, which
+//!    pins the offset down to one sample. the signal must change more slowly
+//!    than the start skew, or a board that starts late misses the change the
+//!    others saw first and pairs up a later one.
+class CaptureGroup
+{
+public:
+    struct DeviceResult
+    {
+        std::string serialNumber;
+        SigFeather::CaptureInfo info;
+        size_t bytes=0;                 //!< sample bytes delivered to the sink
+        std::string error;              //!< empty if the capture ended regularly
+        int64_t offset=0;               //!< sample s of this device was taken with sample s+offset of the first one
+        bool synchronized=false;        //!< the offset was measured on the sync channel, not estimated from timestamps
+        uint64_t syncSample=0;          //!< first level change on the sync channel, if synchronized
+    };
+
+    static constexpr int NoSyncChannel=-1;
+
+    //! the devices are opened by open() unless they are open already
+    explicit CaptureGroup(std::vector<SigFeather::DeviceHandle> devices);
+
+    //! channel index within the capture, not GPIO, that sees the same signal on all boards
+    inline void setSyncChannel(int channel) { syncChannel=channel; }
+    inline int getSyncChannel() const { return syncChannel; }
+
+    inline size_t getDeviceCount() const { return devices.size(); }
+    inline const SigFeather::DeviceHandle& getDevice(size_t index) const { return devices[index]; }
+
+    //! throws std::runtime_error if a device cannot be opened
+    void open();
+    void close();
+
+    //! captures from all devices with the same settings, device i streams into
+    //! sinks[i] on a thread of its own. returns once all captures ended, if any
+    //! device fails before sampling starts, none is started. throws
+    //! std::invalid_argument if there is not one sink per device.
+    std::vector<DeviceResult> stream(const SigFeather::CaptureSettings& settings, const std::vector<SigFeather::ISampleSink*>& sinks);
+
+private:
+    std::vector<SigFeather::DeviceHandle> devices;
+    int syncChannel=NoSyncChannel;
+};
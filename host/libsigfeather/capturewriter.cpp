@@ -0,0 +1,22 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "capturewriter.h"
+#include <algorithm>
+#include <cctype>
+#include "capturefile.h"
+#include "sigrokwriter.h"
+#include "vcdwriter.h"
+
+std::unique_ptr<ICaptureWriter> createCaptureWriter(const std::string& path)
+{
+    std::string extension;
+    auto dot=path.find_last_of('.');
+    if (dot!=std::string::npos) extension=path.substr(dot+1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    if (extension=="vcd") return std::make_unique<VcdWriter>(path);
+    if (extension=="sr") return std::make_unique<SigrokWriter>(path);
+    return std::make_unique<CaptureFileWriter>(path);
+}
@@ -0,0 +1,23 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <memory>
+#include <string>
+#include "sigfeather.h"
+
+//! A sample sink that stores the capture in a file while it is streamed.
+class ICaptureWriter : public SigFeather::ISampleSink
+{
+public:
+    //! a write failed, the capture was stopped at that point
+    virtual bool hasError() const =0;
+    //! the format holds the gaps and segments of a framed or segmented capture
+    virtual bool supportsGaps() const { return true; }
+};
+
+//! creates the writer for the format given by the file extension:
+//! .vcd (value change dump), .sr (sigrok session) or .sfcap for anything else.
+//! throws std::runtime_error if the file cannot be created.
+std::unique_ptr<ICaptureWriter> createCaptureWriter(const std::string& path);
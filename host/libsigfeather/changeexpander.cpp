@@ -0,0 +1,148 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "changeexpander.h"
+#include "protocol.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static_assert(sizeof(ChangeRecord)==8, "partial record buffer size mismatch");
+
+ChangeExpander::ChangeExpander(unsigned channels, double clocksPerSample, uint64_t limit) :
+    channels(channels),
+    samplesPerWord(32/channels),
+    clocksPerSample(clocksPerSample),
+    limit(limit)
+{
+    scratch.reserve(ScratchWords);
+}
+
+bool ChangeExpander::push(const uint8_t* data, size_t bytes, const ChangeOutput& changes, const SampleOutput& samples)
+{
+    if (error || isComplete()) return false;
+
+    // the host is little-endian like the device, see protocol.h
+    size_t position=0;
+    ChangeRecord record;
+    if (partialBytes>0)
+    {
+        size_t count=std::min(sizeof(partial)-partialBytes, bytes);
+        std::memcpy(partial+partialBytes, data, count);
+        partialBytes+=count;
+        position=count;
+        if (partialBytes<sizeof(partial)) return true;
+        partialBytes=0;
+        std::memcpy(&record, partial, sizeof(record));
+        if (!handleRecord(record.timer, record.pins, changes, samples)) return false;
+    }
+    for (; bytes-position>=sizeof(record); position+=sizeof(record))
+    {
+        std::memcpy(&record, data+position, sizeof(record));
+        if (!handleRecord(record.timer, record.pins, changes, samples)) return false;
+    }
+    partialBytes=bytes-position;
+    std::memcpy(partial, data+position, partialBytes);
+    return flush(samples);
+}
+
+bool ChangeExpander::handleRecord(uint32_t timer, uint32_t state, const ChangeOutput& changes, const SampleOutput& samples)
+{
+    if (timer>ChangeTimerStart)
+    {
+        error=true;
+        return false;
+    }
+    if (first)
+    {
+        // the device starts out as if it had reported all pins low
+        first=false;
+        expired=(state==0);
+        pins=state;
+        return changes(0, state);
+    }
+    if (resync)
+    {
+        // the records before were lost, so the base of this one is unknown
+        resync=false;
+        if (!fill(uint64_t(std::ceil(double(clock)/clocksPerSample)), samples)) return false;
+        expired=(timer==0);
+        pins=state;
+        return changes(clock, state);
+    }
+
+    clock+=(expired ? ChangeExpiredClocks : ChangeRecordClocks)+uint64_t(ChangeLoopClocks)*(ChangeTimerStart-timer);
+    // samples taken before this record still show the previous state
+    if (!fill(uint64_t(std::ceil(double(clock)/clocksPerSample)), samples)) return false;
+    expired=(state==pins);
+    if (expired) return true;
+    pins=state;
+    return changes(clock, state);
+}
+
+bool ChangeExpander::gap(uint64_t timestamp, const SampleOutput& samples, const GapOutput& gaps)
+{
+    if (error || isComplete()) return false;
+
+    // a record cut by the gap is lost with the others
+    partialBytes=0;
+    first=false;
+    resync=true;
+    clock=std::max(clock, timestamp);
+    if (wordSamples>0 && !fill(expanded+samplesPerWord-wordSamples, samples)) return false;
+    if (!flush(samples)) return false;
+    uint64_t end=std::min(uint64_t(double(clock)/clocksPerSample), limit)/samplesPerWord*samplesPerWord;
+    if (end<=expanded) return true;
+    uint64_t offset=expanded/samplesPerWord*sizeof(uint32_t);
+    uint64_t bytes=(end-expanded)/samplesPerWord*sizeof(uint32_t);
+    expanded=end;
+    return gaps(offset, bytes);
+}
+
+bool ChangeExpander::fill(uint64_t end, const SampleOutput& output)
+{
+    end=std::min(end, limit);
+    uint32_t sample=channels<32 ? pins & ((1u<<channels)-1) : pins;
+    while (expanded<end)
+    {
+        if (wordSamples==0 && end-expanded>=samplesPerWord)
+        {
+            // whole words of a single state
+            uint32_t pattern=0;
+            for (unsigned i=0; i<samplesPerWord; ++i) pattern|=sample<<(channels*i);
+            size_t words=size_t(std::min<uint64_t>((end-expanded)/samplesPerWord, ScratchWords-scratch.size()));
+            scratch.insert(scratch.end(), words, pattern);
+            expanded+=uint64_t(words)*samplesPerWord;
+        }
+        else
+        {
+            // the oldest sample of a word occupies its most significant bits
+            word|=sample<<(32-channels*(wordSamples+1));
+            ++expanded;
+            if (++wordSamples==samplesPerWord)
+            {
+                scratch.push_back(word);
+                word=0;
+                wordSamples=0;
+            }
+        }
+        if (scratch.size()==ScratchWords && !flush(output)) return false;
+    }
+    if (expanded<limit) return true;
+
+    // data ends on a word boundary, the rest of the last word is sampled like the others
+    for (; wordSamples>0 && wordSamples<samplesPerWord; ++wordSamples) word|=sample<<(32-channels*(wordSamples+1));
+    if (wordSamples>0) scratch.push_back(word);
+    wordSamples=0;
+    flush(output);
+    return false;
+}
+
+bool ChangeExpander::flush(const SampleOutput& output)
+{
+    if (scratch.empty()) return true;
+    bool more=output(reinterpret_cast<const uint8_t*>(scratch.data()), scratch.size()*sizeof(uint32_t));
+    scratch.clear();
+    return more;
+}
@@ -0,0 +1,68 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+//! Rebuilds the pin changes of a change-only session (see protocol.h) with
+//! their time in loop clocks, and expands them into sample words at any rate,
+//! packed like a MultiChannel session sends them. Input may be split anywhere,
+//! even inside a record. Records lost in a framed session are skipped with
+//! gap(), the samples up to the device's estimate of the next record become a
+//! gap.
+class ChangeExpander
+{
+public:
+    //! receives the pin state at 'clock' loop clocks after the first record,
+    //! starting with the initial state. return false to stop decoding
+    using ChangeOutput=std::function<bool(uint64_t clock, uint32_t pins)>;
+    //! receives expanded sample data, return false to stop decoding
+    using SampleOutput=std::function<bool(const uint8_t* data, size_t bytes)>;
+    //! receives whole sample words of unknown state at their byte offset, return false to stop decoding
+    using GapOutput=std::function<bool(uint64_t offset, uint64_t bytes)>;
+
+    //! samples every 'clocksPerSample' loop clocks, stops after 'limit' samples
+    ChangeExpander(unsigned channels, double clocksPerSample, uint64_t limit);
+
+    //! decodes 'bytes' bytes of the record stream. returns false once the limit
+    //! is reached, an output stopped or the stream is corrupt. changes are
+    //! passed on as they are decoded, ahead of the samples that show them.
+    bool push(const uint8_t* data, size_t bytes, const ChangeOutput& changes, const SampleOutput& samples);
+
+    //! records were lost, the next one was read about 'timestamp' loop clocks
+    //! after the first. the current word is completed with the last state, the
+    //! words up to the estimate are passed on as a gap.
+    bool gap(uint64_t timestamp, const SampleOutput& samples, const GapOutput& gaps);
+
+    inline bool hasError() const { return error; }
+    inline bool isComplete() const { return expanded>=limit; }
+    inline uint64_t getExpanded() const { return expanded; }
+
+private:
+    static constexpr size_t ScratchWords=4096;
+
+    unsigned channels;
+    unsigned samplesPerWord;
+    double clocksPerSample;
+    uint64_t limit;
+    uint64_t expanded=0;            // samples in complete words or in 'word'
+    bool error=false;
+    bool first=true;
+    bool expired=false;             // the last record repeated the state, its timer ran out
+    bool resync=false;              // the next record follows a gap, its time is 'clock'
+    uint64_t clock=0;               // of the last record
+    uint32_t pins=0;                // state of the last record
+    uint32_t word=0;                // sample word being filled
+    unsigned wordSamples=0;
+    uint8_t partial[8];             // a record split across push() calls
+    size_t partialBytes=0;
+    std::vector<uint32_t> scratch;
+
+    bool handleRecord(uint32_t timer, uint32_t state, const ChangeOutput& changes, const SampleOutput& samples);
+    bool fill(uint64_t end, const SampleOutput& output);
+    bool flush(const SampleOutput& output);
+};
@@ -0,0 +1,65 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//! one decoded unit of a protocol, e.g. a UART character or an I2C address
+struct DecodedFrame
+{
+    enum class Type : uint8_t
+    {
+        Data,
+        Start,
+        Stop,
+        Address,
+        Error
+    };
+
+    enum Flags : uint8_t
+    {
+        FlagAck = 0x01,             //!< I2C: the byte was acknowledged
+        FlagRead = 0x02,            //!< I2C: read access
+        FlagParityError = 0x04,     //!< UART
+        FlagFramingError = 0x08     //!< UART: stop bit missing, SPI: word cut short by chip select
+    };
+
+    uint64_t start=0;               //!< first sample of the frame
+    uint64_t end=0;                 //!< first sample after the frame
+    Type type=Type::Data;
+    uint8_t flags=0;
+    uint32_t data=0;                //!< character, byte, address or MOSI word
+    uint32_t data2=0;               //!< SPI: MISO word
+};
+
+//! Base of all protocol decoders. A decoder sees the capture as a sequence of
+//! level changes of the channels it watches and may keep any state between
+//! calls, so chunk boundaries of the capture do not matter. All calls are made
+//! in sample order from the thread of the DecoderPipeline.
+class Decoder
+{
+public:
+    using FrameList=std::vector<DecodedFrame>;
+
+    virtual ~Decoder() = default;
+
+    virtual const char* getName() const =0;
+    //! capture channels the decoder watches, bit i is channel i
+    virtual uint32_t getChannelMask() const =0;
+    //! renders a frame of this decoder for display
+    virtual std::string describe(const DecodedFrame& frame) const =0;
+
+    //! a capture at 'sampleRate' samples per second starts
+    virtual void begin(double sampleRate) {}
+    //! the capture lost samples or continues with a new segment. drops the frame in
+    //! progress, the next onChange() reports the initial levels again.
+    virtual void reset() {}
+    //! from 'sample' on the channels have 'levels', channels in 'changed' differ
+    //! from the previous call. the first call reports the initial levels.
+    virtual void onChange(uint64_t sample, uint32_t levels, uint32_t changed, FrameList& frames) =0;
+    //! no level changes happen before 'sample'
+    virtual void onAdvance(uint64_t sample, FrameList& frames) {}
+};
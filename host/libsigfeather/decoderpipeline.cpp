@@ -0,0 +1,202 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "decoderpipeline.h"
+#include <algorithm>
+#include <limits>
+
+DecoderPipeline::DecoderPipeline(FrameHandler handler, size_t queueDepth) :
+    handler(std::move(handler)),
+    queueDepth(std::max<size_t>(queueDepth, 1))
+{
+}
+
+DecoderPipeline::~DecoderPipeline()
+{
+    stopWorker();
+}
+
+void DecoderPipeline::addDecoder(std::unique_ptr<Decoder> decoder)
+{
+    decoders.push_back(std::move(decoder));
+}
+
+void DecoderPipeline::onStart(const SigFeather::CaptureInfo& info)
+{
+    stopWorker();
+
+    edges=std::make_unique<EdgeExtractor>(info.channels);
+    sampleLimit=info.unbounded ? std::numeric_limits<uint64_t>::max() : info.samples;
+    samplesPushed=0;
+    restartSample=0;
+    aligner.reset();
+    sampleRate=info.sampleRate;
+    levels=0;
+    cursors.assign(info.channels, 0);
+
+    // channels the capture does not contain never change
+    uint32_t available=info.channels>=32 ? 0xffffffff : (1u<<info.channels)-1;
+    channelMask=0;
+    for (auto& decoder : decoders)
+    {
+        channelMask|=decoder->getChannelMask() & available;
+        decoder->begin(sampleRate);
+    }
+
+    queue.clear();
+    finished=false;
+    cancelled=false;
+    worker=std::thread(&DecoderPipeline::run, this);
+}
+
+bool DecoderPipeline::onData(const uint8_t* data, size_t bytes)
+{
+    return onBuffer(SigFeather::BufferView::copy(data, bytes));
+}
+
+bool DecoderPipeline::onBuffer(const SigFeather::BufferView& buffer)
+{
+    return enqueue(Item{buffer});
+}
+
+void DecoderPipeline::onGap(size_t offset, size_t bytes)
+{
+    enqueue(Item{{}, true, bytes});
+}
+
+void DecoderPipeline::onSegment(size_t index, size_t offset, uint64_t timestamp)
+{
+    enqueue(Item{{}, true, 0});
+}
+
+bool DecoderPipeline::enqueue(Item item)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    signal.wait(lock, [this]() { return queue.size()<queueDepth || cancelled; });
+    if (cancelled) return false;
+
+    queue.push_back(std::move(item));
+    signal.notify_all();
+    return true;
+}
+
+void DecoderPipeline::onEnd(size_t totalBytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished=true;
+    }
+    signal.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void DecoderPipeline::onError(const std::string& message)
+{
+    stopWorker();
+}
+
+void DecoderPipeline::stopWorker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        cancelled=true;
+    }
+    signal.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void DecoderPipeline::run()
+{
+    while (true)
+    {
+        Item item;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            signal.wait(lock, [this]() { return !queue.empty() || finished || cancelled; });
+            if (cancelled || queue.empty()) return;
+            item=std::move(queue.front());
+            queue.pop_front();
+        }
+        // wake a producer waiting for space
+        signal.notify_all();
+
+        if (item.restart) restart(item.lost);
+        else decode(item.buffer.data(), item.buffer.size());
+    }
+}
+
+void DecoderPipeline::restart(size_t lostBytes)
+{
+    // gaps and segments start on a sample word, nothing is left in the aligner
+    aligner.reset();
+    samplesPushed+=std::min<uint64_t>(uint64_t(lostBytes)*8/edges->getChannels(), sampleLimit-samplesPushed);
+    restartSample=samplesPushed;
+    edges->reset();
+    levels=0;
+    for (auto& decoder : decoders) decoder->reset();
+}
+
+void DecoderPipeline::decode(const uint8_t* data, size_t bytes)
+{
+    aligner.push(data, bytes, [this](const uint8_t* words, size_t count)
+        {
+            decodeWords(words, count);
+            return true;
+        });
+}
+
+void DecoderPipeline::decodeWords(const uint8_t* words, size_t bytes)
+{
+    unsigned channels=edges->getChannels();
+    uint64_t samples=std::min<uint64_t>(bytes*8/channels, sampleLimit-samplesPushed);
+    if (samples==0) return;
+    edges->push(words, samples);
+    samplesPushed+=samples;
+
+    auto deliver=[this](const Decoder& decoder)
+    {
+        for (const auto& frame : frames) handler(decoder, frame);
+        frames.clear();
+    };
+
+    // merge the transitions of all watched channels into one sequence of level changes
+    std::fill(cursors.begin(), cursors.end(), 0);
+    while (true)
+    {
+        uint64_t next=std::numeric_limits<uint64_t>::max();
+        for (unsigned c=0; c<channels; ++c)
+        {
+            if (!(channelMask & (1u<<c))) continue;
+            const auto& transitions=edges->getTransitions(c);
+            if (cursors[c]<transitions.size()) next=std::min<uint64_t>(next, transitions[cursors[c]].sample);
+        }
+        if (next==std::numeric_limits<uint64_t>::max()) break;
+
+        uint32_t changed=0;
+        for (unsigned c=0; c<channels; ++c)
+        {
+            if (!(channelMask & (1u<<c))) continue;
+            const auto& transitions=edges->getTransitions(c);
+            if (cursors[c]<transitions.size() && transitions[cursors[c]].sample==next)
+            {
+                levels=(levels & ~(1u<<c)) | (uint32_t(transitions[cursors[c]].level)<<c);
+                changed|=1u<<c;
+                ++cursors[c];
+            }
+        }
+        for (auto& decoder : decoders)
+        {
+            if (!(decoder->getChannelMask() & changed)) continue;
+            decoder->onChange(restartSample+next, levels, changed, frames);
+            deliver(*decoder);
+        }
+    }
+    edges->clear();
+
+    for (auto& decoder : decoders)
+    {
+        decoder->onAdvance(samplesPushed, frames);
+        deliver(*decoder);
+    }
+}
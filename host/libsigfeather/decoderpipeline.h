@@ -0,0 +1,96 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "sigfeather.h"
+#include "decoder.h"
+#include "edgeextractor.h"
+#include "wordaligner.h"
+
+//! A sample sink that runs protocol decoders while the capture is acquired.
+//! Sample data is queued in a bounded queue and decoded on a worker thread,
+//! so the USB transfers keep flowing while the decoders work. Buffers passed
+//! to onBuffer() are queued as they are, data passed to onData() is copied.
+//! When the queue is full, the sink blocks and pushes back on the device
+//! like any slow sink.
+//!
+//! The worker extracts level transitions of all watched channels, merges
+//! them into one time ordered sequence of level changes and feeds it to the
+//! decoders, which hand their frames to the FrameHandler on the worker thread.
+//! Gaps and segments reset the decoders in stream order, frames in progress are
+//! dropped and sample positions count lost samples like the stream offsets do.
+class DecoderPipeline : public SigFeather::ISampleSink
+{
+public:
+    using FrameHandler=std::function<void(const Decoder& decoder, const DecodedFrame& frame)>;
+
+    explicit DecoderPipeline(FrameHandler handler, size_t queueDepth=64);
+    ~DecoderPipeline() override;
+
+    // not copyable
+    DecoderPipeline(const DecoderPipeline&) = delete;
+    DecoderPipeline& operator=(const DecoderPipeline&) = delete;
+
+    //! add all decoders before the capture starts
+    void addDecoder(std::unique_ptr<Decoder> decoder);
+
+    //! rate of the capture being decoded, to convert frame samples to time
+    inline double getSampleRate() const { return sampleRate; }
+
+    // ISampleSink
+    void onStart(const SigFeather::CaptureInfo& info) override;
+    bool onData(const uint8_t* data, size_t bytes) override;
+    bool onBuffer(const SigFeather::BufferView& buffer) override;
+    void onGap(size_t offset, size_t bytes) override;
+    void onSegment(size_t index, size_t offset, uint64_t timestamp) override;
+    //! returns once all data was decoded
+    void onEnd(size_t totalBytes) override;
+    void onError(const std::string& message) override;
+
+private:
+    struct Item
+    {
+        SigFeather::BufferView buffer;
+        bool restart=false;                         // reset the decoders instead of decoding
+        size_t lost=0;                              // bytes lost before the restart
+    };
+
+    FrameHandler handler;
+    size_t queueDepth;
+    std::vector<std::unique_ptr<Decoder>> decoders;
+
+    // shared with the worker
+    std::deque<Item> queue;
+    std::mutex mutex;
+    std::condition_variable signal;
+    bool finished=false;
+    bool cancelled=false;
+    std::thread worker;
+
+    // owned by the worker
+    std::unique_ptr<EdgeExtractor> edges;
+    uint64_t sampleLimit=0;                         // samples to decode, unused samples of the last word are dropped
+    uint64_t samplesPushed=0;                       // includes lost samples
+    uint64_t restartSample=0;                       // stream sample of the edge extractor's sample 0
+    WordAligner aligner;
+    uint32_t channelMask=0;
+    uint32_t levels=0;
+    std::vector<size_t> cursors;
+    Decoder::FrameList frames;
+    double sampleRate=0;
+
+    bool enqueue(Item item);
+    void run();
+    void restart(size_t lostBytes);
+    void decode(const uint8_t* data, size_t bytes);
+    void decodeWords(const uint8_t* words, size_t bytes);
+    void stopWorker();
+};
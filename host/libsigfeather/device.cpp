@@ -3,7 +3,16 @@
 //! please see LICENSE file in root folder for licensing terms.
 
 #include "device.h"
+#include "bufferpool.h"
+#include "transferpipeline.h"
+#include "rledecoder.h"
+#include "framedecoder.h"
+#include "changeexpander.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <stdexcept>
 
@@ -25,45 +34,182 @@ namespace
             return result;
         }
     }
+
+    //! cuts the incoming transfers into the fixed size chunks requested by the sink.
+    //! data is only copied when a chunk straddles two transfers, otherwise the
+    //! sink gets views of the transfer buffers. the chunk before a gap or segment
+    //! and the last one may be shorter, a chunk never spans them.
+    class ChunkAssembler
+    {
+    public:
+        ChunkAssembler(SigFeather::ISampleSink& sink, size_t chunkSize) :
+            sink(sink),
+            chunkSize(chunkSize)
+        {
+            pending.reserve(chunkSize);
+        }
+
+        bool push(const SigFeather::BufferView& buffer)
+        {
+            total+=buffer.size();
+            if (chunkSize==0) return sink.onBuffer(buffer);
+            size_t offset=0;
+            if (!pending.empty() && !fillPending(buffer.data(), buffer.size(), offset)) return false;
+            while (pending.empty() && buffer.size()-offset>=chunkSize)
+            {
+                if (!sink.onBuffer(buffer.subview(offset, chunkSize))) return false;
+                offset+=chunkSize;
+            }
+            append(buffer.data()+offset, buffer.size()-offset);
+            return true;
+        }
+
+        //! for data that is not in a transfer buffer, e.g. decompressed data
+        bool push(const uint8_t* data, size_t bytes)
+        {
+            total+=bytes;
+            if (chunkSize==0) return sink.onData(data, bytes);
+            size_t offset=0;
+            if (!pending.empty() && !fillPending(data, bytes, offset)) return false;
+            while (pending.empty() && bytes-offset>=chunkSize)
+            {
+                if (!sink.onData(data+offset, chunkSize)) return false;
+                offset+=chunkSize;
+            }
+            append(data+offset, bytes-offset);
+            return true;
+        }
+
+        //! passes the pending chunk on first, so the gap is reported in stream order
+        bool gap(uint64_t offset, uint64_t bytes)
+        {
+            if (!flush()) return false;
+            sink.onGap(size_t(offset), size_t(bytes));
+            return true;
+        }
+
+        //! like gap(), a chunk never spans two segments
+        bool segment(uint32_t index, uint64_t offset, uint64_t timestamp)
+        {
+            if (!flush()) return false;
+            sink.onSegment(index, size_t(offset), timestamp);
+            return true;
+        }
+
+        //! passes the pending data on as a short chunk, returns what the sink did
+        bool flush()
+        {
+            if (pending.empty()) return true;
+            bool more=sink.onData(pending.data(), pending.size());
+            pending.clear();
+            return more;
+        }
+
+        inline size_t getTotal() const { return total; }
+
+    private:
+        SigFeather::ISampleSink& sink;
+        size_t chunkSize;
+        std::vector<uint8_t> pending;
+        size_t total=0;
+
+        //! completes the pending chunk from 'data' and passes it on once it is full
+        bool fillPending(const uint8_t* data, size_t bytes, size_t& offset)
+        {
+            offset=std::min(bytes, chunkSize-pending.size());
+            pending.insert(pending.end(), data, data+offset);
+            if (pending.size()<chunkSize) return true;
+            bool more=sink.onData(pending.data(), pending.size());
+            pending.clear();
+            return more;
+        }
+
+        inline void append(const uint8_t* data, size_t bytes)
+        {
+            pending.insert(pending.end(), data, data+bytes);
+        }
+    };
 }
 
-Device::Device(libusb_device* device, const libusb_device_descriptor& desc) :
+Device::Device(libusb_context* context, libusb_device* device, const libusb_device_descriptor& desc) :
     SigFeather::IDevice(),
+    context(context),
     device(device),
     handle(nullptr),
     descriptor(desc)
 {
     if (!device) throw std::invalid_argument("device is null");
+    libusb_ref_device(device);
+}
+
+Device::~Device()
+{
+    close();
+
+    // the handle is closed once buffers of the pool that are still in use are given back
+    transferPool = nullptr;
+    handleOwner = nullptr;
+    handle = nullptr;
+    libusb_unref_device(device);
+    device = nullptr;
+}
+
+void Device::openHandle() const
+{
+    if (handle) return;
+    if (!connected) throw std::runtime_error("device was disconnected");
     if (libusb_open(device, &handle) != 0)
     {
-        this->device = nullptr;
         handle = nullptr;
         throw std::runtime_error("failed to open device");
     }
+    handleOwner = std::shared_ptr<libusb_device_handle>(handle, libusb_close);
 }
 
-Device::~Device()
+BufferPool& Device::getTransferPool() const
 {
-    close();
+    if (!transferPool || transferPool->getBufferSize()!=transferSize)
+    {
+        transferPool=std::make_unique<BufferPool>(handleOwner, transferSize, hugePages);
+    }
+    return *transferPool;
+}
 
-    if (handle) libusb_close(handle);
-    handle = nullptr;
-    device = nullptr;
+void Device::readStrings() const
+{
+    std::scoped_lock lock(descriptorMutex);
+    if (stringsRead) return;
+    try
+    {
+        openHandle();
+    }
+    catch (const std::exception&)
+    {
+        // leave the strings empty and try again next time
+        return;
+    }
+    manufacturer = getStringDescriptor(handle, descriptor.iManufacturer);
+    product = getStringDescriptor(handle, descriptor.iProduct);
+    serialNumber = getStringDescriptor(handle, descriptor.iSerialNumber);
+    stringsRead = true;
 }
 
 std::string Device::getSerialNumber() const
 {
-    return getStringDescriptor(handle, descriptor.iSerialNumber);
+    readStrings();
+    return serialNumber;
 }
 
 std::string Device::getManufacturer() const
 {
-    return getStringDescriptor(handle, descriptor.iManufacturer);
+    readStrings();
+    return manufacturer;
 }
 
 std::string Device::getProduct() const
 {           
-    return getStringDescriptor(handle, descriptor.iProduct);
+    readStrings();
+    return product;
 }
 
 std::string Device::getAddress() const
@@ -78,6 +224,7 @@ std::string Device::getAddress() const
 void Device::open()
 {
     if (opened) return;
+    openHandle();
 
     libusb_config_descriptor* config = nullptr;
     if (libusb_get_active_config_descriptor(device, &config) != 0)
@@ -127,6 +274,33 @@ void Device::open()
         throw std::runtime_error("failed to claim sigfeather bulk interface");
     }
 
+    Capabilities reported;
+    try
+    {
+        reported=readVersionedCommand<Capabilities>(Command::GetCapabilities, 0);
+    }
+    catch (const std::runtime_error&)
+    {
+        // firmware before protocol version 2 stalls the unknown request
+        libusb_release_interface(handle, interfaceId);
+        throw std::runtime_error("device firmware is too old, please update it");
+    }
+    capabilities.protocolVersion=reported.protocolVersion;
+    capabilities.channelCounts=reported.channelCounts;
+    capabilities.pinCount=reported.pinCount;
+    capabilities.unbounded=(reported.flags & CapabilityUnbounded)!=0;
+    capabilities.compressed=(reported.flags & CapabilityCompressed)!=0;
+    capabilities.triggered=(reported.flags & CapabilityTriggered)!=0;
+    capabilities.deep=(reported.flags & CapabilityDeep)!=0;
+    capabilities.framed=(reported.flags & CapabilityFramed)!=0;
+    capabilities.quickStart=(reported.flags & CapabilityQuickStart)!=0;
+    capabilities.segmented=(reported.flags & CapabilitySegmented)!=0;
+    capabilities.changes=(reported.flags & CapabilityChanges)!=0;
+    capabilities.systemClock=reported.systemClock;
+    capabilities.sampleBufferSize=reported.sampleBufferSize;
+    capabilities.deepBufferSize=reported.deepBufferSize;
+    capabilities.deepBandwidth=reported.deepBandwidth;
+
     auto deviceStatus=readCommand<Status>(Command::Open, 0);
     if (deviceStatus!=Status::Opened)
     {
@@ -136,9 +310,21 @@ void Device::open()
     opened = true;
 }
 
+SigFeather::DeviceCapabilities Device::getCapabilities() const
+{
+    if (!opened) throw std::runtime_error("device is not open");
+    return capabilities;
+}
+
 void Device::close()
 {
     if (!opened) return;
+    if (!connected)
+    {
+        // nothing to tell a device that is gone
+        opened = false;
+        return;
+    }
 
     auto deviceStatus=readCommand<Status>(Command::Close, 0);
     if (deviceStatus!=Status::Closed)
@@ -153,14 +339,51 @@ void Device::close()
     opened = false;
 }
 
+void Device::setTransferQueue(size_t depth, size_t transferSize, bool hugePages)
+{
+    if (depth==0) throw std::invalid_argument("transfer queue depth must not be zero");
+    if (transferSize==0) throw std::invalid_argument("transfer size must not be zero");
+    queueDepth=depth;
+    this->transferSize=transferSize;
+    // the pool picks its memory once, buffers still in use keep the old one alive
+    if (hugePages!=this->hugePages) transferPool.reset();
+    this->hugePages=hugePages;
+}
+
+SigFeather::DeviceStatistics Device::getDeviceStatistics() const
+{
+    if (!opened) throw std::runtime_error("device is not open");
+
+    // a control request, so it does not interfere with a capture on the data endpoint
+    auto reported=readVersionedCommand<Statistics>(Command::GetStatistics, 0);
+    SigFeather::DeviceStatistics statistics;
+    statistics.fifoOverflows=reported.fifoOverflows;
+    statistics.dmaRestarts=reported.dmaRestarts;
+    statistics.updateRate=reported.updateRate;
+    statistics.maxUpdateGap=reported.maxUpdateGap;
+    statistics.bytesSent=reported.bytesSent;
+    statistics.peakLag=reported.peakLag;
+    statistics.bufferSize=reported.bufferSize;
+    statistics.lostBytes=reported.lostBytes;
+    return statistics;
+}
 
 size_t Device::benchmark(size_t bytes) const
 {
     if (!opened) return 0;
 
+    if (bytes>capabilities.sampleBufferSize)
+    {
+        std::cerr << "Device limits benchmarks to " << capabilities.sampleBufferSize << " bytes." << std::endl;
+        bytes=capabilities.sampleBufferSize;
+    }
+
+    // the device's last request is no longer a capture
+    lastSettings.reset();
+
     SessionConfiguration config;
     config.type=SessionType::Benchmark;
-    config.sampleCount=static_cast<uint32_t>(bytes);
+    config.sampleCount=bytes;
     writeCommand<SessionConfiguration>(Command::ConfigureSession, 0, config);
 
     auto deviceStatus=readCommand<Status>(Command::GetStatus, 0);
@@ -169,7 +392,7 @@ size_t Device::benchmark(size_t bytes) const
         std::cerr << "Device not in opened state before benchmark, status " << (int)deviceStatus << std::endl;
         return 0;
     }
-    config=readCommand<SessionConfiguration>(Command::GetSessionConfiguration, 0);
+    config=readVersionedCommand<SessionConfiguration>(Command::GetSessionConfiguration, 0);
     if (config.sampleCount<bytes)
     {
         std::cerr << "Device limited benchmark to " << config.sampleCount << " bytes." << std::endl;
@@ -183,114 +406,520 @@ size_t Device::benchmark(size_t bytes) const
         return 0;
     }
 
-    uint8_t* buffer=new uint8_t[bytes];
-    uint8_t* cursor=buffer;
-    int result=0;
-    while (bytes>0)
-    {
-        //size_t chunk=std::min(bytes,size_t(1024));
-
-        int transferred=0;
-        result=libusb_bulk_transfer(handle, endpoint, cursor, bytes, &transferred, 1000);
-        if (result==LIBUSB_ERROR_TIMEOUT)
+    TransferPipeline pipeline(context, handle, endpoint, queueDepth, transferSize, getTransferPool());
+    size_t received=0;
+    bool intact=true;
+    int result=pipeline.run(bytes, [&received,&intact](const SigFeather::BufferView& buffer)
         {
-            if (transferred>0) result=0; // if we made progress, ignore the timeout error and try again
+            const uint8_t* data=buffer.data();
+            size_t count=buffer.size();
+            for (size_t i=0; intact && i<count; ++i)
+            {
+                if (data[i]!=uint8_t((received+i)%251))
+                {
+                    std::cerr << "Data integrity error at location " << received+i << std::endl;
+                    intact=false;
+                }
+            }
+            received+=count;
+            return true;
         }
-        if (transferred>bytes) throw std::runtime_error("too many bytes returned!");
-        if (result!=0) break;
-        if (transferred==0) break;  // not sure what happened, but we didn't get an data so we stop instead of risking infinite loop
-        cursor+=transferred;
-        bytes-=transferred;
-    }
+    );
+    transferStatistics=pipeline.getStatistics();
 
     if (result!=0)
     {
         std::cerr << "Transfer ended abnormally with status " << libusb_error_name(result) << std::endl;
     }
 
-    bytes=cursor-buffer;
-    for (size_t i=0; i<bytes; ++i)
-    {
-        if (buffer[i]!=uint8_t(i%251))
-        {
-            std::cerr << "Data integrity error at location " << i << std::endl;
-            break;
-        }
-    }
-
     deviceStatus=readCommand<Status>(Command::Stop, 0);
     if (deviceStatus!=Status::Opened)
     {
         std::cerr << "Device returned status " << (int)deviceStatus << std::endl;
     }
 
+    return received;
+}
 
-    delete [] buffer;
-    return bytes;
+size_t Device::stream(const SigFeather::CaptureSettings& settings, SigFeather::ISampleSink& sink) const
+{
+    return stream(settings, sink, nullptr);
 }
 
-std::vector<uint8_t> Device::sample(size_t samples) const
+size_t Device::stream(const SigFeather::CaptureSettings& settings, SigFeather::ISampleSink& sink, const std::function<bool()>& ready) const
 {
-    std::vector<uint8_t> buffer;
+    if (!opened)
+    {
+        sink.onError("device is not open");
+        return 0;
+    }
+
+    if (settings.channels==0 || settings.channels>32 || (32%settings.channels)!=0)
+    {
+        throw std::invalid_argument("channel count must be 1, 2, 4, 8, 16 or 32");
+    }
+
+    bool triggered=settings.trigger.type!=SigFeather::TriggerType::None;
+    if (triggered && settings.unbounded)
+    {
+        throw std::invalid_argument("a triggered capture cannot be unbounded");
+    }
+    bool segmented=settings.segments>1;
+    if (segmented && (settings.unbounded || settings.compressed))
+    {
+        throw std::invalid_argument("a segmented capture cannot be unbounded or compressed");
+    }
+    bool changes=settings.changesOnly;
+    if (changes && (settings.compressed || settings.deep || triggered || segmented))
+    {
+        throw std::invalid_argument("a change-only capture cannot be compressed, deep, triggered or segmented");
+    }
+    if (changes && settings.sampleRate==0)
+    {
+        throw std::invalid_argument("a change-only capture needs the sample rate to expand it to");
+    }
+    if (settings.segments>std::numeric_limits<uint16_t>::max() || settings.segmentInterval>std::numeric_limits<uint32_t>::max())
+    {
+        throw std::invalid_argument("too many segments or segment interval too long");
+    }
+
+    // everything the device reported at open() is checked here, without a round trip
+    if (!capabilities.supportsChannels(settings.channels))
+    {
+        throw std::invalid_argument("device cannot sample " + std::to_string(settings.channels) + " channels");
+    }
+    if (settings.basePin+settings.channels>capabilities.pinCount)
+    {
+        throw std::invalid_argument("channels beyond the last pin of the device");
+    }
+    if (settings.unbounded && !capabilities.unbounded)
+    {
+        sink.onError("device does not support unbounded sampling");
+        return 0;
+    }
+    if (triggered && !capabilities.triggered)
+    {
+        sink.onError("device does not support triggered sampling");
+        return 0;
+    }
+    if (settings.trigger.type==SigFeather::TriggerType::Pattern && uint64_t(settings.sampleRate)*2>capabilities.systemClock)
+    {
+        // the device compares the pattern at twice the sample rate, so it sees a pattern that lasts one sample
+        throw std::invalid_argument("a pattern trigger needs a sample rate of at most half the device clock");
+    }
+    if (segmented && !capabilities.segmented)
+    {
+        sink.onError("device does not support segmented sampling");
+        return 0;
+    }
+    if (changes && !capabilities.changes)
+    {
+        sink.onError("device does not support change-only sampling");
+        return 0;
+    }
+    bool compress=settings.compressed && capabilities.compressed;
+    if (settings.compressed && !compress)
+    {
+        std::cerr << "Device does not support compression, sampling uncompressed." << std::endl;
+    }
+    if (settings.framed && compress)
+    {
+        throw std::invalid_argument("a framed capture cannot be compressed");
+    }
+    // segments are always sent in a framed stream
+    bool framed=(settings.framed || segmented) && capabilities.framed;
+    if (settings.framed && !framed)
+    {
+        std::cerr << "Device does not support framed streams, a sampling overrun ends the capture." << std::endl;
+    }
+    size_t captureBytes=(settings.samples*settings.channels+7)/8;
+    bool deep=settings.deep;
+    if (!settings.deep && !settings.unbounded && !triggered && !segmented && !changes && captureBytes>capabilities.sampleBufferSize &&
+        capabilities.deep && settings.sampleRate<=capabilities.getMaxDeepSampleRate(settings.channels))
+    {
+        // too long for the sample buffer, but PSRAM keeps up with the rate
+        deep=true;
+    }
+    if (deep && !capabilities.deep)
+    {
+        std::cerr << "Device has no PSRAM, using its sample buffer." << std::endl;
+        deep=false;
+    }
+
+    SessionConfiguration config;
+    config.type=changes ? SessionType::Changes : SessionType::MultiChannel;
+    // a change-only session runs until stopped, at the device's best resolution
+    config.sampleCount=settings.unbounded || changes ? 0 : settings.samples;
+    config.flags=(settings.unbounded || changes ? SessionFlagUnbounded : 0) | (compress ? SessionFlagCompressed : 0) |
+        (deep ? SessionFlagDeep : 0) | (framed ? SessionFlagFramed : 0);
+    config.basePin=settings.basePin;
+    config.channelCount=settings.channels;
+    config.sampleRate=changes ? 0 : settings.sampleRate;
+    config.triggerType=static_cast<TriggerType>(settings.trigger.type);
+    config.triggerPin=settings.trigger.pin;
+    config.triggerWidth=settings.trigger.width;
+    config.triggerPattern=settings.trigger.pattern;
+    config.preTriggerSamples=settings.trigger.preTriggerSamples;
+    config.segmentCount=segmented ? uint16_t(settings.segments) : 0;
+    config.segmentInterval=uint32_t(settings.segmentInterval);
+    SessionConfiguration requestedConfig=config;
+
+    // the device's configuration changes now, so rearm() repeats nothing until this capture started
+    lastSettings.reset();
+    auto requested=std::chrono::steady_clock::now();
+    auto started=requested;
+    if (!ready && capabilities.quickStart)
+    {
+        // a single round trip, the device reports the outcome ahead of the sample data
+        writeCommand<SessionConfiguration>(Command::ConfigureAndStart, 0, config);
+        started=std::chrono::steady_clock::now();
+        if (!readStartResult(config, sink)) return 0;
+        if (!checkSession(settings, requestedConfig, config, sink))
+        {
+            readCommand<Status>(Command::Stop, 0);
+            drainEndpoint();
+            return 0;
+        }
+    }
+    else
+    {
+        writeCommand<SessionConfiguration>(Command::ConfigureSession, 0, config);
+
+        auto deviceStatus=readCommand<Status>(Command::GetStatus, 0);
+        if (deviceStatus!=Status::Opened)
+        {
+            sink.onError("device not in opened state before sampling, status " + std::to_string(int(deviceStatus)));
+            return 0;
+        }
+        config=readVersionedCommand<SessionConfiguration>(Command::GetSessionConfiguration, 0);
+        if (!checkSession(settings, requestedConfig, config, sink)) return 0;
+
+        if (ready && !ready())
+        {
+            sink.onError("capture was cancelled before it started");
+            return 0;
+        }
+
+        requested=std::chrono::steady_clock::now();
+        deviceStatus=readCommand<Status>(Command::Start, 0);
+        started=std::chrono::steady_clock::now();
+        if (deviceStatus!=Status::Running)
+        {
+            sink.onError("device returned status " + std::to_string(int(deviceStatus)) + " on start");
+            return 0;
+        }
+    }
 
-    if (!opened) return buffer;
+    lastSettings=settings;
+    return receive(settings, config, sink, requested, started);
+}
 
+size_t Device::rearm(SigFeather::ISampleSink& sink) const
+{
+    if (!opened)
+    {
+        sink.onError("device is not open");
+        return 0;
+    }
+    if (!lastSettings)
+    {
+        sink.onError("there is no capture to repeat");
+        return 0;
+    }
+    if (!capabilities.quickStart) return stream(*lastSettings, sink);
+
+    // the device still has the configuration, so the whole control plane is one request without data
+    auto requested=std::chrono::steady_clock::now();
+    writeControlBuffer(Command::Rearm, 0, nullptr, 0);
+    auto started=std::chrono::steady_clock::now();
     SessionConfiguration config;
-    config.type=SessionType::SingleBit;
-    config.sampleCount=static_cast<uint32_t>(samples);
-    writeCommand<SessionConfiguration>(Command::ConfigureSession, 0, config);
+    if (!readStartResult(config, sink)) return 0;
+    return receive(*lastSettings, config, sink, requested, started);
+}
 
-    auto deviceStatus=readCommand<Status>(Command::GetStatus, 0);
-    if (deviceStatus!=Status::Opened)
+bool Device::readStartResult(SessionConfiguration& config, SigFeather::ISampleSink& sink) const
+{
+    // the result is a packet of its own, the sample data follows in later ones
+    StartResult result;
+    int transferred=0;
+    int error=libusb_bulk_transfer(handle, endpoint, reinterpret_cast<unsigned char*>(&result), sizeof(result), &transferred, 1000);
+    if (error!=0 || transferred!=int(sizeof(result)) || result.magic!=StartResultMagic ||
+        !readVersioned(config, result.config, sizeof(result.config)))
     {
-        std::cerr << "Device not in opened state before benchmark, status " << (int)deviceStatus << std::endl;
-        return buffer;
+        sink.onError("device did not report the start of the capture");
+        readCommand<Status>(Command::Stop, 0);
+        drainEndpoint();
+        return false;
+    }
+    if (result.status!=Status::Running)
+    {
+        sink.onError("device returned status " + std::to_string(int(result.status)) + " on start");
+        return false;
+    }
+    return true;
+}
+
+bool Device::checkSession(const SigFeather::CaptureSettings& settings, const SessionConfiguration& requested, const SessionConfiguration& config,
+    SigFeather::ISampleSink& sink) const
+{
+    bool unbounded=(config.flags & SessionFlagUnbounded)!=0;
+    if ((requested.flags & SessionFlagDeep)!=0 && (config.flags & SessionFlagDeep)==0)
+    {
+        std::cerr << "Device cannot sample into PSRAM, using its sample buffer." << std::endl;
+    }
+    if (settings.unbounded && !unbounded)
+    {
+        sink.onError("device does not support unbounded sampling");
+        return false;
+    }
+    if (requested.triggerType!=TriggerType::None && config.triggerType==TriggerType::None)
+    {
+        sink.onError("device does not support triggered sampling");
+        return false;
+    }
+    if (config.type!=requested.type)
+    {
+        sink.onError("device does not support change-only sampling");
+        return false;
     }
-    config=readCommand<SessionConfiguration>(Command::GetSessionConfiguration, 0);
-    if (config.sampleCount<samples)
+    if (requested.segmentCount>1 && config.segmentCount!=requested.segmentCount)
+    {
+        sink.onError("device does not support segmented sampling");
+        return false;
+    }
+    if (!unbounded && config.sampleCount<settings.samples)
     {
         std::cerr << "Device limited sampling to " << config.sampleCount << " samples." << std::endl;
     }
+    return true;
+}
 
-    deviceStatus=readCommand<Status>(Command::Start, 0);
-    if (deviceStatus!=Status::Running)
+size_t Device::receive(const SigFeather::CaptureSettings& settings, const SessionConfiguration& config, SigFeather::ISampleSink& sink,
+    std::chrono::steady_clock::time_point requested, std::chrono::steady_clock::time_point started) const
+{
+    bool unbounded=(config.flags & SessionFlagUnbounded)!=0;
+    bool compressed=(config.flags & SessionFlagCompressed)!=0;
+    bool deep=(config.flags & SessionFlagDeep)!=0;
+    bool framed=(config.flags & SessionFlagFramed)!=0;
+    bool triggered=config.triggerType!=TriggerType::None;
+    bool segmented=config.segmentCount>1;
+    bool changes=config.type==SessionType::Changes;
+
+    SigFeather::CaptureInfo info;
+    // the device starts sampling somewhere within the round trip of the start request
+    info.startTime=std::chrono::duration<double>(requested.time_since_epoch()+(started-requested)/2).count();
+    info.startUncertainty=std::chrono::duration<double>(started-requested).count()/2;
+    info.samples=segmented ? config.sampleCount*config.segmentCount : config.sampleCount;
+    info.bytes=config.bytesLeft;
+    info.segments=segmented ? config.segmentCount : 0;
+    info.segmentInterval=segmented ? config.segmentInterval : 0;
+    info.unbounded=unbounded;
+    info.compressed=compressed;
+    info.deep=deep;
+    info.framed=framed;
+    info.basePin=config.basePin;
+    info.channels=config.channelCount;
+    info.systemClock=config.systemClock;
+    info.triggered=triggered;
+    info.triggerSample=triggered ? config.preTriggerSamples : 0;
+    uint32_t divider=uint32_t(config.clockDividerInt)*256+config.clockDividerFrac;
+    if (divider>0 && config.systemClock>0)
     {
-        std::cerr << "Device returned status " << (int)deviceStatus << std::endl;
-        return buffer;
+        info.clockDivider=double(divider)/256.0;
+        info.sampleRate=double(config.systemClock)/info.clockDivider;
+        // a fractional divider spaces samples by whole clk_sys periods, alternating
+        // between floor and ceil of the divider, so samples drift up to one period
+        info.jitter=config.clockDividerFrac!=0 ? 1.0/double(config.systemClock) : 0.0;
     }
+    else
+    {
+        info.sampleRate=config.sampleRate;
+    }
+    if (changes)
+    {
+        // the device timed the changes, the host picks the rate of the samples
+        size_t samplesPerWord=32/config.channelCount;
+        info.changesOnly=true;
+        info.changeClock=info.sampleRate;
+        info.unbounded=settings.unbounded;
+        info.samples=settings.unbounded ? 0 : settings.samples;
+        info.bytes=settings.unbounded ? 0 : (info.samples+samplesPerWord-1)/samplesPerWord*4;
+        info.sampleRate=settings.sampleRate;
+        info.clockDivider=double(config.systemClock)/info.sampleRate;
+        // a change is seen at the next read of the pins, which a record may delay
+        info.jitter=ChangeExpiredClocks/info.changeClock;
+    }
+    sink.onStart(info);
 
-    size_t bytesLeft=config.bytesLeft;
-    buffer.resize(bytesLeft);
-    uint8_t* cursor=buffer.data();
+    ChunkAssembler chunks(sink, settings.chunkSize);
+    TransferPipeline pipeline(context, handle, endpoint, queueDepth, transferSize, getTransferPool());
     int result=0;
-    while (bytesLeft>0)
+    bool corrupt=false;
+    try
     {
-        int transferred=0;
-        result=libusb_bulk_transfer(handle, endpoint, cursor, bytesLeft, &transferred, 1000);
-        if (result==LIBUSB_ERROR_TIMEOUT)
+        size_t bytes=unbounded ? std::numeric_limits<size_t>::max() : config.bytesLeft;
+        if (compressed)
+        {
+            // the compressed size is unknown, so receive until the decoder has all sample bytes
+            RleDecoder decoder(bytes);
+            auto output=[&chunks](const uint8_t* data, size_t count)
+            {
+                return chunks.push(data, count);
+            };
+            result=pipeline.run(std::numeric_limits<size_t>::max(), [&decoder, &output](const SigFeather::BufferView& buffer)
+                {
+                    return decoder.push(buffer.data(), buffer.size(), output);
+                },
+                settings.timeout
+            );
+            if (decoder.hasError()) corrupt=true;
+        }
+        else if (changes)
+        {
+            ChangeExpander expander(config.channelCount, info.changeClock/info.sampleRate,
+                info.unbounded ? std::numeric_limits<uint64_t>::max() : info.samples);
+            auto onChange=[&sink](uint64_t clock, uint32_t pins)
+            {
+                sink.onChange(clock, pins);
+                return true;
+            };
+            auto output=[&chunks](const uint8_t* data, size_t count)
+            {
+                return chunks.push(data, count);
+            };
+            auto expand=[&expander, &onChange, &output](const SigFeather::BufferView& buffer)
+            {
+                return expander.push(buffer.data(), buffer.size(), onChange, output);
+            };
+            // lost records become a gap up to the device's estimate of the next one
+            FrameDecoder decoder(expand, [&expander, &output, &chunks](uint64_t, uint64_t, uint64_t timestamp)
+                {
+                    return expander.gap(timestamp, output, [&chunks](uint64_t offset, uint64_t bytes)
+                        {
+                            return chunks.gap(offset, bytes);
+                        }
+                    );
+                }
+            );
+            // a quiet signal still sends a record every ChangeTimerStart loops, wait at least twice that.
+            // a device that can no longer time the changes ends the session, so never wait forever.
+            double quiet=(ChangeExpiredClocks+double(ChangeLoopClocks)*ChangeTimerStart)/info.changeClock;
+            unsigned int timeout=std::max(settings.timeout, unsigned(std::ceil(quiet*2000)));
+            result=pipeline.run(std::numeric_limits<size_t>::max(), [framed, &decoder, &expand](const SigFeather::BufferView& buffer)
+                {
+                    return framed ? decoder.push(buffer) : expand(buffer);
+                },
+                timeout
+            );
+            if (expander.hasError() || decoder.hasError()) corrupt=true;
+        }
+        else if (framed)
+        {
+            // the record stream ends with an End record, or when the sink stops an unbounded capture
+            FrameDecoder decoder([&chunks](const SigFeather::BufferView& buffer)
+                {
+                    return chunks.push(buffer);
+                },
+                [&chunks](uint64_t offset, uint64_t bytes, uint64_t)
+                {
+                    return chunks.gap(offset, bytes);
+                },
+                [&chunks](uint32_t index, uint64_t offset, uint64_t timestamp)
+                {
+                    return chunks.segment(index, offset, timestamp);
+                }
+            );
+            result=pipeline.run(std::numeric_limits<size_t>::max(), [&decoder](const SigFeather::BufferView& buffer)
+                {
+                    return decoder.push(buffer);
+                },
+                settings.timeout
+            );
+            if (decoder.hasError()) corrupt=true;
+        }
+        else
         {
-            if (transferred>0) result=0; // if we made progress, ignore the timeout error and try again
+            result=pipeline.run(bytes, [&chunks](const SigFeather::BufferView& buffer)
+                {
+                    return chunks.push(buffer);
+                },
+                settings.timeout
+            );
         }
-        if (transferred>bytesLeft) throw std::runtime_error("too many bytes returned!");
-        if (result!=0) break;
-        if (transferred==0) break;  // not sure what happened, but we didn't get an data so we stop instead of risking infinite loop
-        cursor+=transferred;
-        bytesLeft-=transferred;
+        if (result==0 && !corrupt) chunks.flush();
     }
-
-    if (result!=0)
+    catch (...)
     {
-        std::cerr << "Transfer ended abnormally with status " << libusb_error_name(result) << std::endl;
+        transferStatistics=pipeline.getStatistics();
+        readCommand<Status>(Command::Stop, 0);
+        drainEndpoint();
+        throw;
     }
+    transferStatistics=pipeline.getStatistics();
 
-    if (cursor - buffer.data() != buffer.size())
-        buffer.resize(cursor - buffer.data());
- 
-    deviceStatus=readCommand<Status>(Command::Stop, 0);
-    if (deviceStatus!=Status::Opened)
+    auto deviceStatus=readCommand<Status>(Command::Stop, 0);
+    // an unbounded or interrupted capture is stopped while data is still queued on the device
+    if (unbounded || chunks.getTotal()<info.bytes) drainEndpoint();
+    if (corrupt)
     {
-        std::cerr << "Device returned status " << (int)deviceStatus << std::endl;
+        sink.onError(changes ? "change record stream is corrupt" : framed ? "framed sample stream is corrupt" : "compressed sample stream is corrupt");
+    }
+    else if (deviceStatus==Status::Error)
+    {
+        // the device ended the session, e.g. a change loop that stalled, which the transfers only see as a timeout
+        sink.onError("device ended the capture with an error");
+    }
+    else if (result!=0)
+    {
+        sink.onError(std::string("transfer ended abnormally with status ") + libusb_error_name(result));
+    }
+    else if (deviceStatus!=Status::Opened)
+    {
+        sink.onError("device returned status " + std::to_string(int(deviceStatus)) + " on stop");
+    }
+    else
+    {
+        sink.onEnd(chunks.getTotal());
     }
+    return chunks.getTotal();
+}
+
+void Device::drainEndpoint() const
+{
+    uint8_t scratch[4096];
+    int transferred=0;
+    do
+    {
+        transferred=0;
+        libusb_bulk_transfer(handle, endpoint, scratch, sizeof(scratch), &transferred, 50);
+    } while (transferred>0);
+}
+
+std::vector<uint8_t> Device::sample(size_t samples) const
+{
+    // the caller gets one contiguous vector, but transfers land in separate pool buffers, so
+    // every byte is copied once. copying while receiving costs the same as keeping the views
+    // with onBuffer() and joining them afterwards, and returns each pool buffer right away.
+    class VectorSink : public SigFeather::ISampleSink
+    {
+    public:
+        std::vector<uint8_t> buffer;
+
+        void onStart(const SigFeather::CaptureInfo& info) override { buffer.reserve(info.bytes); }
+        bool onData(const uint8_t* data, size_t bytes) override
+        {
+            buffer.insert(buffer.end(), data, data+bytes);
+            return true;
+        }
+        void onError(const std::string& message) override
+        {
+            std::cerr << "Sampling failed: " << message << std::endl;
+        }
+    };
 
-    return buffer;  
+    VectorSink sink;
+    SigFeather::CaptureSettings settings;
+    settings.samples=samples;
+    stream(settings, sink);
+    return std::move(sink.buffer);
 }
@@ -4,37 +4,99 @@
 #pragma once
 
 #include <libusb.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include "sigfeather.h"
+#include "bufferpool.h"
 #include "protocol.h"
 
 class Device : public SigFeather::IDevice
 {
 public:
-    Device(libusb_device* device, const libusb_device_descriptor& desc);
+    static constexpr size_t DefaultQueueDepth = 8;
+    static constexpr size_t DefaultTransferSize = 16*1024;
+
+public:
+    //! takes a reference to 'device'. the device is not touched until it is
+    //! used, its handle is opened on first use and its strings are cached.
+    Device(libusb_context* context, libusb_device* device, const libusb_device_descriptor& desc);
     ~Device();
 
+    inline libusb_device* getUsbDevice() const { return device; }
+    //! called by the registry when the device was unplugged
+    inline void setDisconnected() { connected=false; }
+
     virtual std::string getManufacturer() const override;
     virtual std::string getProduct() const override;
     virtual std::string getSerialNumber() const override;
     virtual std::string getAddress() const override;
+    virtual bool isConnected() const override { return connected; }
 
     virtual void open() override;
     virtual void close() override;
     virtual bool isOpen() const override { return opened; }
+    virtual SigFeather::DeviceCapabilities getCapabilities() const override;
+
+    virtual void setTransferQueue(size_t depth, size_t transferSize, bool hugePages=false) override;
+    virtual size_t getTransferQueueDepth() const override { return queueDepth; }
+    virtual size_t getTransferSize() const override { return transferSize; }
+    virtual SigFeather::TransferStatistics getTransferStatistics() const override { return transferStatistics; }
+    virtual SigFeather::DeviceStatistics getDeviceStatistics() const override;
 
     virtual size_t benchmark(size_t bytes) const override;
+    virtual size_t stream(const SigFeather::CaptureSettings& settings, SigFeather::ISampleSink& sink) const override;
+    virtual size_t stream(const SigFeather::CaptureSettings& settings, SigFeather::ISampleSink& sink, const std::function<bool()>& ready) const override;
+    virtual size_t rearm(SigFeather::ISampleSink& sink) const override;
     virtual std::vector<uint8_t> sample(size_t samples) const override;
 
 private:
+    libusb_context* context = nullptr;
     libusb_device* device = nullptr;
-    libusb_device_handle* handle = nullptr;
+    mutable libusb_device_handle* handle = nullptr;
+    mutable std::shared_ptr<libusb_device_handle> handleOwner;     // shared with the transfer pool
     libusb_device_descriptor descriptor{};
+    std::atomic<bool> connected = true;
+
+    // string descriptors, read once
+    mutable std::mutex descriptorMutex;
+    mutable bool stringsRead = false;
+    mutable std::string manufacturer;
+    mutable std::string product;
+    mutable std::string serialNumber;
 
     bool opened = false;
+    SigFeather::DeviceCapabilities capabilities;
     uint8_t interfaceId=0;
     uint8_t endpoint=0;
 
+    size_t queueDepth=DefaultQueueDepth;
+    size_t transferSize=DefaultTransferSize;
+    bool hugePages=false;
+    mutable std::unique_ptr<BufferPool> transferPool;              // kept across captures
+    mutable SigFeather::TransferStatistics transferStatistics;
+    mutable std::optional<SigFeather::CaptureSettings> lastSettings;   // of the last stream(), for rearm()
+
+    //! discard whatever the device still had queued when a session was stopped
+    void drainEndpoint() const;
+    //! reads the StartResult of a quick start from the data endpoint, reports failures to 'sink'
+    bool readStartResult(SessionConfiguration& config, SigFeather::ISampleSink& sink) const;
+    //! compares what the device configured with the request, reports what it refused to 'sink'
+    bool checkSession(const SigFeather::CaptureSettings& settings, const SessionConfiguration& requested, const SessionConfiguration& config,
+        SigFeather::ISampleSink& sink) const;
+    //! receives the data of a started session and hands it to 'sink'
+    size_t receive(const SigFeather::CaptureSettings& settings, const SessionConfiguration& config, SigFeather::ISampleSink& sink,
+        std::chrono::steady_clock::time_point requested, std::chrono::steady_clock::time_point started) const;
+    //! opens the libusb handle unless it is open, throws std::runtime_error on failure
+    void openHandle() const;
+    //! reads the string descriptors unless they were read before
+    void readStrings() const;
+    //! pool of transfer buffers, replaced when the transfer size changes
+    BufferPool& getTransferPool() const;
+
     inline uint16_t readControlResult(Command command, uint16_t param, void* buffer, uint16_t maxBytes, unsigned int timeout=1000) const
     {
         int result=libusb_control_transfer(
@@ -73,6 +135,17 @@ private:
         return retval;
     }
 
+    //! reads a versioned structure, see protocol.h
+    template<typename ResultType>
+    ResultType readVersionedCommand(Command command, uint16_t param, unsigned int timeout=1000) const
+    {
+        ResultType retval;
+        uint8_t buffer[64];
+        auto bytes=readControlResult(command, param, buffer, sizeof(buffer), timeout);
+        if (!readVersioned(retval, buffer, bytes)) throw std::runtime_error("Unexpected command result format");
+        return retval;
+    }
+
     template<typename BufferType>
     void writeCommand(Command command, uint16_t param, const BufferType& buffer, unsigned int timeout=1000) const
     {
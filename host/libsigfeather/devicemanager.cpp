@@ -3,18 +3,204 @@
 //! please see LICENSE file in root folder for licensing terms.
 
 #include "devicemanager.h"
+#include <algorithm>
 #include <stdexcept>
 
 SigFeather::DeviceManager::DeviceManager()
 {
     if (libusb_init(&usbContext) < 0)
         throw std::runtime_error("Failed to initialize libusb");
+
+    if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG))
+    {
+        // enumerating reports the devices already connected before this returns
+        int result=libusb_hotplug_register_callback(usbContext,
+            static_cast<libusb_hotplug_event>(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+            LIBUSB_HOTPLUG_ENUMERATE, VID_SIGFEATHER, PID_SIGFEATHER, LIBUSB_HOTPLUG_MATCH_ANY,
+            &DeviceManager::hotplugCallback, this, &hotplugHandle);
+        hotplug=(result==LIBUSB_SUCCESS);
+    }
+    if (hotplug)
+    {
+        applyEvents();
+        eventThread=std::thread(&DeviceManager::handleEvents, this);
+    }
 }
 
 SigFeather::DeviceManager::~DeviceManager()
 {
+    if (hotplug)
+    {
+        libusb_hotplug_deregister_callback(usbContext, hotplugHandle);
+        stopEvents=true;
+        libusb_interrupt_event_handler(usbContext);
+        if (eventThread.joinable()) eventThread.join();
+        for (const auto& event : events) libusb_unref_device(event.device);
+        events.clear();
+    }
+    devices.clear();
+
     if (usbContext)
         libusb_exit(usbContext);
     usbContext = nullptr;   
 }
 
+std::vector<std::shared_ptr<Device>> SigFeather::DeviceManager::getDevices()
+{
+    if (!hotplug) refresh();
+    std::scoped_lock lock(mutex);
+    return devices;
+}
+
+int SigFeather::DeviceManager::addListener(DeviceEventCallback callback, void* user_data)
+{
+    std::scoped_lock dispatchLock(dispatchMutex);
+    int id=0;
+    {
+        std::scoped_lock lock(listenerMutex);
+        id=nextListener++;
+        listeners[id]=Listener{callback, user_data};
+    }
+    std::vector<std::shared_ptr<Device>> connected;
+    {
+        std::scoped_lock registryLock(mutex);
+        connected=devices;
+    }
+    for (const auto& device : connected)
+    {
+        callback(device, true, user_data);
+    }
+    return id;
+}
+
+void SigFeather::DeviceManager::removeListener(int id)
+{
+    // waits for a notification running on another thread
+    std::scoped_lock lock(dispatchMutex, listenerMutex);
+    listeners.erase(id);
+}
+
+void SigFeather::DeviceManager::refresh()
+{
+    libusb_device** list = nullptr;
+    ssize_t count = libusb_get_device_list(usbContext, &list);
+    if (count<0) return;
+
+    std::vector<libusb_device*> present;
+    for (ssize_t i = 0; i < count; ++i)
+    {
+        libusb_device_descriptor desc;
+        if (libusb_get_device_descriptor(list[i], &desc) == 0 &&
+            desc.idVendor == VID_SIGFEATHER && desc.idProduct == PID_SIGFEATHER)
+        {
+            present.push_back(list[i]);
+            deviceArrived(list[i]);
+        }
+    }
+
+    std::vector<libusb_device*> gone;
+    {
+        std::scoped_lock lock(mutex);
+        for (const auto& device : devices)
+        {
+            if (std::find(present.begin(), present.end(), device->getUsbDevice())==present.end()) gone.push_back(device->getUsbDevice());
+        }
+    }
+    for (auto* device : gone)
+    {
+        deviceLeft(device);
+    }
+
+    libusb_free_device_list(list, 1);
+}
+
+void SigFeather::DeviceManager::deviceArrived(libusb_device* usbDevice)
+{
+    libusb_device_descriptor desc;
+    if (libusb_get_device_descriptor(usbDevice, &desc) != 0) return;
+
+    std::scoped_lock dispatchLock(dispatchMutex);
+    std::shared_ptr<Device> device;
+    {
+        std::scoped_lock lock(mutex);
+        for (const auto& known : devices)
+        {
+            if (known->getUsbDevice()==usbDevice) return;
+        }
+        // Device keeps its own reference to the libusb device
+        device=std::make_shared<Device>(usbContext, usbDevice, desc);
+        devices.push_back(device);
+    }
+    notify(device, true);
+}
+
+void SigFeather::DeviceManager::deviceLeft(libusb_device* usbDevice)
+{
+    std::scoped_lock dispatchLock(dispatchMutex);
+    std::shared_ptr<Device> device;
+    {
+        std::scoped_lock lock(mutex);
+        auto it=std::find_if(devices.begin(), devices.end(), [usbDevice](const auto& known) { return known->getUsbDevice()==usbDevice; });
+        if (it==devices.end()) return;
+        device=*it;
+        devices.erase(it);
+    }
+    device->setDisconnected();
+    notify(device, false);
+}
+
+void SigFeather::DeviceManager::notify(const std::shared_ptr<Device>& device, bool arrived)
+{
+    std::vector<int> ids;
+    {
+        std::scoped_lock lock(listenerMutex);
+        for (const auto& [id, listener] : listeners) ids.push_back(id);
+    }
+    for (int id : ids)
+    {
+        // a listener may have removed another one
+        Listener listener;
+        {
+            std::scoped_lock lock(listenerMutex);
+            auto it=listeners.find(id);
+            if (it==listeners.end()) continue;
+            listener=it->second;
+        }
+        listener.callback(device, arrived, listener.userData);
+    }
+}
+
+void SigFeather::DeviceManager::handleEvents()
+{
+    while (!stopEvents)
+    {
+        timeval timeout{0, 100000};
+        libusb_handle_events_timeout_completed(usbContext, &timeout, nullptr);
+        applyEvents();
+    }
+}
+
+void SigFeather::DeviceManager::applyEvents()
+{
+    std::deque<Event> pending;
+    {
+        std::scoped_lock lock(eventMutex);
+        pending.swap(events);
+    }
+    for (const auto& event : pending)
+    {
+        if (event.arrived) deviceArrived(event.device);
+        else deviceLeft(event.device);
+        libusb_unref_device(event.device);
+    }
+}
+
+int LIBUSB_CALL SigFeather::DeviceManager::hotplugCallback(libusb_context* context, libusb_device* device, libusb_hotplug_event event, void* user_data)
+{
+    auto* self=static_cast<DeviceManager*>(user_data);
+    // libusb must not be used from here, so the event is applied once libusb_handle_events returned
+    if (event!=LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED && event!=LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) return 0;
+    std::scoped_lock lock(self->eventMutex);
+    self->events.push_back(Event{libusb_ref_device(device), event==LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED});
+    return 0; // stay registered
+}
@@ -6,8 +6,22 @@
 #include <libusb.h>
 #include "sigfeather.h"
 #include "device.h"
+#include <atomic>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
+//! Registry of the connected SigFeathers. With hotplug support, libusb reports
+//! arriving and leaving devices to a callback and an event thread keeps the
+//! registry current, so lookups never touch the bus. The callback only queues
+//! the events, the event thread applies them and notifies listeners after
+//! libusb returned, so listeners may use the bus and the manager. Without
+//! hotplug, lookups list the bus again but still reuse the Device of a known
+//! board. Devices open their handle and read their descriptors lazily and
+//! cache them, so a lookup does not disturb boards that are busy capturing.
 class SigFeather::DeviceManager
 {
 public:
@@ -18,29 +32,53 @@ public:
     DeviceManager();
     ~DeviceManager();
 
-    template<typename Callback>
-    void findUsbDevices(Callback callback)
-    {
-        libusb_device** list = nullptr;
-        ssize_t count = libusb_get_device_list(usbContext, &list);
-        
-        for (ssize_t i = 0; i < count; ++i)
-        {
-            libusb_device* device = list[i];
-            libusb_device_descriptor desc;
-            if (libusb_get_device_descriptor(device, &desc) == 0)
-            {
-                if (desc.idVendor == VID_SIGFEATHER && desc.idProduct == PID_SIGFEATHER)
-                {
-                    if (callback(std::make_shared<Device>(device, desc))) break;
-                }
-            }
-        }
-
-        libusb_free_device_list(list, 1);
-        return;
-    }
+    // not copyable
+    DeviceManager(const DeviceManager&) = delete;
+    DeviceManager& operator=(const DeviceManager&) = delete;
+
+    //! connected devices in order of arrival
+    std::vector<std::shared_ptr<Device>> getDevices();
+
+    //! reports the connected devices as arrived, returns an id for removeListener()
+    int addListener(DeviceEventCallback callback, void* user_data);
+    //! once this returns the listener is not called again, it may be called from a listener
+    void removeListener(int id);
 
 private:
+    struct Listener
+    {
+        DeviceEventCallback callback=nullptr;
+        void* userData=nullptr;
+    };
+
+    struct Event
+    {
+        libusb_device* device=nullptr;  // referenced until the event is applied
+        bool arrived=false;
+    };
+
     libusb_context* usbContext = nullptr;
+    libusb_hotplug_callback_handle hotplugHandle = 0;
+    bool hotplug=false;
+    std::thread eventThread;
+    std::atomic<bool> stopEvents=false;
+    std::mutex eventMutex;
+    std::deque<Event> events;       // filled by hotplugCallback, drained by applyEvents
+
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Device>> devices;
+    std::recursive_mutex dispatchMutex; // held across a change and its notification, so listeners see each change once
+    std::mutex listenerMutex;       // guards listeners, never held while a listener runs
+    std::map<int, Listener> listeners;
+    int nextListener=1;
+
+    void refresh();
+    void deviceArrived(libusb_device* device);
+    void deviceLeft(libusb_device* device);
+    //! dispatchMutex must be held
+    void notify(const std::shared_ptr<Device>& device, bool arrived);
+    void handleEvents();
+    void applyEvents();
+
+    static int LIBUSB_CALL hotplugCallback(libusb_context* context, libusb_device* device, libusb_hotplug_event event, void* user_data);
 };
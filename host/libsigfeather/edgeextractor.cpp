@@ -0,0 +1,152 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "edgeextractor.h"
+#include <algorithm>
+#include <bit>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define SIGFEATHER_X86 1
+#include <immintrin.h>
+#if defined(__GNUC__)
+#define SIGFEATHER_AVX2 1
+#define TARGET_AVX2 __attribute__((target("avx2,popcnt,bmi")))
+#endif
+#endif
+
+namespace
+{
+    using Transition=EdgeExtractor::Transition;
+
+    //! appends one transition for every bit set in 'edges', 'plane' holds the new levels
+    inline void emit(uint64_t edges, uint64_t plane, uint64_t base, std::vector<Transition>& out)
+    {
+        size_t index=out.size();
+        out.resize(index+std::popcount(edges));
+        while (edges!=0)
+        {
+            int bit=std::countr_zero(edges);
+            out[index++]=Transition{base+bit, (plane>>bit) & 1};
+            edges&=edges-1;
+        }
+    }
+
+    //! scans plane words [first, words), words[-1] must be valid.
+    //! 'samples' masks off unused bits in the last word.
+    void scanScalar(const uint64_t* plane, size_t first, size_t words, size_t samples, uint64_t base, std::vector<Transition>& out)
+    {
+        for (size_t i=first; i<words; ++i)
+        {
+            uint64_t value=plane[i];
+            uint64_t edges=value ^ ((value<<1) | (plane[i-1]>>63));
+            size_t valid=samples-i*64;
+            if (valid<64) edges&=(uint64_t(1)<<valid)-1;
+            if (edges!=0) emit(edges, value, base+i*64, out);
+        }
+    }
+
+#if SIGFEATHER_X86
+    size_t scanSSE2(const uint64_t* plane, size_t words, uint64_t base, std::vector<Transition>& out)
+    {
+        size_t i=0;
+        for (; i+2<=words; i+=2)
+        {
+            __m128i value=_mm_loadu_si128(reinterpret_cast<const __m128i*>(plane+i));
+            __m128i previous=_mm_loadu_si128(reinterpret_cast<const __m128i*>(plane+i-1));
+            __m128i edges=_mm_xor_si128(value, _mm_or_si128(_mm_slli_epi64(value, 1), _mm_srli_epi64(previous, 63)));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(edges, _mm_setzero_si128()))==0xffff) continue;
+
+            alignas(16) uint64_t lanes[2];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), edges);
+            for (int lane=0; lane<2; ++lane)
+            {
+                if (lanes[lane]!=0) emit(lanes[lane], plane[i+lane], base+(i+lane)*64, out);
+            }
+        }
+        return i;
+    }
+#endif
+
+#if SIGFEATHER_AVX2
+    TARGET_AVX2 size_t scanAVX2(const uint64_t* plane, size_t words, uint64_t base, std::vector<Transition>& out)
+    {
+        size_t i=0;
+        for (; i+4<=words; i+=4)
+        {
+            __m256i value=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(plane+i));
+            __m256i previous=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(plane+i-1));
+            __m256i edges=_mm256_xor_si256(value, _mm256_or_si256(_mm256_slli_epi64(value, 1), _mm256_srli_epi64(previous, 63)));
+            if (_mm256_testz_si256(edges, edges)) continue;
+
+            alignas(32) uint64_t lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), edges);
+            for (int lane=0; lane<4; ++lane)
+            {
+                if (lanes[lane]!=0) emit(lanes[lane], plane[i+lane], base+(i+lane)*64, out);
+            }
+        }
+        return i;
+    }
+#endif
+}
+
+EdgeExtractor::EdgeExtractor(unsigned channels, SampleUnpacker::Kernel kernel) :
+    unpacker(channels, kernel),
+    planes(channels, std::vector<uint64_t>(SampleUnpacker::getPlaneWords(BlockSamples)+1)),
+    planePointers(channels),
+    transitions(channels)
+{
+    for (unsigned c=0; c<channels; ++c)
+    {
+        planePointers[c]=planes[c].data()+1;
+    }
+}
+
+void EdgeExtractor::clear()
+{
+    for (auto& list : transitions)
+    {
+        list.clear();
+    }
+}
+
+void EdgeExtractor::reset()
+{
+    clear();
+    position=0;
+}
+
+void EdgeExtractor::push(const uint8_t* packed, size_t samples)
+{
+    unsigned channels=getChannels();
+    for (size_t start=0; start<samples; start+=BlockSamples)
+    {
+        size_t count=std::min(BlockSamples, samples-start);
+        size_t words=SampleUnpacker::getPlaneWords(count);
+        unpacker.demultiplex(packed+start/unpacker.getSamplesPerWord()*4, count, planePointers.data());
+
+        for (unsigned c=0; c<channels; ++c)
+        {
+            uint64_t* plane=planePointers[c];
+            // pretend the level before sample 0 differs from it, so it is reported
+            if (position==0) plane[-1]=(plane[0] & 1) ? 0 : uint64_t(1)<<63;
+
+            // all but the last word are complete, the last one is masked by the scalar scan
+            size_t scanned=0;
+            size_t fullWords=words-1;
+#if SIGFEATHER_AVX2
+            if (unpacker.getKernel()==SampleUnpacker::Kernel::AVX2) scanned=scanAVX2(plane, fullWords, position, transitions[c]);
+#endif
+#if SIGFEATHER_X86
+            if (unpacker.getKernel()==SampleUnpacker::Kernel::SSE2) scanned=scanSSE2(plane, fullWords, position, transitions[c]);
+#endif
+            scanScalar(plane, scanned, words, count, position, transitions[c]);
+
+            // carry the last level into the next block
+            size_t last=count-1;
+            plane[-1]=((plane[last/64]>>(last%64)) & 1) ? uint64_t(1)<<63 : 0;
+        }
+        position+=count;
+    }
+}
@@ -0,0 +1,56 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "unpacker.h"
+
+//! Turns packed capture data into a list of level transitions per channel.
+//! Data is fed in chunks as it arrives, sample indices count from the first
+//! sample of the first chunk and levels carry over between chunks, so a
+//! transition right at a chunk boundary is found like any other. Every
+//! channel starts with a transition at sample 0 that reports its initial level.
+//!
+//! The samples are demultiplexed into bit planes first, transitions are then
+//! found 64 samples at a time as plane^(plane<<1), skipping quiet stretches
+//! with vector compares, so the cost is dominated by the number of edges.
+class EdgeExtractor
+{
+public:
+    struct Transition
+    {
+        uint64_t sample : 63;       //!< index of the first sample at the new level
+        uint64_t level : 1;         //!< the new level
+    };
+
+    explicit EdgeExtractor(unsigned channels, SampleUnpacker::Kernel kernel=SampleUnpacker::getBestKernel());
+
+    //! processes the next 'samples' samples. 'packed' starts on a sample word,
+    //! every chunk but the last must end on one, too.
+    void push(const uint8_t* packed, size_t samples);
+
+    //! transitions found since construction or the last clear(), in sample order
+    inline const std::vector<Transition>& getTransitions(unsigned channel) const { return transitions[channel]; }
+    //! drops the collected transitions, but keeps the levels and sample count,
+    //! so a consumer can drain transitions after every push()
+    void clear();
+    //! starts over at sample 0
+    void reset();
+
+    inline unsigned getChannels() const { return unpacker.getChannels(); }
+    inline uint64_t getSampleCount() const { return position; }
+    //! level of the last sample pushed
+    inline bool getLevel(unsigned channel) const { return (planes[channel][0]>>63)!=0; }
+
+private:
+    static constexpr size_t BlockSamples=64*1024;   // planes per channel stay at 8KB
+
+    SampleUnpacker unpacker;
+    uint64_t position=0;
+    std::vector<std::vector<uint64_t>> planes;      // a leading word carries the previous level in bit 63
+    std::vector<uint64_t*> planePointers;
+    std::vector<std::vector<Transition>> transitions;
+};
@@ -0,0 +1,164 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "framedecoder.h"
+#include "protocol.h"
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(FrameHeader)==64, "header buffer size mismatch");
+
+FrameDecoder::FrameDecoder(DataOutput data, GapOutput gap, SegmentOutput segment) :
+    dataOutput(std::move(data)),
+    gapOutput(std::move(gap)),
+    segmentOutput(std::move(segment))
+{
+}
+
+bool FrameDecoder::push(const SigFeather::BufferView& buffer)
+{
+    if (error || complete) return false;
+
+    size_t position=0;
+    while (position<buffer.size())
+    {
+        if (payloadLeft>0)
+        {
+            size_t count=std::min<size_t>(payloadLeft, buffer.size()-position);
+            pending.push_back(Item{payloadOffset, count, buffer.subview(position, count)});
+            payloadOffset+=count;
+            payloadLeft-=uint32_t(count);
+            position+=count;
+            continue;
+        }
+
+        size_t count=std::min(sizeof(header)-headerBytes, buffer.size()-position);
+        std::memcpy(header+headerBytes, buffer.data()+position, count);
+        headerBytes+=count;
+        position+=count;
+        if (headerBytes<sizeof(header)) break;
+        headerBytes=0;
+        if (!handleHeader()) return false;
+    }
+    return true;
+}
+
+bool FrameDecoder::handleHeader()
+{
+    // the host is little-endian like the device, see protocol.h
+    FrameHeader record;
+    std::memcpy(&record, header, sizeof(record));
+    if (record.magic!=FrameMagic || record.sequence!=sequence)
+    {
+        error=true;
+        return false;
+    }
+    ++sequence;
+    if (record.type!=FrameType::Segment)
+    {
+        record.offset=toStream(record.offset);
+        record.verified=toStream(record.verified);
+    }
+
+    switch (record.type)
+    {
+    case FrameType::Data:
+        if (record.offset!=streamEnd)
+        {
+            error=true;
+            return false;
+        }
+        streamEnd+=record.bytes;
+        payloadOffset=record.offset;
+        payloadLeft=record.bytes;
+        break;
+    case FrameType::Gap:
+        // a gap either skips data that was never sent, or takes back a record
+        // that was overwritten while it was sent
+        if (record.offset>streamEnd || (record.offset<streamEnd && record.offset+record.bytes>streamEnd))
+        {
+            error=true;
+            return false;
+        }
+        if (record.offset==streamEnd) streamEnd+=record.bytes;
+        addGap(record.offset, record.bytes, record.timestamp);
+        break;
+    case FrameType::End:
+        complete=true;
+        break;
+    case FrameType::Segment:
+        // the previous segment was queued completely before the next one starts
+        if (!segments.empty() && record.offset<segments.back().deviceOffset+streamEnd-segments.back().offset)
+        {
+            error=true;
+            return false;
+        }
+        segments.push_back(Segment{record.offset, streamEnd});
+        pending.push_back(Item{streamEnd, 0, {}, true, record.segment, record.timestamp});
+        record.verified=toStream(record.verified);
+        break;
+    default:
+        error=true;
+        return false;
+    }
+
+    verified=std::max<uint64_t>(verified, record.verified);
+    if (!deliver(complete)) return false;
+    return !complete;
+}
+
+void FrameDecoder::addGap(uint64_t offset, uint64_t bytes, uint64_t timestamp)
+{
+    lost+=bytes;
+    uint64_t end=offset+bytes;
+    std::deque<Item> kept;
+    for (auto& item : pending)
+    {
+        uint64_t itemEnd=item.offset+item.bytes;
+        if (item.data.empty() || itemEnd<=offset || item.offset>=end)
+        {
+            kept.push_back(std::move(item));
+            continue;
+        }
+        // keep what lies outside the gap
+        if (item.offset<offset) kept.push_back(Item{item.offset, offset-item.offset, item.data.subview(0, offset-item.offset)});
+        if (itemEnd>end) kept.push_back(Item{end, itemEnd-end, item.data.subview(end-item.offset, itemEnd-end)});
+    }
+    auto position=std::upper_bound(kept.begin(), kept.end(), offset, [](uint64_t value, const Item& item) { return value<item.offset; });
+    kept.insert(position, Item{offset, bytes, {}, false, 0, timestamp});
+    pending=std::move(kept);
+}
+
+uint64_t FrameDecoder::toStream(uint64_t deviceOffset) const
+{
+    // an offset mostly belongs to the latest segment
+    for (auto segment=segments.rbegin(); segment!=segments.rend(); ++segment)
+    {
+        if (deviceOffset>=segment->deviceOffset) return segment->offset+(deviceOffset-segment->deviceOffset);
+    }
+    return deviceOffset;
+}
+
+bool FrameDecoder::deliver(bool all)
+{
+    while (!pending.empty())
+    {
+        Item& item=pending.front();
+        if (item.segment)
+        {
+            if (segmentOutput && !segmentOutput(item.index, item.offset, item.timestamp)) return false;
+        }
+        else if (item.data.empty())
+        {
+            if (!gapOutput(item.offset, item.bytes, item.timestamp)) return false;
+        }
+        else
+        {
+            if (!all && item.offset+item.bytes>verified) break;
+            if (!dataOutput(item.data)) return false;
+        }
+        pending.pop_front();
+    }
+    return true;
+}
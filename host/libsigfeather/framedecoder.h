@@ -0,0 +1,81 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+#include "sigfeather.h"
+
+//! Takes apart the record stream of a framed session (see protocol.h). Sample
+//! data is passed on as views of the transfer buffers, without copying, but
+//! only once the device confirmed it was not overwritten while it was sent.
+//! Input may be split anywhere, even inside a header.
+//!
+//! The device counts offsets in sampler bytes. The bytes between the segments
+//! of a segmented session are never sent, so the outputs get offsets of a stream
+//! in which the segments follow each other.
+class FrameDecoder
+{
+public:
+    //! receives sample data in stream order, return false to stop decoding
+    using DataOutput=std::function<bool(const SigFeather::BufferView& buffer)>;
+    //! receives lost sample bytes at their stream offset, in order with the data.
+    //! 'timestamp' is only set in change sessions, see FrameHeader.
+    using GapOutput=std::function<bool(uint64_t offset, uint64_t bytes, uint64_t timestamp)>;
+    //! a segment starts at 'offset', 'timestamp' sample clocks after sampling started
+    using SegmentOutput=std::function<bool(uint32_t index, uint64_t offset, uint64_t timestamp)>;
+
+    FrameDecoder(DataOutput data, GapOutput gap, SegmentOutput segment=nullptr);
+
+    //! decodes the next piece of the stream. returns false once the End record
+    //! was seen, an output stopped or the stream is corrupt.
+    bool push(const SigFeather::BufferView& buffer);
+
+    inline bool hasError() const { return error; }
+    inline bool isComplete() const { return complete; }
+    inline uint64_t getLostBytes() const { return lost; }
+
+private:
+    //! a piece of sample data, a gap or the start of a segment, waiting for confirmation
+    struct Item
+    {
+        uint64_t offset;
+        uint64_t bytes;
+        SigFeather::BufferView data;    // empty for a gap or segment
+        bool segment=false;
+        uint32_t index=0;               // segment only
+        uint64_t timestamp=0;           // segment, or gap of a change session
+    };
+
+    //! where a segment starts in the sampler bytes of the device and in the stream
+    struct Segment
+    {
+        uint64_t deviceOffset;
+        uint64_t offset;
+    };
+
+    DataOutput dataOutput;
+    GapOutput gapOutput;
+    SegmentOutput segmentOutput;
+    bool error=false;
+    bool complete=false;
+    uint8_t header[64];
+    size_t headerBytes=0;
+    uint32_t payloadLeft=0;         // bytes of the current data record still to come
+    uint64_t payloadOffset=0;       // stream offset of the next payload byte
+    uint32_t sequence=0;            // expected next record
+    uint64_t streamEnd=0;           // end of the last data or gap record at the front of the stream
+    uint64_t verified=0;
+    uint64_t lost=0;
+    std::deque<Item> pending;
+    std::vector<Segment> segments;
+
+    uint64_t toStream(uint64_t deviceOffset) const;
+    bool handleHeader();
+    void addGap(uint64_t offset, uint64_t bytes, uint64_t timestamp);
+    bool deliver(bool all);
+};
@@ -0,0 +1,64 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <vector>
+#include "sigfeather.h"
+
+//! Passes a capture on to several sinks, e.g. to write it to a file while
+//! decoding it. The capture stops as soon as one of the sinks stops it.
+class MultiSink : public SigFeather::ISampleSink
+{
+public:
+    //! the sinks must outlive the capture
+    void add(SigFeather::ISampleSink& sink) { sinks.push_back(&sink); }
+    inline bool isEmpty() const { return sinks.empty(); }
+
+    void onStart(const SigFeather::CaptureInfo& info) override
+    {
+        for (auto sink : sinks) sink->onStart(info);
+    }
+
+    bool onData(const uint8_t* data, size_t bytes) override
+    {
+        bool more=true;
+        for (auto sink : sinks) more=sink->onData(data, bytes) && more;
+        return more;
+    }
+
+    bool onBuffer(const SigFeather::BufferView& buffer) override
+    {
+        bool more=true;
+        for (auto sink : sinks) more=sink->onBuffer(buffer) && more;
+        return more;
+    }
+
+    void onGap(size_t offset, size_t bytes) override
+    {
+        for (auto sink : sinks) sink->onGap(offset, bytes);
+    }
+
+    void onSegment(size_t index, size_t offset, uint64_t timestamp) override
+    {
+        for (auto sink : sinks) sink->onSegment(index, offset, timestamp);
+    }
+
+    void onChange(uint64_t clock, uint32_t pins) override
+    {
+        for (auto sink : sinks) sink->onChange(clock, pins);
+    }
+
+    void onEnd(size_t totalBytes) override
+    {
+        for (auto sink : sinks) sink->onEnd(totalBytes);
+    }
+
+    void onError(const std::string& message) override
+    {
+        for (auto sink : sinks) sink->onError(message);
+    }
+
+private:
+    std::vector<SigFeather::ISampleSink*> sinks;
+};
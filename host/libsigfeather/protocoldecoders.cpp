@@ -0,0 +1,321 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "protocoldecoders.h"
+#include <bit>
+#include <cstdio>
+#include <stdexcept>
+
+namespace
+{
+    std::string hex(uint32_t value)
+    {
+        char text[16];
+        std::snprintf(text, sizeof(text), "0x%02x", value);
+        return text;
+    }
+
+    inline bool levelOf(uint32_t levels, unsigned channel)
+    {
+        return ((levels>>channel) & 1)!=0;
+    }
+}
+
+UartDecoder::UartDecoder(unsigned channel, uint32_t baudRate, unsigned dataBits, Parity parity) :
+    channel(channel),
+    baudRate(baudRate),
+    dataBits(dataBits),
+    parity(parity)
+{
+    if (channel>=32) throw std::invalid_argument("uart channel out of range");
+    if (baudRate==0) throw std::invalid_argument("uart baud rate must not be zero");
+    if (dataBits<5 || dataBits>9) throw std::invalid_argument("uart data bits must be 5 to 9");
+}
+
+void UartDecoder::begin(double sampleRate)
+{
+    bitSamples=sampleRate/double(baudRate);
+    reset();
+}
+
+void UartDecoder::reset()
+{
+    // the line must be seen idle again before a start bit counts
+    state=State::WaitIdle;
+}
+
+uint64_t UartDecoder::getBitCenter(unsigned index) const
+{
+    return frameStart+uint64_t((double(index)+0.5)*bitSamples);
+}
+
+void UartDecoder::sampleBits(uint64_t sample, FrameList& frames)
+{
+    unsigned parityBit=dataBits+1;
+    unsigned stopBit=parity==Parity::None ? parityBit : parityBit+1;
+    while (state==State::Frame && getBitCenter(bit)<sample)
+    {
+        if (bit==0)
+        {
+            // a start bit that is gone by its center was a glitch
+            if (level)
+            {
+                state=State::Idle;
+                return;
+            }
+        }
+        else if (bit<=dataBits)
+        {
+            value|=uint32_t(level)<<(bit-1);
+        }
+        else if (bit<stopBit)
+        {
+            bool odd=(std::popcount(value)+int(level))%2!=0;
+            if (odd!=(parity==Parity::Odd)) flags|=DecodedFrame::FlagParityError;
+        }
+        else
+        {
+            if (!level) flags|=DecodedFrame::FlagFramingError;
+            DecodedFrame frame;
+            frame.start=frameStart;
+            frame.end=frameStart+uint64_t(double(stopBit+1)*bitSamples);
+            frame.flags=flags;
+            frame.data=value;
+            frames.push_back(frame);
+            // a line held low after a missing stop bit is a break, not a new start bit
+            state=level ? State::Idle : State::WaitIdle;
+            return;
+        }
+        ++bit;
+    }
+}
+
+void UartDecoder::onChange(uint64_t sample, uint32_t levels, uint32_t changed, FrameList& frames)
+{
+    if (!levelOf(changed, channel)) return;
+    sampleBits(sample, frames);
+
+    level=levelOf(levels, channel);
+    if (state==State::WaitIdle && level)
+    {
+        state=State::Idle;
+    }
+    else if (state==State::Idle && !level)
+    {
+        state=State::Frame;
+        frameStart=sample;
+        bit=0;
+        value=0;
+        flags=0;
+    }
+}
+
+void UartDecoder::onAdvance(uint64_t sample, FrameList& frames)
+{
+    sampleBits(sample, frames);
+}
+
+std::string UartDecoder::describe(const DecodedFrame& frame) const
+{
+    std::string text=hex(frame.data);
+    if (frame.data>=0x20 && frame.data<0x7f) text+=std::string(" '")+char(frame.data)+"'";
+    if (frame.flags & DecodedFrame::FlagParityError) text+=" parity error";
+    if (frame.flags & DecodedFrame::FlagFramingError) text+=" framing error";
+    return text;
+}
+
+SpiDecoder::SpiDecoder(unsigned clock, int mosi, int miso, int chipSelect, unsigned mode, unsigned wordBits, bool msbFirst) :
+    clock(clock),
+    mosi(mosi),
+    miso(miso),
+    chipSelect(chipSelect),
+    // data is sampled on the leading clock edge with CPHA=0, the leading edge is rising with CPOL=0
+    sampleOnRising((mode>>1)==(mode&1)),
+    wordBits(wordBits),
+    msbFirst(msbFirst)
+{
+    if (clock>=32 || mosi>=32 || miso>=32 || chipSelect>=32) throw std::invalid_argument("spi channel out of range");
+    if (mode>3) throw std::invalid_argument("spi mode must be 0 to 3");
+    if (wordBits==0 || wordBits>32) throw std::invalid_argument("spi word size must be 1 to 32 bits");
+}
+
+uint32_t SpiDecoder::getChannelMask() const
+{
+    uint32_t mask=1u<<clock;
+    if (mosi!=Unused) mask|=1u<<mosi;
+    if (miso!=Unused) mask|=1u<<miso;
+    if (chipSelect!=Unused) mask|=1u<<chipSelect;
+    return mask;
+}
+
+void SpiDecoder::endWord(uint64_t sample, FrameList& frames)
+{
+    DecodedFrame frame;
+    frame.start=wordStart;
+    frame.end=sample;
+    frame.flags=bits<wordBits ? DecodedFrame::FlagFramingError : 0;
+    frame.data=mosiWord;
+    frame.data2=misoWord;
+    frames.push_back(frame);
+    bits=0;
+    mosiWord=0;
+    misoWord=0;
+}
+
+void SpiDecoder::reset()
+{
+    initialized=false;
+    bits=0;
+    mosiWord=0;
+    misoWord=0;
+}
+
+void SpiDecoder::onChange(uint64_t sample, uint32_t levels, uint32_t changed, FrameList& frames)
+{
+    uint32_t previous=previousLevels;
+    previousLevels=levels;
+    if (!initialized)
+    {
+        initialized=true;
+        return;
+    }
+
+    if (chipSelect!=Unused && levelOf(changed, chipSelect))
+    {
+        // a new selection always starts a new word
+        if (bits>0) endWord(lastEdge+1, frames);
+        bits=0;
+        mosiWord=0;
+        misoWord=0;
+    }
+    if (!levelOf(changed, clock) || !isSelected(levels)) return;
+    if (levelOf(levels, clock)!=sampleOnRising) return;
+
+    // data lines changing together with the clock edge changed after it
+    if (bits==0) wordStart=sample;
+    uint32_t mosiBit=mosi!=Unused ? uint32_t(levelOf(previous, mosi)) : 0;
+    uint32_t misoBit=miso!=Unused ? uint32_t(levelOf(previous, miso)) : 0;
+    if (msbFirst)
+    {
+        mosiWord=(mosiWord<<1) | mosiBit;
+        misoWord=(misoWord<<1) | misoBit;
+    }
+    else
+    {
+        mosiWord|=mosiBit<<bits;
+        misoWord|=misoBit<<bits;
+    }
+    lastEdge=sample;
+    if (++bits==wordBits) endWord(sample+1, frames);
+}
+
+std::string SpiDecoder::describe(const DecodedFrame& frame) const
+{
+    std::string text;
+    if (mosi!=Unused) text+="mosi "+hex(frame.data);
+    if (miso!=Unused) text+=std::string(text.empty() ? "" : " ")+"miso "+hex(frame.data2);
+    if (frame.flags & DecodedFrame::FlagFramingError) text+=" incomplete";
+    return text;
+}
+
+I2cDecoder::I2cDecoder(unsigned clock, unsigned data) :
+    clock(clock),
+    data(data)
+{
+    if (clock>=32 || data>=32) throw std::invalid_argument("i2c channel out of range");
+    if (clock==data) throw std::invalid_argument("i2c clock and data must be different channels");
+}
+
+void I2cDecoder::reset()
+{
+    // the next transfer is only decoded from its start condition on
+    initialized=false;
+    active=false;
+    bits=0;
+    value=0;
+}
+
+void I2cDecoder::onChange(uint64_t sample, uint32_t levels, uint32_t changed, FrameList& frames)
+{
+    uint32_t previous=previousLevels;
+    previousLevels=levels;
+    if (!initialized)
+    {
+        initialized=true;
+        return;
+    }
+
+    bool scl=levelOf(levels, clock);
+    bool sdaChanged=levelOf(changed, data);
+    bool sclChanged=levelOf(changed, clock);
+
+    // data changing while the clock is high is a start or stop condition
+    if (sdaChanged && !sclChanged && scl)
+    {
+        DecodedFrame frame;
+        frame.start=sample;
+        frame.end=sample+1;
+        if (!levelOf(levels, data))
+        {
+            frame.type=DecodedFrame::Type::Start;
+            active=true;
+            address=true;
+        }
+        else
+        {
+            if (!active) return;
+            frame.type=DecodedFrame::Type::Stop;
+            active=false;
+        }
+        frames.push_back(frame);
+        bits=0;
+        value=0;
+        return;
+    }
+
+    if (!active || !sclChanged || !scl) return;
+
+    // data is sampled on the rising clock edge, a simultaneous data change happened after it
+    uint32_t bit=levelOf(previous, data) ? 1 : 0;
+    if (bits==0) byteStart=sample;
+    if (bits<8)
+    {
+        value=(value<<1) | bit;
+        ++bits;
+        return;
+    }
+
+    DecodedFrame frame;
+    frame.start=byteStart;
+    frame.end=sample+1;
+    frame.flags=bit==0 ? DecodedFrame::FlagAck : 0;
+    if (address)
+    {
+        frame.type=DecodedFrame::Type::Address;
+        frame.data=value>>1;
+        if (value & 1) frame.flags|=DecodedFrame::FlagRead;
+        address=false;
+    }
+    else
+    {
+        frame.data=value;
+    }
+    frames.push_back(frame);
+    bits=0;
+    value=0;
+}
+
+std::string I2cDecoder::describe(const DecodedFrame& frame) const
+{
+    switch (frame.type)
+    {
+    case DecodedFrame::Type::Start: return "start";
+    case DecodedFrame::Type::Stop: return "stop";
+    case DecodedFrame::Type::Address:
+        return "address "+hex(frame.data)+((frame.flags & DecodedFrame::FlagRead) ? " read" : " write")
+            +((frame.flags & DecodedFrame::FlagAck) ? " ack" : " nack");
+    default:
+        return hex(frame.data)+((frame.flags & DecodedFrame::FlagAck) ? " ack" : " nack");
+    }
+}
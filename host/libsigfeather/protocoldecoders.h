@@ -0,0 +1,117 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include "decoder.h"
+
+//! asynchronous serial, idle high, LSB first
+class UartDecoder : public Decoder
+{
+public:
+    enum class Parity
+    {
+        None,
+        Even,
+        Odd
+    };
+
+    UartDecoder(unsigned channel, uint32_t baudRate, unsigned dataBits=8, Parity parity=Parity::None);
+
+    const char* getName() const override { return "uart"; }
+    uint32_t getChannelMask() const override { return 1u<<channel; }
+    std::string describe(const DecodedFrame& frame) const override;
+
+    void begin(double sampleRate) override;
+    void reset() override;
+    void onChange(uint64_t sample, uint32_t levels, uint32_t changed, FrameList& frames) override;
+    void onAdvance(uint64_t sample, FrameList& frames) override;
+
+private:
+    enum class State
+    {
+        WaitIdle,       // line must be high before a start bit counts
+        Idle,
+        Frame
+    };
+
+    unsigned channel;
+    uint32_t baudRate;
+    unsigned dataBits;
+    Parity parity;
+
+    double bitSamples=0;
+    State state=State::WaitIdle;
+    bool level=false;
+    uint64_t frameStart=0;
+    unsigned bit=0;             // next bit to sample, 0 is the start bit
+    uint32_t value=0;
+    uint8_t flags=0;
+
+    //! samples all bits of the current frame that lie before 'sample'
+    void sampleBits(uint64_t sample, FrameList& frames);
+    uint64_t getBitCenter(unsigned index) const;
+};
+
+//! synchronous serial with optional MISO and active low chip select
+class SpiDecoder : public Decoder
+{
+public:
+    static constexpr int Unused=-1;
+
+    //! 'mode' 0..3 selects clock polarity and phase as usual
+    SpiDecoder(unsigned clock, int mosi, int miso=Unused, int chipSelect=Unused, unsigned mode=0, unsigned wordBits=8, bool msbFirst=true);
+
+    const char* getName() const override { return "spi"; }
+    uint32_t getChannelMask() const override;
+    std::string describe(const DecodedFrame& frame) const override;
+
+    void reset() override;
+    void onChange(uint64_t sample, uint32_t levels, uint32_t changed, FrameList& frames) override;
+
+private:
+    unsigned clock;
+    int mosi;
+    int miso;
+    int chipSelect;
+    bool sampleOnRising;
+    unsigned wordBits;
+    bool msbFirst;
+
+    bool initialized=false;
+    uint32_t previousLevels=0;
+    unsigned bits=0;
+    uint64_t wordStart=0;
+    uint64_t lastEdge=0;
+    uint32_t mosiWord=0;
+    uint32_t misoWord=0;
+
+    bool isSelected(uint32_t levels) const { return chipSelect==Unused || ((levels>>chipSelect) & 1)==0; }
+    void endWord(uint64_t sample, FrameList& frames);
+};
+
+//! I2C with 7 bit addresses
+class I2cDecoder : public Decoder
+{
+public:
+    I2cDecoder(unsigned clock, unsigned data);
+
+    const char* getName() const override { return "i2c"; }
+    uint32_t getChannelMask() const override { return (1u<<clock) | (1u<<data); }
+    std::string describe(const DecodedFrame& frame) const override;
+
+    void reset() override;
+    void onChange(uint64_t sample, uint32_t levels, uint32_t changed, FrameList& frames) override;
+
+private:
+    unsigned clock;
+    unsigned data;
+
+    bool initialized=false;
+    bool active=false;          // between start and stop
+    bool address=false;         // the next byte is an address
+    uint32_t previousLevels=0;
+    unsigned bits=0;
+    uint32_t value=0;
+    uint64_t byteStart=0;
+};
@@ -0,0 +1,122 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "rledecoder.h"
+#include "protocol.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    inline uint32_t readWord(const uint8_t* data)
+    {
+        // the stream is little-endian regardless of the host
+        return uint32_t(data[0]) | (uint32_t(data[1])<<8) | (uint32_t(data[2])<<16) | (uint32_t(data[3])<<24);
+    }
+}
+
+RleDecoder::RleDecoder(size_t limit) :
+    limit(limit)
+{
+}
+
+bool RleDecoder::push(const uint8_t* data, size_t bytes, const Output& output)
+{
+    if (error || isComplete()) return false;
+
+    while (bytes>0)
+    {
+        // complete a word that was split by the previous call
+        if (partialBytes>0)
+        {
+            size_t fill=std::min(bytes, 4-partialBytes);
+            std::memcpy(partial+partialBytes, data, fill);
+            partialBytes+=fill;
+            data+=fill;
+            bytes-=fill;
+            if (partialBytes<4) return true;
+            partialBytes=0;
+            if (!handleWord(readWord(partial), output)) return false;
+            continue;
+        }
+
+        // pass whole raw words straight through
+        if (state==State::Raw)
+        {
+            size_t words=std::min<size_t>(count, bytes/4);
+            if (words>0)
+            {
+                count-=uint32_t(words);
+                if (count==0) state=State::Header;
+                if (!emit(data, words*4, output)) return false;
+                data+=words*4;
+                bytes-=words*4;
+                continue;
+            }
+        }
+
+        if (bytes<4)
+        {
+            std::memcpy(partial, data, bytes);
+            partialBytes=bytes;
+            return true;
+        }
+        if (!handleWord(readWord(data), output)) return false;
+        data+=4;
+        bytes-=4;
+    }
+    return !isComplete();
+}
+
+bool RleDecoder::handleWord(uint32_t word, const Output& output)
+{
+    switch (state)
+    {
+    case State::Header:
+        count=word & CompressedCountMask;
+        if (count==0)
+        {
+            error=true;
+            return false;
+        }
+        state=(word & CompressedRunFlag)!=0 ? State::Run : State::Raw;
+        return true;
+    case State::Run:
+        state=State::Header;
+        return emitRun(word, count, output);
+    case State::Raw:
+    default:
+    {
+        uint8_t bytes[4]={uint8_t(word), uint8_t(word>>8), uint8_t(word>>16), uint8_t(word>>24)};
+        if (--count==0) state=State::Header;
+        return emit(bytes, 4, output);
+    }
+    }
+}
+
+bool RleDecoder::emit(const uint8_t* data, size_t bytes, const Output& output)
+{
+    bytes=std::min(bytes, limit-decoded);
+    decoded+=bytes;
+    if (bytes>0 && !output(data, bytes)) return false;
+    return !isComplete();
+}
+
+bool RleDecoder::emitRun(uint32_t value, uint32_t words, const Output& output)
+{
+    // keep the byte order of the stream
+    uint8_t bytes[4]={uint8_t(value), uint8_t(value>>8), uint8_t(value>>16), uint8_t(value>>24)};
+    uint32_t native;
+    std::memcpy(&native, bytes, 4);
+
+    if (scratch.empty()) scratch.resize(ScratchWords);
+    std::fill(scratch.begin(), scratch.begin()+std::min<size_t>(words, ScratchWords), native);
+    while (words>0)
+    {
+        size_t chunk=std::min<size_t>(words, ScratchWords);
+        if (!emit(reinterpret_cast<const uint8_t*>(scratch.data()), chunk*4, output)) return false;
+        words-=uint32_t(chunk);
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+//! Expands the run-length encoded sample stream of a compressed session (see
+//! protocol.h) back into sample words. Input may be split anywhere, even
+//! inside a header or sample word. Raw blocks are passed through without
+//! copying where possible, runs are expanded through a small scratch buffer.
+class RleDecoder
+{
+public:
+    //! receives decoded sample data, return false to stop decoding
+    using Output=std::function<bool(const uint8_t* data, size_t bytes)>;
+
+    //! stops after 'limit' decoded bytes
+    explicit RleDecoder(size_t limit);
+
+    //! decodes 'bytes' bytes of the compressed stream. returns false once the
+    //! limit is reached, the output stopped or the stream is corrupt.
+    bool push(const uint8_t* data, size_t bytes, const Output& output);
+
+    inline bool hasError() const { return error; }
+    inline bool isComplete() const { return decoded>=limit; }
+    inline size_t getDecoded() const { return decoded; }
+
+private:
+    static constexpr size_t ScratchWords=4096;
+
+    enum class State
+    {
+        Header,
+        Run,        // waiting for the repeated word
+        Raw
+    };
+
+    size_t limit;
+    size_t decoded=0;
+    bool error=false;
+    State state=State::Header;
+    uint32_t count=0;               // words left in the current block
+    uint8_t partial[4];             // a word split across push() calls
+    size_t partialBytes=0;
+    std::vector<uint32_t> scratch;
+
+    bool emit(const uint8_t* data, size_t bytes, const Output& output);
+    bool emitRun(uint32_t value, uint32_t words, const Output& output);
+    bool handleWord(uint32_t word, const Output& output);
+};
@@ -37,30 +37,27 @@ SigFeather::~SigFeather()
 
 SigFeather::DeviceHandle SigFeather::findDevice(std::string_view serialNumber) const
 {
-    SigFeather::DeviceHandle foundDevice = nullptr;
-    deviceManager->findUsbDevices([&foundDevice,serialNumber](DeviceHandle device)
-        {
-            if (serialNumber.empty() || serialNumber==device->getSerialNumber())
-            {
-                foundDevice = device;
-                return false; // stop enumeration
-            }
-            else
-            {
-                return true; // continue enumeration
-            }
-        }
-    );
-    return foundDevice;
+    for (const auto& device : deviceManager->getDevices())
+    {
+        if (serialNumber.empty() || serialNumber==device->getSerialNumber()) return device;
+    }
+    return nullptr;
 }
 
 void SigFeather::enumerateDevices(DeviceFoundCallback callback, void* user_data) const
 {
-    deviceManager->findUsbDevices([callback,user_data](DeviceHandle device)
-        {
-            return callback(device, user_data);
-        }
-    );
+    for (const auto& device : deviceManager->getDevices())
+    {
+        if (!callback(device, user_data)) break;
+    }
 }
 
+int SigFeather::addDeviceListener(DeviceEventCallback callback, void* user_data)
+{
+    return deviceManager->addListener(callback, user_data);
+}
 
+void SigFeather::removeDeviceListener(int id)
+{
+    deviceManager->removeListener(id);
+}
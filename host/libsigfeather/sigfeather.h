@@ -3,7 +3,11 @@
 //! please see LICENSE file in root folder for licensing terms.
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -11,6 +15,200 @@ class SigFeather
 {
 public:
     class DeviceManager;
+
+    //! timing of the bulk transfer queue used by the last benchmark or capture
+    struct TransferStatistics
+    {
+        size_t queueDepth=0;            //!< configured number of queued transfers
+        size_t transferSize=0;          //!< configured size of each transfer in bytes
+        size_t transfers=0;             //!< number of completed transfers
+        size_t bytes=0;                 //!< payload bytes received
+        size_t maxQueueDepth=0;         //!< most transfers still queued when one completed
+        double averageQueueDepth=0;     //!< transfers still queued when one completed, on average
+        double minTurnaround=0;         //!< submit to completion time in microseconds
+        double averageTurnaround=0;
+        double maxTurnaround=0;
+        double seconds=0;               //!< duration of the whole stream
+        std::string memory;             //!< what the transfer buffers are: usbfs device memory, huge pages or pages
+    };
+
+    //! data path telemetry the device keeps for its current or last capture, to find
+    //! the highest sample rate a setup sustains without loss
+    struct DeviceStatistics
+    {
+        size_t fifoOverflows=0;         //!< times the sampler found samples lost to a full PIO FIFO
+        size_t dmaRestarts=0;           //!< ring rewinds of an unbounded or triggered capture
+        double updateRate=0;            //!< device loop iterations per second
+        double maxUpdateGap=0;          //!< longest time between two device loop iterations in microseconds
+        uint64_t bytesSent=0;           //!< bytes the device sent, compressed bytes for a compressed capture
+        uint64_t peakLag=0;             //!< most sampled bytes that were not sent yet
+        uint64_t bufferSize=0;          //!< capture buffer, a peakLag above it means data was overwritten
+        uint64_t lostBytes=0;           //!< sample bytes a framed capture reported as gaps
+
+        inline bool isLossless() const { return fifoOverflows==0 && peakLag<=bufferSize && lostBytes==0; }
+    };
+
+    //! condition that starts the capture window of a triggered capture
+    enum class TriggerType : uint8_t
+    {
+        None=0,                         //!< capture starts right away
+        RisingEdge,                     //!< pin goes from low to high
+        FallingEdge,                    //!< pin goes from high to low
+        High,                           //!< pin is high
+        Low,                            //!< pin is low
+        Pattern                         //!< 'width' pins starting at 'pin' equal 'pattern', needs a sample rate of at most half the device clock
+    };
+
+    struct TriggerSettings
+    {
+        TriggerType type=TriggerType::None;
+        uint8_t pin=2;
+        uint8_t width=1;                //!< pins compared by TriggerType::Pattern
+        uint32_t pattern=0;             //!< bit i is the level of pin+i
+        size_t preTriggerSamples=0;     //!< samples of the window taken before the trigger fired
+    };
+
+    //! what to acquire in a streaming capture
+    struct CaptureSettings
+    {
+        size_t samples=0;               //!< number of samples to acquire
+        bool unbounded=false;           //!< sample until the sink stops the capture, 'samples' is ignored
+        uint8_t basePin=2;              //!< first sampled GPIO
+        uint8_t channels=1;             //!< contiguous GPIOs sampled per clock: 1, 2, 4, 8, 16 or 32
+        uint32_t sampleRate=0;          //!< samples per second, 0 uses the device default
+        size_t chunkSize=0;             //!< bytes per ISampleSink::onData() call, 0 passes transfers through as they arrive.
+                                        //!< the chunks before a gap or segment and the last one may be shorter.
+        bool compressed=false;          //!< run-length encode the stream on the device, sinks still receive raw samples
+        bool deep=false;                //!< sample into the device's PSRAM, for captures larger or faster than its SRAM and USB allow
+        bool framed=false;              //!< data the device cannot send in time becomes a gap, see ISampleSink::onGap(),
+                                        //!< instead of ending the capture. cannot be combined with compression.
+        TriggerSettings trigger;        //!< a triggered capture cannot be unbounded
+        size_t segments=0;              //!< more than 1 captures 'samples' samples that many times without stopping the device's
+                                        //!< sampler: at every trigger, or every 'segmentInterval' samples. see ISampleSink::onSegment(),
+                                        //!< implies framed, cannot be unbounded or compressed.
+        size_t segmentInterval=0;       //!< samples from the start of one untriggered segment to the next, at least 'samples'
+        bool changesOnly=false;         //!< the device only sends pin changes, timed to a few of its clocks, and the host expands
+                                        //!< them into samples at 'sampleRate', which must be set. for slow or bursty signals,
+                                        //!< see ISampleSink::onChange(). of the options above, only 'framed' applies: records the
+                                        //!< device could not send in time become a gap, and the changes behind it are placed
+                                        //!< at the device's estimate of their time.
+        unsigned int timeout=1000;      //!< milliseconds to wait for data, 0 waits forever e.g. for a trigger
+    };
+
+    //! what the device agreed to deliver, may be less than requested
+    struct CaptureInfo
+    {
+        size_t samples=0;               //!< not used for unbounded captures
+        size_t bytes=0;
+        bool unbounded=false;
+        bool compressed=false;          //!< the device agreed to compress, see TransferStatistics::bytes for the bytes on the wire
+        bool deep=false;                //!< the device samples into its PSRAM, the rate may be lower than requested
+        bool framed=false;              //!< the sink may get gaps
+        size_t segments=0;              //!< 'samples' and 'bytes' split evenly into this many segments, 0 for a single capture
+        size_t segmentInterval=0;       //!< achieved CaptureSettings::segmentInterval, 0 for triggered segments
+        bool changesOnly=false;         //!< samples are expanded from pin changes on the host
+        double changeClock=0;           //!< change-only captures: Hz of the clock ISampleSink::onChange() counts
+        uint8_t basePin=0;
+        uint8_t channels=1;             //!< see protocol.h for how channels are packed into the sample words
+        double sampleRate=0;            //!< exact achieved samples per second
+        uint32_t systemClock=0;         //!< device clock the sample clock is divided from, in Hz
+        double clockDivider=0;          //!< systemClock/sampleRate, a multiple of 1/256
+        double jitter=0;                //!< worst case offset of a sample from its ideal time, in seconds
+        bool triggered=false;
+        size_t triggerSample=0;         //!< index of the first sample after the trigger fired, within each segment of a segmented capture.
+                                        //!< the device reads the DMA position in its trigger interrupt, so this is only good to about
+                                        //!< one sample word (32/channels samples) plus the samples taken during the interrupt latency
+        double startTime=0;             //!< host steady clock in seconds when sampling was started
+        double startUncertainty=0;      //!< half the round trip of the start request, the device started within startTime +/- this
+    };
+
+    //! what a device supports, read when it is opened
+    struct DeviceCapabilities
+    {
+        unsigned protocolVersion=0;
+        uint32_t channelCounts=0;       //!< bit n is set if 2^n channels can be sampled
+        uint8_t pinCount=0;             //!< basePin+channels must not exceed this
+        bool unbounded=false;
+        bool compressed=false;
+        bool triggered=false;
+        bool deep=false;                //!< the device has PSRAM for CaptureSettings::deep
+        bool framed=false;
+        bool quickStart=false;          //!< starts a capture in a single round trip, see IDevice::rearm()
+        bool segmented=false;           //!< see CaptureSettings::segments
+        bool changes=false;             //!< see CaptureSettings::changesOnly
+        uint32_t systemClock=0;         //!< also the highest sample rate
+        size_t sampleBufferSize=0;      //!< bytes of a one-shot capture or benchmark, a trigger window may fill half of it
+        size_t deepBufferSize=0;        //!< bytes of a deep capture
+        double deepBandwidth=0;         //!< bytes per second a deep capture can sample
+
+        inline bool supportsChannels(unsigned channels) const { return channels>0 && channels<=32 && (channels & (channels-1))==0 && (channelCounts & channels)!=0; }
+        //! highest sample rate of a deep capture of 'channels' channels
+        inline double getMaxDeepSampleRate(unsigned channels) const { return std::min(deepBandwidth*8/channels, double(systemClock)); }
+    };
+
+    //! a reference counted piece of sample memory. copies share the memory,
+    //! which stays valid while any of them exists, so a sink can keep data
+    //! past ISampleSink::onBuffer() without copying it.
+    class BufferView
+    {
+    public:
+        BufferView() = default;
+        BufferView(std::shared_ptr<uint8_t> memory, size_t size) : memory(std::move(memory)), bytes(size) {}
+
+        //! a view of its own copy of 'data'
+        static BufferView copy(const uint8_t* data, size_t size)
+        {
+            auto owner=std::make_shared<std::vector<uint8_t>>(data, data+size);
+            return BufferView(std::shared_ptr<uint8_t>(owner, owner->data()), size);
+        }
+
+        inline const uint8_t* data() const { return memory.get(); }
+        inline uint8_t* data() { return memory.get(); }
+        inline size_t size() const { return bytes; }
+        inline bool empty() const { return bytes==0; }
+        //! 'size' bytes from 'offset' on, sharing the memory
+        inline BufferView subview(size_t offset, size_t size) const { return BufferView(std::shared_ptr<uint8_t>(memory, memory.get()+offset), size); }
+        //! number of views sharing the memory
+        inline long getUseCount() const { return memory.use_count(); }
+
+    private:
+        std::shared_ptr<uint8_t> memory;
+        size_t bytes=0;
+    };
+
+    //! receives a capture while it is being acquired. All calls are made on
+    //! the thread that called IDevice::stream(). While onData() runs no more
+    //! USB transfers are consumed, so a slow sink pushes back on the device
+    //! instead of piling up data on the host.
+    class ISampleSink
+    {
+    public:
+        virtual ~ISampleSink() = default;
+
+        virtual void onStart(const CaptureInfo& info) {}
+        //! receives the next chunk of raw sample data. the pointer is only valid during the call.
+        //! return false to end the capture early.
+        virtual bool onData(const uint8_t* data, size_t bytes) =0;
+        //! receives the next chunk like onData(), but as a view the sink may keep
+        //! after the call instead of copying it. the default passes it to onData().
+        virtual bool onBuffer(const BufferView& buffer) { return onData(buffer.data(), buffer.size()); }
+        //! a framed capture lost 'bytes' of sample data, whole sample words, at byte 'offset' of the
+        //! stream. offsets count lost bytes too, the data passed on so far ends right at 'offset'.
+        virtual void onGap(size_t offset, size_t bytes) {}
+        //! segment 'index' of a segmented capture starts at byte 'offset' of the stream, right behind the
+        //! previous one. its first sample was taken 'timestamp' sample clocks after sampling started,
+        //! divide by CaptureInfo::sampleRate for seconds.
+        virtual void onSegment(size_t index, size_t offset, uint64_t timestamp) {}
+        //! a change-only capture saw the pins change to 'pins' at 'clock' cycles of CaptureInfo::changeClock
+        //! after sampling started, the first call has the initial state. called as changes are decoded,
+        //! ahead of the samples that show them.
+        virtual void onChange(uint64_t clock, uint32_t pins) {}
+        //! the stream ended regularly, either complete or stopped by the sink
+        virtual void onEnd(size_t totalBytes) {}
+        //! the stream ended because of an error, onEnd() is not called in this case
+        virtual void onError(const std::string& message) {}
+    };
+
     class IDevice
     {
     public:
@@ -20,17 +218,47 @@ public:
         virtual std::string getProduct() const = 0;
         virtual std::string getSerialNumber() const = 0;
         virtual std::string getAddress() const = 0;
+        //! false once the device was unplugged, a handle to it stays valid but cannot be used
+        virtual bool isConnected() const = 0;
 
         virtual void open() =0;
         virtual void close() =0;
         virtual bool isOpen() const =0;
+        //! throws std::runtime_error if the device is not open
+        virtual DeviceCapabilities getCapabilities() const =0;
+
+        //! number of bulk transfers kept queued and size of each in bytes. without usbfs device
+        //! memory, transfers of at least 2MB may be backed by huge pages instead of pages.
+        virtual void setTransferQueue(size_t depth, size_t transferSize, bool hugePages=false) =0;
+        //! the configured queue, unlike TransferStatistics valid before the first capture
+        virtual size_t getTransferQueueDepth() const =0;
+        virtual size_t getTransferSize() const =0;
+        virtual TransferStatistics getTransferStatistics() const =0;
+        //! reads the device's telemetry, also while a capture runs on another thread.
+        //! throws std::runtime_error if the device is not open.
+        virtual DeviceStatistics getDeviceStatistics() const =0;
 
         virtual size_t benchmark(size_t bytes) const =0;
+        //! acquire samples and hand them to 'sink' as they arrive. returns the number of bytes delivered.
+        virtual size_t stream(const CaptureSettings& settings, ISampleSink& sink) const =0;
+        //! like stream(), but calls 'ready' once the device is configured, right before sampling starts, so several
+        //! devices can be started together. if 'ready' returns false, sampling is not started and the sink gets onError().
+        virtual size_t stream(const CaptureSettings& settings, ISampleSink& sink, const std::function<bool()>& ready) const =0;
+        //! repeats the last stream() with the same settings. the device still has the
+        //! configuration, so starting takes one control request instead of several,
+        //! for taking many short captures. reports an error to the sink if the last
+        //! stream() did not start.
+        virtual size_t rearm(ISampleSink& sink) const =0;
+        //! acquire samples into memory, convenience wrapper around stream() that copies
+        //! every transfer once. a sink overriding onBuffer() keeps the buffers instead.
         virtual std::vector<uint8_t> sample(size_t samples) const =0;
     };
 
     using DeviceHandle=std::shared_ptr<IDevice>;
     using DeviceFoundCallback=bool(*)(DeviceHandle device, void* user_data);
+    //! called on the device manager's event thread when a device was plugged in ('arrived') or removed.
+    //! callbacks may open devices and add or remove listeners.
+    using DeviceEventCallback=void(*)(DeviceHandle device, bool arrived, void* user_data);
 
 public:
     SigFeather();
@@ -39,6 +267,11 @@ public:
     DeviceHandle findDevice(std::string_view serialNumber={}) const;
     void enumerateDevices(DeviceFoundCallback callback, void* user_data) const;
 
+    //! reports arriving and leaving devices. devices connected already are
+    //! reported as arrived before this returns. returns an id for removeDeviceListener().
+    int addDeviceListener(DeviceEventCallback callback, void* user_data);
+    void removeDeviceListener(int id);
+
 private:
     std::shared_ptr<DeviceManager> deviceManager;
 };
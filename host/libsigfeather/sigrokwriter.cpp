@@ -0,0 +1,226 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "sigrokwriter.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <ctime>
+#include <limits>
+
+namespace
+{
+    // zip record signatures
+    constexpr uint32_t LocalHeader=0x04034b50;
+    constexpr uint32_t CentralHeader=0x02014b50;
+    constexpr uint32_t EndOfCentralDirectory=0x06054b50;
+    constexpr uint16_t VersionNeeded=10;            // stored entries only
+    constexpr uint64_t ArchiveLimit=0xffffffff;
+    constexpr uint64_t DirectoryEntrySize=64;       // central directory record with a name of up to 18 characters
+
+    //! CRC-32 (IEEE), slicing-by-8 tables, so the checksum keeps up with the expanded samples
+    class Crc32
+    {
+    public:
+        Crc32()
+        {
+            for (uint32_t i=0; i<256; ++i)
+            {
+                uint32_t crc=i;
+                for (int bit=0; bit<8; ++bit) crc=(crc>>1) ^ ((crc & 1) ? 0xedb88320 : 0);
+                table[0][i]=crc;
+            }
+            for (uint32_t i=0; i<256; ++i)
+            {
+                for (size_t t=1; t<table.size(); ++t) table[t][i]=(table[t-1][i]>>8) ^ table[0][table[t-1][i] & 0xff];
+            }
+        }
+
+        uint32_t compute(const void* data, size_t bytes) const
+        {
+            const uint8_t* p=static_cast<const uint8_t*>(data);
+            uint32_t crc=0xffffffff;
+            for (; bytes>=8; bytes-=8, p+=8)
+            {
+                uint32_t low=crc ^ (uint32_t(p[0]) | uint32_t(p[1])<<8 | uint32_t(p[2])<<16 | uint32_t(p[3])<<24);
+                uint32_t high=uint32_t(p[4]) | uint32_t(p[5])<<8 | uint32_t(p[6])<<16 | uint32_t(p[7])<<24;
+                crc=table[7][low & 0xff] ^ table[6][(low>>8) & 0xff] ^ table[5][(low>>16) & 0xff] ^ table[4][low>>24] ^
+                    table[3][high & 0xff] ^ table[2][(high>>8) & 0xff] ^ table[1][(high>>16) & 0xff] ^ table[0][high>>24];
+            }
+            for (; bytes>0; --bytes, ++p) crc=(crc>>8) ^ table[0][(crc ^ *p) & 0xff];
+            return ~crc;
+        }
+
+    private:
+        std::array<std::array<uint32_t, 256>, 8> table;
+    };
+
+    const Crc32 crc32;
+}
+
+SigrokWriter::SigrokWriter(const std::string& path) :
+    file(path)
+{
+}
+
+void SigrokWriter::onStart(const SigFeather::CaptureInfo& info)
+{
+    unpacker=std::make_unique<SampleUnpacker>(info.channels);
+    aligner.reset();
+    buffer.resize(BufferSize);
+    bufferSamples=0;
+    samplesLeft=info.unbounded ? std::numeric_limits<uint64_t>::max() : info.samples;
+    entries.clear();
+    logicFiles=0;
+    error=false;
+    unsupported=false;
+    finished=false;
+
+    std::time_t now=std::time(nullptr);
+    const std::tm* local=std::localtime(&now);
+    dosTime=uint16_t(local->tm_hour<<11 | local->tm_min<<5 | local->tm_sec/2);
+    dosDate=uint16_t((std::max(local->tm_year-80, 0))<<9 | (local->tm_mon+1)<<5 | local->tm_mday);
+
+    std::string metadata="[global]\nsigrok version=0.5.1\n\n[device 1]\ncapturefile=logic-1\n";
+    metadata+="total probes="+std::to_string(info.channels)+"\n";
+    metadata+="samplerate="+std::to_string(std::llround(info.sampleRate))+"\n";
+    metadata+="total analog=0\n";
+    for (unsigned c=0; c<info.channels; ++c)
+    {
+        metadata+="probe"+std::to_string(c+1)+"=GPIO"+std::to_string(info.basePin+c)+"\n";
+    }
+    metadata+="unitsize="+std::to_string(unpacker->getSampleSize())+"\n";
+
+    writeEntry("version", "2", 1);
+    writeEntry("metadata", metadata.data(), metadata.size());
+}
+
+bool SigrokWriter::onData(const uint8_t* data, size_t bytes)
+{
+    if (!unpacker || finished || unsupported) return false;
+    return aligner.push(data, bytes, [this](const uint8_t* words, size_t count) { return expandWords(words, count); });
+}
+
+void SigrokWriter::onGap(size_t offset, size_t bytes)
+{
+    unsupported=true;
+}
+
+void SigrokWriter::onSegment(size_t index, size_t offset, uint64_t timestamp)
+{
+    if (index>0) unsupported=true;
+}
+
+void SigrokWriter::onEnd(size_t totalBytes)
+{
+    finish();
+}
+
+void SigrokWriter::onError(const std::string& message)
+{
+    finish();
+}
+
+bool SigrokWriter::expandWords(const uint8_t* words, size_t bytes)
+{
+    size_t sampleSize=unpacker->getSampleSize();
+    size_t samplesPerWord=32/unpacker->getChannels();
+    size_t capacity=buffer.size()/sampleSize;
+    uint64_t samples=std::min<uint64_t>(bytes/4*samplesPerWord, samplesLeft);
+    while (samples>0)
+    {
+        // the capacity is a multiple of the samples per word, so a full buffer ends on a word
+        size_t count=std::min<uint64_t>(samples, capacity-bufferSamples);
+        unpacker->expand(words, count, buffer.data()+bufferSamples*sampleSize);
+        bufferSamples+=count;
+        samplesLeft-=count;
+        samples-=count;
+        words+=count/samplesPerWord*4;
+        if (bufferSamples==capacity && !writeLogic()) return false;
+    }
+    return !hasError();
+}
+
+bool SigrokWriter::writeLogic()
+{
+    if (bufferSamples==0) return true;
+    bool written=writeEntry("logic-1-"+std::to_string(++logicFiles), buffer.data(), bufferSamples*unpacker->getSampleSize());
+    bufferSamples=0;
+    return written;
+}
+
+bool SigrokWriter::writeEntry(const std::string& name, const void* data, size_t bytes)
+{
+    if (error) return false;
+    // leave room for the central directory, too
+    uint64_t end=file.getPosition()+30+name.size()+bytes;
+    if (end+(entries.size()+1)*DirectoryEntrySize+22>ArchiveLimit)
+    {
+        error=true;
+        return false;
+    }
+
+    Entry entry;
+    entry.name=name;
+    entry.crc=crc32.compute(data, bytes);
+    entry.size=uint32_t(bytes);
+    entry.offset=uint32_t(file.getPosition());
+
+    file.writeLE32(LocalHeader);
+    file.writeLE16(VersionNeeded);
+    file.writeLE16(0);                      // flags
+    file.writeLE16(0);                      // stored
+    file.writeLE16(dosTime);
+    file.writeLE16(dosDate);
+    file.writeLE32(entry.crc);
+    file.writeLE32(entry.size);             // compressed
+    file.writeLE32(entry.size);
+    file.writeLE16(uint16_t(name.size()));
+    file.writeLE16(0);                      // extra field
+    file.write(name);
+    file.write(data, bytes);
+    entries.push_back(std::move(entry));
+    return !file.hasError();
+}
+
+void SigrokWriter::finish()
+{
+    if (finished || !unpacker) return;
+    finished=true;
+    writeLogic();
+
+    uint64_t directory=file.getPosition();
+    for (const auto& entry : entries)
+    {
+        file.writeLE32(CentralHeader);
+        file.writeLE16(20);                 // made by, zip 2.0
+        file.writeLE16(VersionNeeded);
+        file.writeLE16(0);
+        file.writeLE16(0);
+        file.writeLE16(dosTime);
+        file.writeLE16(dosDate);
+        file.writeLE32(entry.crc);
+        file.writeLE32(entry.size);
+        file.writeLE32(entry.size);
+        file.writeLE16(uint16_t(entry.name.size()));
+        file.writeLE16(0);                  // extra field
+        file.writeLE16(0);                  // comment
+        file.writeLE16(0);                  // disk
+        file.writeLE16(0);                  // internal attributes
+        file.writeLE32(0);                  // external attributes
+        file.writeLE32(entry.offset);
+        file.write(entry.name);
+    }
+    uint64_t directorySize=file.getPosition()-directory;
+
+    file.writeLE32(EndOfCentralDirectory);
+    file.writeLE16(0);
+    file.writeLE16(0);
+    file.writeLE16(uint16_t(entries.size()));
+    file.writeLE16(uint16_t(entries.size()));
+    file.writeLE32(uint32_t(directorySize));
+    file.writeLE32(uint32_t(directory));
+    file.writeLE16(0);                      // comment
+    file.close();
+}
@@ -0,0 +1,70 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <string>
+#include <vector>
+#include "bufferedwriter.h"
+#include "capturewriter.h"
+#include "unpacker.h"
+#include "wordaligner.h"
+
+//! Exports a capture as a sigrok session (.sr) for PulseView and sigrok-cli.
+//! A session is a zip archive holding the metadata and the samples as one
+//! value per sample, split into 'logic-1-n' files. The archive is written
+//! while the capture streams: samples are expanded into a buffer and every
+//! full buffer becomes one stored (uncompressed) entry, so its size and CRC
+//! are known before its header is written and nothing is ever rewritten.
+//!
+//! Without zip64 an archive ends at 4GB, a longer capture stops there with an error.
+//! A session has no notion of lost samples or segments, so a gap or a second
+//! segment stops the capture with an error, too. The archive keeps the samples
+//! received before.
+class SigrokWriter : public ICaptureWriter
+{
+public:
+    //! throws std::runtime_error if the file cannot be created
+    explicit SigrokWriter(const std::string& path);
+
+    bool hasError() const override { return error || unsupported || file.hasError(); }
+    bool supportsGaps() const override { return false; }
+
+    // ISampleSink
+    void onStart(const SigFeather::CaptureInfo& info) override;
+    bool onData(const uint8_t* data, size_t bytes) override;
+    void onGap(size_t offset, size_t bytes) override;
+    void onSegment(size_t index, size_t offset, uint64_t timestamp) override;
+    void onEnd(size_t totalBytes) override;
+    void onError(const std::string& message) override;
+
+private:
+    static constexpr size_t BufferSize=4*1024*1024;     // bytes per logic file, like sigrok itself
+
+    struct Entry
+    {
+        std::string name;
+        uint32_t crc=0;
+        uint32_t size=0;
+        uint32_t offset=0;
+    };
+
+    BufferedWriter file;
+    std::unique_ptr<SampleUnpacker> unpacker;
+    WordAligner aligner;
+    std::vector<uint8_t> buffer;
+    size_t bufferSamples=0;         // expanded samples in the buffer
+    uint64_t samplesLeft=0;
+    std::vector<Entry> entries;
+    size_t logicFiles=0;
+    uint16_t dosTime=0;
+    uint16_t dosDate=0;
+    bool error=false;
+    bool unsupported=false;         // the capture had a gap or segments
+    bool finished=false;
+
+    bool expandWords(const uint8_t* words, size_t bytes);
+    bool writeLogic();
+    bool writeEntry(const std::string& name, const void* data, size_t bytes);
+    void finish();
+};
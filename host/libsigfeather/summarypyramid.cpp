@@ -0,0 +1,426 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "summarypyramid.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include "bufferedwriter.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIGFEATHER_POPCNT 1
+#define TARGET_POPCNT __attribute__((target("popcnt")))
+#endif
+
+// Summary file layout, all values little-endian: a FileHeader, then for
+// every channel and level a uint64_t block count followed by the blocks
+// as FileBlock records.
+namespace
+{
+    constexpr char Magic[8]={'S','F','S','U','M','\r','\n','\x1a'};
+    constexpr uint32_t Version=1;
+
+    enum BlockFlags : uint8_t
+    {
+        FlagHigh = 0x01,
+        FlagLow = 0x02
+    };
+
+    struct [[gnu::packed]] FileHeader
+    {
+        char magic[8]={};
+        uint32_t version=Version;
+        uint32_t channels=0;
+        uint32_t blockShift=0;
+        uint32_t levels=0;
+        uint64_t samples=0;
+    };
+    static_assert(sizeof(FileHeader)==32, "summary file header size mismatch");
+
+    struct [[gnu::packed]] FileBlock
+    {
+        uint32_t transitions=0;
+        uint8_t flags=0;
+        uint8_t reserved[3]={};
+    };
+    static_assert(sizeof(FileBlock)==8, "summary file block size mismatch");
+
+    //! running summary of whole plane words
+    struct Accumulator
+    {
+        uint64_t transitions=0;
+        uint64_t any=0;
+        uint64_t all=~uint64_t(0);
+    };
+
+    //! adds plane words [first, end), 'previous' holds the level before them in bit 0 and is updated
+    void accumulateScalar(const uint64_t* plane, size_t first, size_t end, uint64_t& previous, Accumulator& out)
+    {
+        for (size_t i=first; i<end; ++i)
+        {
+            uint64_t value=plane[i];
+            out.transitions+=std::popcount(value ^ ((value<<1) | previous));
+            out.any|=value;
+            out.all&=value;
+            previous=value>>63;
+        }
+    }
+
+#if SIGFEATHER_POPCNT
+    // the same with the popcnt instruction, the generic popcount is several times slower
+    TARGET_POPCNT void accumulatePopcnt(const uint64_t* plane, size_t first, size_t end, uint64_t& previous, Accumulator& out)
+    {
+        for (size_t i=first; i<end; ++i)
+        {
+            uint64_t value=plane[i];
+            out.transitions+=__builtin_popcountll(value ^ ((value<<1) | previous));
+            out.any|=value;
+            out.all&=value;
+            previous=value>>63;
+        }
+    }
+#endif
+
+    //! bits [first, first+count) of a word, count 1..64
+    inline uint64_t bitRange(size_t first, size_t count)
+    {
+        return (count==64 ? ~uint64_t(0) : ((uint64_t(1)<<count)-1))<<first;
+    }
+}
+
+void SummaryPyramid::Summary::merge(const Summary& other)
+{
+    uint64_t sum=uint64_t(transitions)+other.transitions;
+    transitions=uint32_t(std::min<uint64_t>(sum, std::numeric_limits<uint32_t>::max()));
+    high=high || other.high;
+    low=low || other.low;
+}
+
+SummaryPyramid::SummaryPyramid(unsigned channels, unsigned blockShift) :
+    blockShift(blockShift)
+{
+    if (blockShift<6 || blockShift>30)
+    {
+        throw std::invalid_argument("summary blocks must hold 64 to 2^30 samples");
+    }
+    reset(channels);
+}
+
+void SummaryPyramid::reset(unsigned channelCount)
+{
+    unpacker=std::make_unique<SampleUnpacker>(channelCount);
+#if SIGFEATHER_POPCNT
+    popcnt=__builtin_cpu_supports("popcnt");
+#endif
+    channels.assign(channelCount, Channel());
+    for (auto& channel : channels)
+    {
+        channel.levels.resize(1);
+    }
+    planes.assign(channelCount, std::vector<uint64_t>(SampleUnpacker::getPlaneWords(TileSamples)));
+    planePointers.resize(channelCount);
+    for (unsigned c=0; c<channelCount; ++c)
+    {
+        planePointers[c]=planes[c].data();
+    }
+    position=0;
+    restart=true;
+    aligner.reset();
+}
+
+void SummaryPyramid::push(const uint8_t* packed, size_t samples)
+{
+    uint64_t blockSize=uint64_t(1)<<blockShift;
+    uint64_t firstBlock=position>>blockShift;
+    for (size_t start=0; start<samples; start+=TileSamples)
+    {
+        size_t count=std::min(TileSamples, samples-start);
+        size_t words=SampleUnpacker::getPlaneWords(count);
+        unpacker->demultiplex(packed+start/unpacker->getSamplesPerWord()*4, count, planePointers.data());
+
+        for (unsigned c=0; c<channels.size(); ++c)
+        {
+            Channel& channel=channels[c];
+            auto& blocks=channel.levels[0];
+            const uint64_t* plane=planePointers[c];
+            size_t i=0;
+            if (start==0 && restart)
+            {
+                // the first sample of a capture or after a break has nothing to change from
+                channel.previous=plane[0] & 1;
+            }
+
+            // a chunk that ended inside a plane word shifts the words of all later ones
+            // against the blocks, so words may span two blocks and are split
+            for (; i<words && ((position+i*64) & 63)!=0; ++i)
+            {
+                uint64_t value=plane[i];
+                size_t valid=std::min<size_t>(64, count-i*64);
+                uint64_t edges=value ^ ((value<<1) | channel.previous);
+                uint64_t sample=position+i*64;
+                channel.previous=(value>>(valid-1)) & 1;
+                for (size_t done=0; done<valid;)
+                {
+                    uint64_t current=sample+done;
+                    size_t bits=std::min<uint64_t>(valid-done, blockSize-(current & (blockSize-1)));
+                    uint64_t mask=bitRange(done, bits);
+                    Summary summary;
+                    summary.transitions=uint32_t(std::popcount(edges & mask));
+                    summary.high=(value & mask)!=0;
+                    summary.low=(~value & mask)!=0;
+                    addToBlock(blocks, current>>blockShift, summary);
+                    done+=bits;
+                }
+            }
+
+            // otherwise words fall into blocks whole, accumulate them block by block
+            while (i<words)
+            {
+                uint64_t sample=position+i*64;
+                size_t end=std::min<size_t>(words, i+(blockSize-(sample & (blockSize-1)))/64);
+                Accumulator accumulator;
+                size_t full=std::min(end, count/64);
+#if SIGFEATHER_POPCNT
+                if (popcnt) accumulatePopcnt(plane, i, full, channel.previous, accumulator);
+                else
+#endif
+                accumulateScalar(plane, i, full, channel.previous, accumulator);
+                i=std::max(i, full);
+                if (i<end)
+                {
+                    // the last word of the chunk
+                    size_t valid=count-i*64;
+                    uint64_t mask=bitRange(0, valid);
+                    uint64_t value=plane[i] & mask;
+                    accumulator.transitions+=std::popcount((value ^ ((value<<1) | channel.previous)) & mask);
+                    accumulator.any|=value;
+                    accumulator.all&=value | ~mask;
+                    channel.previous=(value>>(valid-1)) & 1;
+                    ++i;
+                }
+                Summary summary;
+                summary.transitions=uint32_t(std::min<uint64_t>(accumulator.transitions, std::numeric_limits<uint32_t>::max()));
+                summary.high=accumulator.any!=0;
+                summary.low=accumulator.all!=~uint64_t(0);
+                addToBlock(blocks, sample>>blockShift, summary);
+            }
+        }
+        position+=count;
+    }
+    if (samples>0) restart=false;
+
+    for (auto& channel : channels)
+    {
+        updateLevels(channel, firstBlock);
+    }
+}
+
+void SummaryPyramid::skip(uint64_t samples)
+{
+    restart=true;
+    if (samples==0) return;
+    // lost samples add empty summaries, so blocks keep their sample ranges
+    uint64_t firstBlock=position>>blockShift;
+    uint64_t lastBlock=(position+samples-1)>>blockShift;
+    for (auto& channel : channels)
+    {
+        for (uint64_t block=firstBlock; block<=lastBlock; ++block) addToBlock(channel.levels[0], block, Summary());
+        updateLevels(channel, firstBlock);
+    }
+    position+=samples;
+}
+
+void SummaryPyramid::addToBlock(std::vector<Summary>& blocks, uint64_t block, const Summary& summary)
+{
+    if (block<blocks.size()) blocks[block].merge(summary);
+    else blocks.push_back(summary);
+}
+
+void SummaryPyramid::updateLevels(Channel& channel, uint64_t firstBlock)
+{
+    // recompute the parents of all blocks that changed, up to a single block
+    auto& levels=channel.levels;
+    for (size_t level=1; levels[level-1].size()>1; ++level)
+    {
+        if (level==levels.size()) levels.emplace_back();
+        const auto& children=levels[level-1];
+        auto& parents=levels[level];
+        firstBlock>>=1;
+        parents.resize((children.size()+1)/2);
+        for (size_t i=firstBlock; i<parents.size(); ++i)
+        {
+            Summary summary=children[2*i];
+            if (2*i+1<children.size()) summary.merge(children[2*i+1]);
+            parents[i]=summary;
+        }
+    }
+}
+
+SummaryPyramid::Summary SummaryPyramid::summarize(unsigned channel, uint64_t first, uint64_t end) const
+{
+    Summary result;
+    const auto& levels=channels[channel].levels;
+    end=std::min(end, position);
+    if (first>=end) return result;
+
+    // climb the levels, merging the odd blocks at both ends of the range
+    uint64_t low=first>>blockShift;
+    uint64_t high=((end-1)>>blockShift)+1;
+    for (size_t level=0; level<levels.size() && low<high; ++level)
+    {
+        const auto& blocks=levels[level];
+        if (low & 1) result.merge(blocks[low++]);
+        if (high & 1) result.merge(blocks[--high]);
+        low>>=1;
+        high>>=1;
+    }
+    return result;
+}
+
+void SummaryPyramid::render(unsigned channel, uint64_t first, double samplesPerPixel, size_t pixels, Summary* out) const
+{
+    for (size_t pixel=0; pixel<pixels; ++pixel)
+    {
+        uint64_t start=first+uint64_t(std::llround(pixel*samplesPerPixel));
+        uint64_t end=first+uint64_t(std::llround((pixel+1)*samplesPerPixel));
+        out[pixel]=summarize(channel, start, std::max(end, start+1));
+    }
+}
+
+uint64_t SummaryPyramid::findActivity(unsigned channel, uint64_t sample) const
+{
+    const auto& levels=channels[channel].levels;
+    size_t level=0;
+    uint64_t block=sample>>blockShift;
+
+    // move right, climbing to the parent whenever a left child was checked
+    while (true)
+    {
+        if (block>=levels[level].size()) return NotFound;
+        if (levels[level][block].toggled()) break;
+        if ((block & 1) && level+1<levels.size())
+        {
+            block=(block>>1)+1;
+            ++level;
+        }
+        else
+        {
+            ++block;
+        }
+    }
+    // descend to the first base block with a transition
+    while (level>0)
+    {
+        --level;
+        block*=2;
+        if (!levels[level][block].toggled()) ++block;
+    }
+    return block<<blockShift;
+}
+
+void SummaryPyramid::onStart(const SigFeather::CaptureInfo& info)
+{
+    reset(info.channels);
+    sampleLimit=info.unbounded ? std::numeric_limits<uint64_t>::max() : info.samples;
+}
+
+bool SummaryPyramid::onData(const uint8_t* data, size_t bytes)
+{
+    return aligner.push(data, bytes, [this](const uint8_t* words, size_t count)
+        {
+            uint64_t samples=std::min<uint64_t>(count/4*unpacker->getSamplesPerWord(), sampleLimit-position);
+            if (samples>0) push(words, samples);
+            return true;
+        });
+}
+
+void SummaryPyramid::onGap(size_t offset, size_t bytes)
+{
+    // gaps start on a sample word, nothing is left in the aligner
+    aligner.reset();
+    skip(std::min<uint64_t>(uint64_t(bytes)/4*unpacker->getSamplesPerWord(), sampleLimit-position));
+}
+
+void SummaryPyramid::onSegment(size_t index, size_t offset, uint64_t timestamp)
+{
+    aligner.reset();
+    skip(0);
+}
+
+void SummaryPyramid::save(const std::string& path) const
+{
+    BufferedWriter file(path);
+    FileHeader header;
+    std::memcpy(header.magic, Magic, sizeof(header.magic));
+    header.channels=getChannels();
+    header.blockShift=blockShift;
+    header.levels=uint32_t(getLevelCount());
+    header.samples=position;
+    file.write(&header, sizeof(header));
+
+    for (const auto& channel : channels)
+    {
+        for (const auto& blocks : channel.levels)
+        {
+            uint64_t count=blocks.size();
+            file.write(&count, sizeof(count));
+            for (const auto& summary : blocks)
+            {
+                FileBlock block;
+                block.transitions=summary.transitions;
+                block.flags=(summary.high ? FlagHigh : 0) | (summary.low ? FlagLow : 0);
+                file.write(&block, sizeof(block));
+            }
+        }
+    }
+    if (!file.close()) throw std::runtime_error("writing the summary file "+path+" failed");
+}
+
+SummaryPyramid SummaryPyramid::load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) throw std::runtime_error("cannot open summary file "+path);
+
+    FileHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, Magic, sizeof(header.magic))!=0 || header.version!=Version ||
+        header.channels==0 || header.channels>32 || (32%header.channels)!=0 ||
+        header.blockShift<6 || header.blockShift>30 || header.levels==0 || header.levels>64)
+    {
+        throw std::runtime_error(path+" is not a supported summary file");
+    }
+
+    SummaryPyramid pyramid(header.channels, header.blockShift);
+    pyramid.position=header.samples;
+    uint64_t blockSize=uint64_t(1)<<header.blockShift;
+    for (auto& channel : pyramid.channels)
+    {
+        channel.levels.resize(header.levels);
+        // every level must hold exactly the blocks the sample count calls for
+        uint64_t expected=(header.samples+blockSize-1)/blockSize;
+        for (auto& blocks : channel.levels)
+        {
+            uint64_t count=0;
+            file.read(reinterpret_cast<char*>(&count), sizeof(count));
+            if (!file || count!=expected) throw std::runtime_error(path+" is corrupt");
+            std::vector<FileBlock> records(count);
+            file.read(reinterpret_cast<char*>(records.data()), count*sizeof(FileBlock));
+            if (!file) throw std::runtime_error(path+" is truncated");
+            blocks.resize(count);
+            for (size_t i=0; i<count; ++i)
+            {
+                blocks[i].transitions=records[i].transitions;
+                blocks[i].high=(records[i].flags & FlagHigh)!=0;
+                blocks[i].low=(records[i].flags & FlagLow)!=0;
+            }
+            expected=(expected+1)/2;
+        }
+        // a complete pyramid ends with a single block
+        if (channel.levels.back().size()>1) throw std::runtime_error(path+" is corrupt");
+    }
+    return pyramid;
+}
@@ -0,0 +1,105 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "sigfeather.h"
+#include "unpacker.h"
+#include "wordaligner.h"
+
+//! Multi-resolution summary of a capture for zoomed out views and searches.
+//! For every channel, level 0 summarizes blocks of getBlockSamples(0) samples
+//! and every further level merges two blocks of the level below, up to a
+//! single block covering the whole capture. A block records whether the
+//! channel was high, whether it was low and how often it changed inside.
+//!
+//! The pyramid is built incrementally, either through push() or as a sample
+//! sink while a capture streams, and can be saved next to the capture. A view
+//! then summarizes any range with a handful of blocks instead of the samples;
+//! below the base block size the raw samples are cheap enough to scan.
+//! Results are exact up to base blocks: ranges are widened to whole blocks.
+//! Samples a framed capture lost are neither high nor low, and no transition
+//! is counted across a gap or from one segment to the next.
+class SummaryPyramid : public SigFeather::ISampleSink
+{
+public:
+    struct Summary
+    {
+        uint32_t transitions=0;         //!< level changes inside the block, saturates
+        bool high=false;                //!< at least one sample was high
+        bool low=false;                 //!< at least one sample was low
+
+        inline bool toggled() const { return transitions>0; }
+        void merge(const Summary& other);
+    };
+
+    static constexpr unsigned DefaultBlockShift=10;
+    static constexpr uint64_t NotFound=std::numeric_limits<uint64_t>::max();
+
+    //! base blocks hold 1<<blockShift samples, blockShift must be 6..30
+    explicit SummaryPyramid(unsigned channels=1, unsigned blockShift=DefaultBlockShift);
+
+    //! loads a pyramid written by save() for queries, throws std::runtime_error on failure
+    static SummaryPyramid load(const std::string& path);
+    //! throws std::runtime_error on failure
+    void save(const std::string& path) const;
+
+    //! starts over at sample 0, 'channels' must be 1, 2, 4, 8, 16 or 32
+    void reset(unsigned channels);
+    //! summarizes the next 'samples' samples. 'packed' starts on a sample word,
+    //! every chunk but the last must end on one, too.
+    void push(const uint8_t* packed, size_t samples);
+    //! continues after 'samples' lost samples, 0 for a break like a new segment.
+    //! the next sample pushed has nothing to change from.
+    void skip(uint64_t samples);
+
+    inline unsigned getChannels() const { return unsigned(channels.size()); }
+    inline uint64_t getSampleCount() const { return position; }
+    inline size_t getLevelCount() const { return channels.empty() ? 0 : channels[0].levels.size(); }
+    inline uint64_t getBlockSamples(size_t level) const { return uint64_t(1)<<(blockShift+level); }
+    //! blocks of a level in sample order, the last one may be partial
+    inline const std::vector<Summary>& getLevel(unsigned channel, size_t level) const { return channels[channel].levels[level]; }
+
+    //! summary of the samples [first, end) widened to base blocks, in O(log) blocks
+    Summary summarize(unsigned channel, uint64_t first, uint64_t end) const;
+    //! one summary per pixel for 'pixels' pixels of 'samplesPerPixel' samples from 'first' on
+    void render(unsigned channel, uint64_t first, double samplesPerPixel, size_t pixels, Summary* out) const;
+    //! first sample of the first base block from the one holding 'sample' on
+    //! that contains a transition, or NotFound. scan that block's samples for the edge.
+    uint64_t findActivity(unsigned channel, uint64_t sample) const;
+
+    // ISampleSink
+    void onStart(const SigFeather::CaptureInfo& info) override;
+    bool onData(const uint8_t* data, size_t bytes) override;
+    void onGap(size_t offset, size_t bytes) override;
+    void onSegment(size_t index, size_t offset, uint64_t timestamp) override;
+
+private:
+    static constexpr size_t TileSamples=64*1024;
+
+    struct Channel
+    {
+        std::vector<std::vector<Summary>> levels;
+        uint64_t previous=0;            // level of the last sample pushed in bit 0
+    };
+
+    unsigned blockShift;
+    std::vector<Channel> channels;
+    uint64_t position=0;
+    std::unique_ptr<SampleUnpacker> unpacker;
+    std::vector<std::vector<uint64_t>> planes;
+    std::vector<uint64_t*> planePointers;
+    WordAligner aligner;
+    uint64_t sampleLimit=0;
+    bool restart=true;              // the next sample starts the capture or follows a break
+    bool popcnt=false;              // the CPU counts bits in one instruction
+
+    void addToBlock(std::vector<Summary>& blocks, uint64_t block, const Summary& summary);
+    void updateLevels(Channel& channel, uint64_t firstBlock);
+};
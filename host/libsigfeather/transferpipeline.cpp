@@ -0,0 +1,213 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "transferpipeline.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+    int transferStatusToError(libusb_transfer_status status)
+    {
+        switch (status)
+        {
+        case LIBUSB_TRANSFER_COMPLETED: return LIBUSB_SUCCESS;
+        case LIBUSB_TRANSFER_TIMED_OUT: return LIBUSB_ERROR_TIMEOUT;
+        case LIBUSB_TRANSFER_CANCELLED: return LIBUSB_ERROR_INTERRUPTED;
+        case LIBUSB_TRANSFER_STALL: return LIBUSB_ERROR_PIPE;
+        case LIBUSB_TRANSFER_NO_DEVICE: return LIBUSB_ERROR_NO_DEVICE;
+        case LIBUSB_TRANSFER_OVERFLOW: return LIBUSB_ERROR_OVERFLOW;
+        case LIBUSB_TRANSFER_ERROR:
+        default:
+            return LIBUSB_ERROR_IO;
+        }
+    }
+}
+
+TransferPipeline::TransferPipeline(libusb_context* context, libusb_device_handle* handle, uint8_t endpoint, size_t queueDepth, size_t transferSize, BufferPool& pool) :
+    context(context),
+    handle(handle),
+    endpoint(endpoint),
+    transferSize(transferSize),
+    pool(pool)
+{
+    if (!handle) throw std::invalid_argument("device handle is null");
+    if (queueDepth==0) throw std::invalid_argument("queue depth must be at least one transfer");
+    if (transferSize==0 || transferSize>size_t(std::numeric_limits<int>::max())) throw std::invalid_argument("invalid transfer size");
+    if (pool.getBufferSize()<transferSize) throw std::invalid_argument("pool buffers are smaller than a transfer");
+
+    statistics.queueDepth=queueDepth;
+    statistics.transferSize=transferSize;
+
+    slots.resize(queueDepth);
+    for (auto& slot : slots)
+    {
+        slot.owner=this;
+        slot.buffer=pool.acquire();
+        slot.transfer=libusb_alloc_transfer(0);
+        if (!slot.transfer)
+        {
+            for (auto& allocated : slots) if (allocated.transfer) libusb_free_transfer(allocated.transfer);
+            throw std::runtime_error("failed to allocate usb transfer");
+        }
+        idle.push_back(&slot);
+    }
+
+    eventThread=std::thread(&TransferPipeline::handleEvents, this);
+}
+
+TransferPipeline::~TransferPipeline()
+{
+    cancelAll();
+
+    stopEvents=true;
+    libusb_interrupt_event_handler(context);
+    if (eventThread.joinable()) eventThread.join();
+
+    for (auto& slot : slots)
+    {
+        libusb_free_transfer(slot.transfer);
+        slot.transfer=nullptr;
+    }
+}
+
+int TransferPipeline::run(size_t bytes, const Consumer& consumer, unsigned int timeout)
+{
+    // only the configuration carries over from the last run
+    SigFeather::TransferStatistics fresh;
+    fresh.queueDepth=statistics.queueDepth;
+    fresh.transferSize=statistics.transferSize;
+    statistics=fresh;
+    queueDepthSum=0;
+    turnaroundSum=0;
+    auto start=Clock::now();
+
+    size_t remaining=bytes;     // bytes the stream still has to deliver
+    size_t requested=0;         // bytes covered by transfers we did not consume yet
+    auto refill=[&]() -> int
+    {
+        while (!idle.empty() && remaining>requested)
+        {
+            Slot* slot=idle.back();
+            size_t length=std::min(transferSize, remaining-requested);
+            int error=submit(slot, length, timeout);
+            if (error!=0) return error;
+            idle.pop_back();
+            requested+=length;
+        }
+        return 0;
+    };
+
+    int result=refill();
+    bool done=(remaining==0);
+    while (!done && result==0)
+    {
+        Slot* slot=nullptr;
+        {
+            std::unique_lock lock(mutex);
+            signal.wait(lock, [this]() { return !completed.empty(); });
+            slot=completed.front();
+            completed.pop_front();
+        }
+        idle.push_back(slot);
+
+        libusb_transfer* transfer=slot->transfer;
+        requested-=transfer->length;
+        size_t received=transfer->actual_length;
+        // a timeout that still made progress is not an error, the remaining data follows in the next transfer
+        if (transfer->status==LIBUSB_TRANSFER_COMPLETED || (transfer->status==LIBUSB_TRANSFER_TIMED_OUT && received>0))
+        {
+            if (received>remaining) throw std::runtime_error("too many bytes returned!");
+            remaining-=received;
+            statistics.bytes+=received;
+            if (received==0) done=true;  // not sure what happened, but we didn't get any data so we stop instead of risking an infinite loop
+            else if (!consumer(slot->buffer.subview(0, received))) done=true;
+            // the consumer kept the buffer, continue with a fresh one
+            if (slot->buffer.getUseCount()>1) slot->buffer=pool.acquire();
+        }
+        else
+        {
+            result=transferStatusToError(transfer->status);
+        }
+
+        if (remaining==0) done=true;
+        if (!done && result==0) result=refill();
+    }
+
+    cancelAll();
+
+    statistics.seconds=std::chrono::duration<double>(Clock::now()-start).count();
+    // device memory may have run out while buffers were allocated
+    statistics.memory=BufferPool::getMemoryName(pool.getMemory());
+    if (statistics.transfers>0)
+    {
+        statistics.averageQueueDepth=queueDepthSum/double(statistics.transfers);
+        statistics.averageTurnaround=turnaroundSum/double(statistics.transfers);
+    }
+    return result;
+}
+
+int TransferPipeline::submit(Slot* slot, size_t bytes, unsigned int timeout)
+{
+    libusb_fill_bulk_transfer(slot->transfer, handle, endpoint, slot->buffer.data(), static_cast<int>(bytes), &TransferPipeline::transferCallback, slot, timeout);
+
+    std::scoped_lock lock(mutex);
+    slot->submitted=Clock::now();
+    int result=libusb_submit_transfer(slot->transfer);
+    if (result==0) ++inFlight;
+    return result;
+}
+
+void TransferPipeline::cancelAll()
+{
+    for (auto& slot : slots)
+    {
+        if (std::find(idle.begin(), idle.end(), &slot)==idle.end())
+        {
+            libusb_cancel_transfer(slot.transfer); // fails harmlessly for transfers that already completed
+        }
+    }
+
+    std::unique_lock lock(mutex);
+    signal.wait(lock, [this]() { return inFlight==0; });
+    for (auto* slot : completed) idle.push_back(slot);
+    completed.clear();
+}
+
+void TransferPipeline::handleEvents()
+{
+    while (!stopEvents)
+    {
+        timeval timeout{0, 100000};
+        libusb_handle_events_timeout_completed(context, &timeout, nullptr);
+    }
+}
+
+void TransferPipeline::transferCallback(libusb_transfer* transfer)
+{
+    Slot* slot=static_cast<Slot*>(transfer->user_data);
+    TransferPipeline* self=slot->owner;
+    auto now=Clock::now();
+    {
+        std::scoped_lock lock(self->mutex);
+        --self->inFlight;
+
+        if (transfer->status!=LIBUSB_TRANSFER_CANCELLED)
+        {
+            auto& stats=self->statistics;
+            double turnaround=std::chrono::duration<double, std::micro>(now-slot->submitted).count();
+            if (stats.transfers==0 || turnaround<stats.minTurnaround) stats.minTurnaround=turnaround;
+            if (turnaround>stats.maxTurnaround) stats.maxTurnaround=turnaround;
+            // number of transfers still queued at the time this one finished
+            if (self->inFlight>stats.maxQueueDepth) stats.maxQueueDepth=self->inFlight;
+            self->queueDepthSum+=double(self->inFlight);
+            self->turnaroundSum+=turnaround;
+            ++stats.transfers;
+        }
+
+        self->completed.push_back(slot);
+    }
+    self->signal.notify_all();
+}
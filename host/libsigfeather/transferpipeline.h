@@ -0,0 +1,81 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <libusb.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "bufferpool.h"
+#include "sigfeather.h"
+
+//! Streams data from a bulk IN endpoint by keeping several asynchronous
+//! transfers queued at all times. A dedicated thread handles libusb events
+//! while the calling thread consumes completed transfers in order and
+//! immediately resubmits them, so the bus never idles waiting for the host.
+//! Transfers receive straight into buffers of a BufferPool, a consumer that
+//! keeps a buffer gets it and the transfer continues with a fresh one.
+class TransferPipeline
+{
+public:
+    //! called for every completed transfer, in stream order.
+    //! return false to end the stream early.
+    using Consumer=std::function<bool(const SigFeather::BufferView& data)>;
+
+    //! the buffers of 'pool' must hold at least 'transferSize' bytes, the pool must outlive the pipeline
+    TransferPipeline(libusb_context* context, libusb_device_handle* handle, uint8_t endpoint, size_t queueDepth, size_t transferSize, BufferPool& pool);
+    ~TransferPipeline();
+
+    // not copyable
+    TransferPipeline(const TransferPipeline&) = delete;
+    TransferPipeline& operator=(const TransferPipeline&) = delete;
+
+    //! receive up to 'bytes' bytes and hand them to 'consumer'. blocks until
+    //! all data arrived, the consumer stopped the stream or an error occurred.
+    //! returns 0 or a libusb error code.
+    int run(size_t bytes, const Consumer& consumer, unsigned int timeout=1000);
+
+    inline const SigFeather::TransferStatistics& getStatistics() const { return statistics; }
+
+private:
+    using Clock=std::chrono::steady_clock;
+
+    struct Slot
+    {
+        TransferPipeline* owner=nullptr;
+        libusb_transfer* transfer=nullptr;
+        SigFeather::BufferView buffer;
+        Clock::time_point submitted;
+    };
+
+    libusb_context* context;
+    libusb_device_handle* handle;
+    uint8_t endpoint;
+    size_t transferSize;
+    BufferPool& pool;
+
+    std::vector<Slot> slots;
+    std::vector<Slot*> idle;
+    std::deque<Slot*> completed;    // filled by the event thread, drained by run()
+    std::mutex mutex;
+    std::condition_variable signal;
+
+    std::thread eventThread;
+    std::atomic<bool> stopEvents{false};
+
+    size_t inFlight=0;
+    double queueDepthSum=0;
+    double turnaroundSum=0;
+    SigFeather::TransferStatistics statistics;
+
+    int submit(Slot* slot, size_t bytes, unsigned int timeout);
+    void cancelAll();
+    void handleEvents();
+    static void transferCallback(libusb_transfer* transfer);
+};
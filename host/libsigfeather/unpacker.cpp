@@ -0,0 +1,395 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "unpacker.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define SIGFEATHER_X86 1
+#include <immintrin.h>
+#if defined(__GNUC__)
+#define SIGFEATHER_AVX2 1
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace
+{
+    constexpr size_t TileSamples=4096;     // demultiplex works in tiles that stay in L1, a multiple of 64 and 32
+
+    inline uint32_t readWord(const uint8_t* data)
+    {
+        return uint32_t(data[0]) | (uint32_t(data[1])<<8) | (uint32_t(data[2])<<16) | (uint32_t(data[3])<<24);
+    }
+
+    //! expands samples starting at packed word 'firstWord', used for whole
+    //! buffers by the scalar kernel and for the tails of the vector kernels
+    template<typename T>
+    void expandScalar(const uint8_t* packed, size_t firstWord, size_t samples, unsigned channels, T* out)
+    {
+        unsigned samplesPerWord=32/channels;
+        uint32_t mask=channels==32 ? 0xffffffff : (1u<<channels)-1;
+        for (size_t n=firstWord*samplesPerWord, word=firstWord; n<samples; ++word)
+        {
+            uint32_t value=readWord(packed+word*4);
+            for (unsigned k=0; k<samplesPerWord && n<samples; ++k, ++n)
+            {
+                out[n]=T((value>>((samplesPerWord-1-k)*channels)) & mask);
+            }
+        }
+    }
+
+    //! bit planes of up to 8 channels from expanded samples 'stride' bytes
+    //! apart, starting at plane word 'firstWord'
+    void planesScalar(const uint8_t* bytes, size_t stride, size_t firstWord, size_t samples, unsigned channels, uint64_t* const* planes)
+    {
+        for (size_t word=firstWord; word*64<samples; ++word)
+        {
+            size_t count=std::min<size_t>(64, samples-word*64);
+            uint64_t bits[8]={};
+            const uint8_t* in=bytes+word*64*stride;
+            for (size_t i=0; i<count; ++i, in+=stride)
+            {
+                for (unsigned c=0; c<channels; ++c)
+                {
+                    bits[c]|=uint64_t((*in>>c) & 1)<<i;
+                }
+            }
+            for (unsigned c=0; c<channels; ++c)
+            {
+                planes[c][word]=bits[c];
+            }
+        }
+    }
+
+#if SIGFEATHER_X86
+    inline __m128i byteReverse32(__m128i x)
+    {
+        x=_mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2,3,0,1)), _MM_SHUFFLE(2,3,0,1));
+    }
+
+    //! 'x' holds Width bit groups of samples in its bytes, oldest in the most
+    //! significant bits. splits them until every byte holds one sample.
+    template<unsigned Channels, unsigned Width=8>
+    inline void splitBytes(__m128i x, uint8_t* out)
+    {
+        if constexpr (Width==Channels)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), x);
+        }
+        else
+        {
+            constexpr unsigned Half=Width/2;
+            __m128i mask=_mm_set1_epi8(char((1<<Half)-1));
+            __m128i high=_mm_and_si128(_mm_srli_epi16(x, Half), mask);
+            __m128i low=_mm_and_si128(x, mask);
+            splitBytes<Channels, Half>(_mm_unpacklo_epi8(high, low), out);
+            splitBytes<Channels, Half>(_mm_unpackhi_epi8(high, low), out+16*Half/Channels);
+        }
+    }
+
+    template<unsigned Channels>
+    void expandSSE2(const uint8_t* packed, size_t samples, void* out)
+    {
+        constexpr size_t SamplesPerVector=4*32/Channels;
+        size_t vectors=samples/SamplesPerVector;
+        if constexpr (Channels<=8)
+        {
+            uint8_t* bytes=static_cast<uint8_t*>(out);
+            for (size_t v=0; v<vectors; ++v)
+            {
+                __m128i x=byteReverse32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(packed+v*16)));
+                splitBytes<Channels>(x, bytes+v*SamplesPerVector);
+            }
+            expandScalar(packed, vectors*4, samples, Channels, bytes);
+        }
+        else if constexpr (Channels==16)
+        {
+            uint16_t* values=static_cast<uint16_t*>(out);
+            for (size_t v=0; v<vectors; ++v)
+            {
+                __m128i x=_mm_loadu_si128(reinterpret_cast<const __m128i*>(packed+v*16));
+                x=_mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2,3,0,1)), _MM_SHUFFLE(2,3,0,1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(values+v*SamplesPerVector), x);
+            }
+            expandScalar(packed, vectors*4, samples, Channels, values);
+        }
+        else
+        {
+            std::memcpy(out, packed, samples*4);
+        }
+    }
+
+    //! bit planes of up to 8 channels from one byte per sample, whole plane words only
+    size_t planesSSE2(const uint8_t* bytes, size_t samples, unsigned channels, uint64_t* const* planes)
+    {
+        size_t words=samples/64;
+        for (size_t word=0; word<words; ++word)
+        {
+            const __m128i* in=reinterpret_cast<const __m128i*>(bytes+word*64);
+            __m128i v[4]={_mm_loadu_si128(in), _mm_loadu_si128(in+1), _mm_loadu_si128(in+2), _mm_loadu_si128(in+3)};
+            for (unsigned c=0; c<channels; ++c)
+            {
+                // move bit c of every byte into its sign bit
+                int shift=7-int(c);
+                uint64_t bits=0;
+                for (int i=0; i<4; ++i)
+                {
+                    bits|=uint64_t(uint16_t(_mm_movemask_epi8(_mm_sll_epi16(v[i], _mm_cvtsi32_si128(shift)))))<<(16*i);
+                }
+                planes[c][word]=bits;
+            }
+        }
+        return words;
+    }
+
+    //! gathers byte 'group' of every 'stride' byte sample into 'out'
+    void deinterleaveSSE2(const uint8_t* samples, size_t count, size_t stride, unsigned group, uint8_t* out)
+    {
+        size_t vectors=count/16;
+        __m128i mask=_mm_set1_epi32(0xff);
+        __m128i shift=_mm_cvtsi32_si128(int(group*8));
+        for (size_t v=0; v<vectors; ++v)
+        {
+            const __m128i* in=reinterpret_cast<const __m128i*>(samples+v*16*stride);
+            __m128i result;
+            if (stride==2)
+            {
+                __m128i a=_mm_and_si128(_mm_srl_epi16(_mm_loadu_si128(in), shift), _mm_set1_epi16(0xff));
+                __m128i b=_mm_and_si128(_mm_srl_epi16(_mm_loadu_si128(in+1), shift), _mm_set1_epi16(0xff));
+                result=_mm_packus_epi16(a, b);
+            }
+            else
+            {
+                __m128i a=_mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(in), shift), mask);
+                __m128i b=_mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(in+1), shift), mask);
+                __m128i c=_mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(in+2), shift), mask);
+                __m128i d=_mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(in+3), shift), mask);
+                result=_mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out+v*16), result);
+        }
+        for (size_t i=vectors*16; i<count; ++i)
+        {
+            out[i]=samples[i*stride+group];
+        }
+    }
+#endif
+
+#if SIGFEATHER_AVX2
+    TARGET_AVX2 inline __m256i byteReverse32AVX2(__m256i x)
+    {
+        const __m256i order=_mm256_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12, 3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12);
+        return _mm256_shuffle_epi8(x, order);
+    }
+
+    //! like splitBytes(), unpack works within 128 bit lanes so the halves are
+    //! put back in sample order after every step
+    template<unsigned Channels, unsigned Width=8>
+    TARGET_AVX2 inline void splitBytesAVX2(__m256i x, uint8_t* out)
+    {
+        if constexpr (Width==Channels)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), x);
+        }
+        else
+        {
+            constexpr unsigned Half=Width/2;
+            __m256i mask=_mm256_set1_epi8(char((1<<Half)-1));
+            __m256i high=_mm256_and_si256(_mm256_srli_epi16(x, Half), mask);
+            __m256i low=_mm256_and_si256(x, mask);
+            __m256i first=_mm256_unpacklo_epi8(high, low);
+            __m256i second=_mm256_unpackhi_epi8(high, low);
+            splitBytesAVX2<Channels, Half>(_mm256_permute2x128_si256(first, second, 0x20), out);
+            splitBytesAVX2<Channels, Half>(_mm256_permute2x128_si256(first, second, 0x31), out+32*Half/Channels);
+        }
+    }
+
+    template<unsigned Channels>
+    TARGET_AVX2 void expandAVX2(const uint8_t* packed, size_t samples, void* out)
+    {
+        constexpr size_t SamplesPerVector=8*32/Channels;
+        size_t vectors=samples/SamplesPerVector;
+        if constexpr (Channels<=8)
+        {
+            uint8_t* bytes=static_cast<uint8_t*>(out);
+            for (size_t v=0; v<vectors; ++v)
+            {
+                __m256i x=byteReverse32AVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(packed+v*32)));
+                splitBytesAVX2<Channels>(x, bytes+v*SamplesPerVector);
+            }
+            expandScalar(packed, vectors*8, samples, Channels, bytes);
+        }
+        else if constexpr (Channels==16)
+        {
+            uint16_t* values=static_cast<uint16_t*>(out);
+            for (size_t v=0; v<vectors; ++v)
+            {
+                __m256i x=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(packed+v*32));
+                x=_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(2,3,0,1)), _MM_SHUFFLE(2,3,0,1));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(values+v*SamplesPerVector), x);
+            }
+            expandScalar(packed, vectors*8, samples, Channels, values);
+        }
+        else
+        {
+            std::memcpy(out, packed, samples*4);
+        }
+    }
+
+    TARGET_AVX2 size_t planesAVX2(const uint8_t* bytes, size_t samples, unsigned channels, uint64_t* const* planes)
+    {
+        size_t words=samples/64;
+        for (size_t word=0; word<words; ++word)
+        {
+            const __m256i* in=reinterpret_cast<const __m256i*>(bytes+word*64);
+            __m256i low=_mm256_loadu_si256(in);
+            __m256i high=_mm256_loadu_si256(in+1);
+            for (unsigned c=0; c<channels; ++c)
+            {
+                __m128i shift=_mm_cvtsi32_si128(7-int(c));
+                uint64_t bits=uint32_t(_mm256_movemask_epi8(_mm256_sll_epi16(low, shift)));
+                bits|=uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_sll_epi16(high, shift))))<<32;
+                planes[c][word]=bits;
+            }
+        }
+        return words;
+    }
+#endif
+
+    template<unsigned Channels>
+    void expandWith(SampleUnpacker::Kernel kernel, const uint8_t* packed, size_t samples, void* out)
+    {
+        switch (kernel)
+        {
+#if SIGFEATHER_AVX2
+        case SampleUnpacker::Kernel::AVX2:
+            expandAVX2<Channels>(packed, samples, out);
+            return;
+#endif
+#if SIGFEATHER_X86
+        case SampleUnpacker::Kernel::SSE2:
+            expandSSE2<Channels>(packed, samples, out);
+            return;
+#endif
+        default:
+            if constexpr (Channels<=8) expandScalar(packed, 0, samples, Channels, static_cast<uint8_t*>(out));
+            else if constexpr (Channels==16) expandScalar(packed, 0, samples, Channels, static_cast<uint16_t*>(out));
+            else expandScalar(packed, 0, samples, Channels, static_cast<uint32_t*>(out));
+            return;
+        }
+    }
+
+    //! bit planes of up to 8 channels from one byte per sample
+    void planesWith(SampleUnpacker::Kernel kernel, const uint8_t* bytes, size_t samples, unsigned channels, uint64_t* const* planes)
+    {
+        size_t words=0;
+#if SIGFEATHER_AVX2
+        if (kernel==SampleUnpacker::Kernel::AVX2) words=planesAVX2(bytes, samples, channels, planes);
+#endif
+#if SIGFEATHER_X86
+        if (kernel==SampleUnpacker::Kernel::SSE2) words=planesSSE2(bytes, samples, channels, planes);
+#endif
+        planesScalar(bytes, 1, words, samples, channels, planes);
+    }
+}
+
+SampleUnpacker::SampleUnpacker(unsigned channels, Kernel kernel) :
+    channels(channels),
+    kernel(kernel)
+{
+    if (channels==0 || channels>32 || (32%channels)!=0)
+    {
+        throw std::invalid_argument("channel count must be 1, 2, 4, 8, 16 or 32");
+    }
+    if (static_cast<int>(kernel)>static_cast<int>(getBestKernel()))
+    {
+        throw std::invalid_argument(std::string("kernel ")+getKernelName(kernel)+" is not supported on this CPU");
+    }
+}
+
+SampleUnpacker::Kernel SampleUnpacker::getBestKernel()
+{
+#if SIGFEATHER_AVX2
+    static const bool hasAVX2=__builtin_cpu_supports("avx2");
+    if (hasAVX2) return Kernel::AVX2;
+#endif
+#if SIGFEATHER_X86
+    return Kernel::SSE2;
+#else
+    return Kernel::Scalar;
+#endif
+}
+
+const char* SampleUnpacker::getKernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::SSE2: return "SSE2";
+    case Kernel::AVX2: return "AVX2";
+    case Kernel::Scalar:
+    default:
+        return "scalar";
+    }
+}
+
+void SampleUnpacker::expand(const uint8_t* packed, size_t samples, void* out) const
+{
+    switch (channels)
+    {
+    case 1: expandWith<1>(kernel, packed, samples, out); break;
+    case 2: expandWith<2>(kernel, packed, samples, out); break;
+    case 4: expandWith<4>(kernel, packed, samples, out); break;
+    case 8: expandWith<8>(kernel, packed, samples, out); break;
+    case 16: expandWith<16>(kernel, packed, samples, out); break;
+    default: expandWith<32>(kernel, packed, samples, out); break;
+    }
+}
+
+void SampleUnpacker::demultiplex(const uint8_t* packed, size_t samples, uint64_t* const* planes) const
+{
+    size_t sampleSize=getSampleSize();
+    std::vector<uint8_t> expanded(TileSamples*sampleSize);
+    std::vector<uint8_t> group(sampleSize>1 ? TileSamples : 0);
+    uint64_t* tilePlanes[32];
+
+    for (size_t start=0; start<samples; start+=TileSamples)
+    {
+        size_t count=std::min(TileSamples, samples-start);
+        expand(packed+start/getSamplesPerWord()*4, count, expanded.data());
+        for (unsigned c=0; c<channels; ++c)
+        {
+            tilePlanes[c]=planes[c]+start/64;
+        }
+
+        if (sampleSize==1)
+        {
+            planesWith(kernel, expanded.data(), count, channels, tilePlanes);
+            continue;
+        }
+        // wider samples are split into bytes of 8 channels first
+        for (unsigned g=0; g<sampleSize; ++g)
+        {
+#if SIGFEATHER_X86
+            if (kernel!=Kernel::Scalar)
+            {
+                deinterleaveSSE2(expanded.data(), count, sampleSize, g, group.data());
+                planesWith(kernel, group.data(), count, 8, tilePlanes+g*8);
+                continue;
+            }
+#endif
+            for (size_t i=0; i<count; ++i)
+            {
+                uint32_t value=sampleSize==2 ? reinterpret_cast<const uint16_t*>(expanded.data())[i] : reinterpret_cast<const uint32_t*>(expanded.data())[i];
+                group[i]=uint8_t(value>>(g*8));
+            }
+            planesScalar(group.data(), 1, 0, count, 8, tilePlanes+g*8);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+//!@author mucki (code@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//! Converts packed capture data as delivered by IDevice::stream() into
+//! formats that are easier to analyze. Packed data is a sequence of 32 bit
+//! little-endian words, each holding 32/channels samples, oldest sample in
+//! the most significant bits (see protocol.h).
+//!
+//! Two output formats are supported:
+//!  - expanded: one value per sample, bit i is channel i. the value is a
+//!    uint8_t for up to 8 channels, uint16_t for 16 and uint32_t for 32.
+//!  - bit planes: one bitstream per channel, bit n%64 of uint64_t n/64 is the
+//!    level at sample n. unused bits of the last word are zero.
+//!
+//! Kernels use AVX2 or SSE2 where available and fall back to portable code.
+class SampleUnpacker
+{
+public:
+    enum class Kernel
+    {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    //! 'channels' must be 1, 2, 4, 8, 16 or 32
+    explicit SampleUnpacker(unsigned channels, Kernel kernel=getBestKernel());
+
+    //! fastest kernel supported by this CPU
+    static Kernel getBestKernel();
+    static const char* getKernelName(Kernel kernel);
+
+    inline unsigned getChannels() const { return channels; }
+    inline Kernel getKernel() const { return kernel; }
+    inline unsigned getSamplesPerWord() const { return 32/channels; }
+    //! bytes per expanded sample: 1, 2 or 4
+    inline size_t getSampleSize() const { return channels<=8 ? 1 : channels/8; }
+    //! bytes of packed data holding 'samples' samples, always whole words
+    inline size_t getPackedSize(size_t samples) const { return (samples+getSamplesPerWord()-1)/getSamplesPerWord()*4; }
+    //! uint64_t words per bit plane for 'samples' samples
+    static inline size_t getPlaneWords(size_t samples) { return (samples+63)/64; }
+
+    //! writes 'samples' expanded samples of getSampleSize() bytes each to 'out'.
+    //! 'packed' must start on a sample word and hold getPackedSize(samples) bytes.
+    void expand(const uint8_t* packed, size_t samples, void* out) const;
+
+    //! writes getPlaneWords(samples) words to planes[c] for every channel c.
+    //! to fill planes across several calls, pass a multiple of 64 samples to
+    //! all but the last call and advance the plane pointers accordingly.
+    void demultiplex(const uint8_t* packed, size_t samples, uint64_t* const* planes) const;
+
+private:
+    unsigned channels;
+    Kernel kernel;
+};
@@ -0,0 +1,180 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+
+#include "vcdwriter.h"
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <limits>
+
+namespace
+{
+    // one printable character per channel, starting at '!'
+    inline char identifier(unsigned channel)
+    {
+        return char('!'+channel);
+    }
+}
+
+VcdWriter::VcdWriter(const std::string& path) :
+    file(path)
+{
+}
+
+void VcdWriter::onStart(const SigFeather::CaptureInfo& info)
+{
+    edges=std::make_unique<EdgeExtractor>(info.channels);
+    aligner.reset();
+    sampleLimit=info.unbounded ? std::numeric_limits<uint64_t>::max() : info.samples;
+    cursors.assign(info.channels, 0);
+    streamBase=0;
+    timeBase=0;
+    dumped=false;
+    finished=false;
+
+    // nanoseconds unless a sample is shorter than a microsecond, then picoseconds keep the fractions
+    const char* timescale="1 ns";
+    unitsPerSample=1;
+    if (info.sampleRate>0)
+    {
+        unitsPerSample=1e9/info.sampleRate;
+        if (unitsPerSample<1000)
+        {
+            timescale="1 ps";
+            unitsPerSample*=1000;
+        }
+    }
+
+    char date[64]="";
+    std::time_t now=std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+
+    file.write("$date ");
+    file.write(date);
+    file.write(" $end\n$version sigfeather $end\n$timescale ");
+    file.write(timescale);
+    file.write(" $end\n$scope module sigfeather $end\n");
+    for (unsigned c=0; c<info.channels; ++c)
+    {
+        file.write("$var wire 1 ");
+        file.put(identifier(c));
+        file.write(" GPIO");
+        file.writeNumber(info.basePin+c);
+        file.write(" $end\n");
+    }
+    file.write("$upscope $end\n$enddefinitions $end\n");
+}
+
+bool VcdWriter::onData(const uint8_t* data, size_t bytes)
+{
+    if (!edges || finished) return false;
+    return aligner.push(data, bytes, [this](const uint8_t* words, size_t count) { return writeWords(words, count); });
+}
+
+void VcdWriter::onGap(size_t offset, size_t bytes)
+{
+    if (!edges || finished) return;
+    uint64_t lost=uint64_t(bytes)*8/edges->getChannels();
+    restart(lost, timeBase+edges->getSampleCount()+lost);
+}
+
+void VcdWriter::onSegment(size_t index, size_t offset, uint64_t timestamp)
+{
+    if (!edges || finished) return;
+    // a segment that directly follows the previous one continues it
+    uint64_t end=timeBase+edges->getSampleCount();
+    if (timestamp>end || edges->getSampleCount()==0) restart(0, std::max(timestamp, end));
+}
+
+void VcdWriter::onEnd(size_t totalBytes)
+{
+    finish();
+}
+
+void VcdWriter::onError(const std::string& message)
+{
+    finish();
+}
+
+bool VcdWriter::writeWords(const uint8_t* words, size_t bytes)
+{
+    uint64_t position=streamBase+edges->getSampleCount();
+    uint64_t samples=std::min<uint64_t>(bytes*8/edges->getChannels(), sampleLimit-std::min(sampleLimit, position));
+    if (samples>0)
+    {
+        edges->push(words, samples);
+        writeChanges();
+    }
+    return !file.hasError();
+}
+
+void VcdWriter::writeChanges()
+{
+    // merge the transitions of all channels into one time ordered list of value changes
+    unsigned channels=edges->getChannels();
+    std::fill(cursors.begin(), cursors.end(), 0);
+    while (true)
+    {
+        uint64_t next=std::numeric_limits<uint64_t>::max();
+        for (unsigned c=0; c<channels; ++c)
+        {
+            const auto& transitions=edges->getTransitions(c);
+            if (cursors[c]<transitions.size()) next=std::min<uint64_t>(next, transitions[cursors[c]].sample);
+        }
+        if (next==std::numeric_limits<uint64_t>::max()) break;
+
+        writeTime(timeBase+next);
+        bool initial=!dumped;
+        if (initial) file.write("$dumpvars\n");
+        for (unsigned c=0; c<channels; ++c)
+        {
+            const auto& transitions=edges->getTransitions(c);
+            if (cursors[c]<transitions.size() && transitions[cursors[c]].sample==next)
+            {
+                file.put(transitions[cursors[c]].level ? '1' : '0');
+                file.put(identifier(c));
+                file.put('\n');
+                ++cursors[c];
+            }
+        }
+        if (initial) file.write("$end\n");
+        dumped=true;
+    }
+    edges->clear();
+}
+
+void VcdWriter::restart(uint64_t lost, uint64_t time)
+{
+    // gaps and segments start on a sample word, nothing is left in the aligner
+    aligner.reset();
+    if (dumped && edges->getSampleCount()>0)
+    {
+        writeTime(timeBase+edges->getSampleCount());
+        for (unsigned c=0; c<edges->getChannels(); ++c)
+        {
+            file.put('x');
+            file.put(identifier(c));
+            file.put('\n');
+        }
+    }
+    streamBase+=edges->getSampleCount()+lost;
+    timeBase=time;
+    edges->reset();
+}
+
+void VcdWriter::writeTime(uint64_t sample)
+{
+    file.put('#');
+    file.writeNumber(static_cast<uint64_t>(std::llround(sample*unitsPerSample)));
+    file.put('\n');
+}
+
+void VcdWriter::finish()
+{
+    if (finished || !edges) return;
+    finished=true;
+    // a last timestamp marks the end of the capture, so viewers show the final levels until then
+    if (edges->getSampleCount()>0) writeTime(timeBase+edges->getSampleCount());
+    file.close();
+}
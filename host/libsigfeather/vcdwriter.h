@@ -0,0 +1,53 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "bufferedwriter.h"
+#include "capturewriter.h"
+#include "edgeextractor.h"
+#include "wordaligner.h"
+
+//! Exports a capture as a value change dump (IEEE 1364) for GTKWave, PulseView
+//! and simulators. Only level changes are written, found with the edge
+//! extractor, so the output grows with the activity on the pins rather
+//! than with the capture length. Samples a framed capture lost and the time
+//! between segments are dumped as unknown ('x') levels, time keeps counting
+//! across them, so every sample is shown when it was taken.
+class VcdWriter : public ICaptureWriter
+{
+public:
+    //! throws std::runtime_error if the file cannot be created
+    explicit VcdWriter(const std::string& path);
+
+    bool hasError() const override { return file.hasError(); }
+
+    // ISampleSink
+    void onStart(const SigFeather::CaptureInfo& info) override;
+    bool onData(const uint8_t* data, size_t bytes) override;
+    void onGap(size_t offset, size_t bytes) override;
+    void onSegment(size_t index, size_t offset, uint64_t timestamp) override;
+    void onEnd(size_t totalBytes) override;
+    void onError(const std::string& message) override;
+
+private:
+    BufferedWriter file;
+    std::unique_ptr<EdgeExtractor> edges;
+    WordAligner aligner;
+    uint64_t sampleLimit=0;
+    uint64_t streamBase=0;          // stream samples before the edge extractor's sample 0
+    uint64_t timeBase=0;            // sample period at which the edge extractor's sample 0 was taken
+    double unitsPerSample=1;        // timescale units per sample period
+    std::vector<size_t> cursors;
+    bool dumped=false;              // the initial levels were written
+    bool finished=false;
+
+    bool writeWords(const uint8_t* words, size_t bytes);
+    void writeChanges();
+    void writeTime(uint64_t sample);
+    //! the next sample was taken at 'time' and does not continue the last one
+    void restart(uint64_t lost, uint64_t time);
+    void finish();
+};
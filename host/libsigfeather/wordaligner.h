@@ -0,0 +1,45 @@
+//!@author mucki (coding@mucki.dev)
+//!@copyright Copyright (c) 2025
+//! please see LICENSE file in root folder for licensing terms.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//! Sinks receive captures in chunks of any size, but the analysis code works
+//! on whole sample words. This passes on whole words only and keeps a word
+//! split between two chunks until it is complete.
+class WordAligner
+{
+public:
+    //! calls 'consumer(const uint8_t* words, size_t bytes)' up to twice with
+    //! whole words. stops and returns false as soon as the consumer does.
+    template<typename Consumer>
+    bool push(const uint8_t* data, size_t bytes, Consumer&& consumer)
+    {
+        if (partialBytes>0)
+        {
+            while (bytes>0 && partialBytes<4)
+            {
+                partial[partialBytes++]=*data++;
+                --bytes;
+            }
+            if (partialBytes<4) return true;
+            partialBytes=0;
+            if (!consumer(static_cast<const uint8_t*>(partial), size_t(4))) return false;
+        }
+
+        size_t whole=bytes/4*4;
+        for (size_t i=whole; i<bytes; ++i)
+        {
+            partial[partialBytes++]=data[i];
+        }
+        return whole==0 || consumer(data, whole);
+    }
+
+    inline void reset() { partialBytes=0; }
+
+private:
+    uint8_t partial[4];
+    size_t partialBytes=0;
+};
@@ -1,10 +1,326 @@
 #include <iostream>
 #include "sigfeather.h"
+#include "capturefile.h"
+#include "capturewriter.h"
+#include "decoderpipeline.h"
+#include "edgeextractor.h"
+#include "multisink.h"
+#include "protocoldecoders.h"
+#include "summarypyramid.h"
+#include "unpacker.h"
 #include <boost/program_options.hpp>
+#include <atomic>
 #include <chrono>
+#include <csignal>
+#include <cstring>
+#include <limits>
+#include <random>
 
 namespace po = boost::program_options;
 
+namespace
+{
+    std::atomic<bool> interrupted{false};
+
+    void printTransferStatistics(const SigFeather::TransferStatistics& stats)
+    {
+        std::cout << "transfer queue: depth " << stats.queueDepth << " x " << stats.transferSize << " bytes of " << stats.memory << ", "
+                  << stats.transfers << " transfers" << std::endl;
+        std::cout << "achieved queue depth: average " << stats.averageQueueDepth << ", max " << stats.maxQueueDepth << std::endl;
+        std::cout << "turnaround: min " << stats.minTurnaround << " us, average " << stats.averageTurnaround
+                  << " us, max " << stats.maxTurnaround << " us" << std::endl;
+    }
+
+    void printDeviceStatistics(const SigFeather::DeviceStatistics& stats)
+    {
+        std::cout << "device: " << stats.bytesSent << " bytes sent, peak lag " << stats.peakLag << " of " << stats.bufferSize
+                  << " buffer bytes, " << stats.fifoOverflows << " FIFO overflows, " << stats.dmaRestarts << " DMA restarts" << std::endl;
+        std::cout << "device loop: " << stats.updateRate << " per second, max gap " << stats.maxUpdateGap << " us" << std::endl;
+        if (!stats.isLossless()) std::cout << "samples were lost, the sample rate is too high for this setup" << std::endl;
+    }
+
+    //! packed data with a level change on a random channel about every 'spacing' samples
+    std::vector<uint8_t> makeTestData(size_t bytes, unsigned channels, unsigned spacing)
+    {
+        std::mt19937 random(1);
+        unsigned samplesPerWord=32/channels;
+        uint32_t mask=channels==32 ? 0xffffffff : (1u<<channels)-1;
+        std::vector<uint8_t> data(bytes/4*4);
+        uint32_t level=0;
+        for (size_t offset=0; offset<data.size(); offset+=4)
+        {
+            uint32_t word=0;
+            for (unsigned k=0; k<samplesPerWord; ++k)
+            {
+                if (random()%spacing==0) level^=1u<<(random()%channels);
+                word|=(level & mask)<<((samplesPerWord-1-k)*channels);
+            }
+            std::memcpy(data.data()+offset, &word, 4);
+        }
+        return data;
+    }
+
+    //! measures the analysis kernels of every instruction set this CPU supports
+    void benchmarkKernels(size_t megabytes, unsigned channels)
+    {
+        auto data=makeTestData(megabytes*1000*1000, channels, 1000);
+        size_t samples=data.size()*8/channels;
+        std::cout << "analyzing " << data.size() << " bytes, " << samples << " samples of " << channels << " channels" << std::endl;
+
+        auto measure=[&data](const char* name, auto&& function)
+        {
+            auto start=std::chrono::steady_clock::now();
+            function();
+            double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+            std::cout << "  " << name << ": " << double(data.size())/seconds/1e6 << " MB/s" << std::endl;
+        };
+
+        for (int k=0; k<=static_cast<int>(SampleUnpacker::getBestKernel()); ++k)
+        {
+            auto kernel=static_cast<SampleUnpacker::Kernel>(k);
+            std::cout << SampleUnpacker::getKernelName(kernel) << ":" << std::endl;
+            SampleUnpacker unpacker(channels, kernel);
+
+            std::vector<uint8_t> expanded(samples*unpacker.getSampleSize());
+            measure("expand", [&]() { unpacker.expand(data.data(), samples, expanded.data()); });
+
+            std::vector<std::vector<uint64_t>> planes(channels, std::vector<uint64_t>(SampleUnpacker::getPlaneWords(samples)));
+            std::vector<uint64_t*> planePointers;
+            for (auto& plane : planes) planePointers.push_back(plane.data());
+            measure("demultiplex", [&]() { unpacker.demultiplex(data.data(), samples, planePointers.data()); });
+
+            EdgeExtractor edges(channels, kernel);
+            size_t transitions=0;
+            measure("edges", [&]()
+                {
+                    // feed it like a capture in 64KB chunks
+                    constexpr size_t Chunk=64*1024;
+                    for (size_t offset=0; offset<data.size(); offset+=Chunk)
+                    {
+                        size_t bytes=std::min(Chunk, data.size()-offset);
+                        edges.push(data.data()+offset, bytes*8/channels);
+                        for (unsigned c=0; c<channels; ++c) transitions+=edges.getTransitions(c).size();
+                        edges.clear();
+                    }
+                });
+            std::cout << "  " << transitions << " transitions" << std::endl;
+        }
+    }
+
+    //! creates a decoder from "uart:<channel>[:<baud>[:<bits><n|e|o>]]",
+    //! "spi:<clock>:<mosi>[:<miso>[:<cs>[:<mode>]]]" with '-' for unused lines
+    //! or "i2c:<scl>:<sda>". channels count from the base pin.
+    std::unique_ptr<Decoder> createDecoder(const std::string& spec)
+    {
+        std::vector<std::string> fields;
+        size_t begin=0;
+        while (true)
+        {
+            size_t end=spec.find(':', begin);
+            fields.push_back(spec.substr(begin, end-begin));
+            if (end==std::string::npos) break;
+            begin=end+1;
+        }
+        auto channel=[&fields](size_t index, int fallback)
+        {
+            if (index>=fields.size() || fields[index]=="-") return fallback;
+            return std::stoi(fields[index]);
+        };
+
+        if (fields[0]=="uart" && fields.size()>=2)
+        {
+            uint32_t baud=fields.size()>2 ? std::stoul(fields[2]) : 115200;
+            unsigned bits=8;
+            auto parity=UartDecoder::Parity::None;
+            if (fields.size()>3 && !fields[3].empty())
+            {
+                bits=std::stoul(fields[3]);
+                char mode=fields[3].back();
+                if (mode=='e') parity=UartDecoder::Parity::Even;
+                else if (mode=='o') parity=UartDecoder::Parity::Odd;
+            }
+            return std::make_unique<UartDecoder>(channel(1, 0), baud, bits, parity);
+        }
+        if (fields[0]=="spi" && fields.size()>=3)
+        {
+            return std::make_unique<SpiDecoder>(channel(1, 0), channel(2, SpiDecoder::Unused), channel(3, SpiDecoder::Unused),
+                channel(4, SpiDecoder::Unused), channel(5, 0));
+        }
+        if (fields[0]=="i2c" && fields.size()==3)
+        {
+            return std::make_unique<I2cDecoder>(channel(1, 0), channel(2, 1));
+        }
+        throw std::invalid_argument("invalid decoder specification "+spec);
+    }
+
+    //! prints decoded frames as they are found
+    class DecodeSink : public DecoderPipeline
+    {
+    public:
+        DecodeSink() :
+            DecoderPipeline([this](const Decoder& decoder, const DecodedFrame& frame) { print(decoder, frame); })
+        {
+        }
+
+        void onStart(const SigFeather::CaptureInfo& info) override
+        {
+            std::cout << "decoding at " << info.sampleRate << " Hz" << std::endl;
+            DecoderPipeline::onStart(info);
+        }
+
+        //! the device passes transfers here, and DecoderPipeline::onData() queues copies here too
+        bool onBuffer(const SigFeather::BufferView& buffer) override
+        {
+            if (interrupted) return false;
+            return DecoderPipeline::onBuffer(buffer);
+        }
+
+        void onError(const std::string& message) override
+        {
+            DecoderPipeline::onError(message);
+            std::cerr << "Error: " << message << std::endl;
+        }
+
+    private:
+        void print(const Decoder& decoder, const DecodedFrame& frame)
+        {
+            double rate=getSampleRate();
+            std::cout << "[" << decoder.getName() << "] " << frame.start;
+            if (rate>0) std::cout << " (" << double(frame.start)/rate*1e6 << " us)";
+            std::cout << ": " << decoder.describe(frame) << std::endl;
+        }
+    };
+
+    //! prints sample data as it arrives
+    class HexDumpSink : public SigFeather::ISampleSink
+    {
+    public:
+        void onStart(const SigFeather::CaptureInfo& info) override
+        {
+            std::cout << "sample rate " << std::fixed << info.sampleRate << " Hz (divider " << info.clockDivider
+                      << " of " << info.systemClock << " Hz, jitter " << info.jitter*1e9 << " ns)" << std::defaultfloat << std::endl;
+            if (info.unbounded)
+            {
+                std::cout << "acquiring until interrupted:" << std::endl;
+                return;
+            }
+            if (info.triggered)
+            {
+                std::cout << "waiting for trigger, it fires at sample " << info.triggerSample << std::endl;
+            }
+            std::cout << "acquiring " << info.samples << " samples of " << int(info.channels) << " channels in " << info.bytes << " bytes of sample data:" << std::endl;
+        }
+
+        bool onData(const uint8_t* data, size_t bytes) override
+        {
+            if (interrupted) return false;
+            for (size_t i=0;i<bytes;++i,++offset)
+            {
+                std::cout << std::hex << static_cast<int>(data[i]) << " ";
+                if ((offset%16)==15) std::cout << std::endl;
+            }
+            std::cout << std::dec;
+            return true;
+        }
+
+        void onEnd(size_t totalBytes) override
+        {
+            std::cout << std::endl << "acquired " << totalBytes << " bytes of sample data" << std::endl;
+        }
+
+        void onError(const std::string& message) override
+        {
+            std::cerr << std::endl << "Error: " << message << std::endl;
+        }
+
+    private:
+        size_t offset=0;
+    };
+
+    //! warns about the data a framed capture lost
+    class GapReporter : public SigFeather::ISampleSink
+    {
+    public:
+        bool onData(const uint8_t*, size_t) override { return true; }
+
+        void onGap(size_t offset, size_t bytes) override
+        {
+            std::cerr << "Warning: the device lost " << bytes << " bytes of sample data at byte " << offset << std::endl;
+        }
+    };
+
+    //! lists when each segment of a segmented capture was taken
+    class SegmentReporter : public SigFeather::ISampleSink
+    {
+    public:
+        void onStart(const SigFeather::CaptureInfo& info) override { sampleRate=info.sampleRate; }
+        bool onData(const uint8_t*, size_t) override { return true; }
+
+        void onSegment(size_t index, size_t offset, uint64_t timestamp) override
+        {
+            std::cerr << "segment " << index << " at byte " << offset << ", sampled from " << double(timestamp)/sampleRate*1e6 << " us" << std::endl;
+        }
+
+    private:
+        double sampleRate=1;
+    };
+
+    //! drops the data of repeated captures, keeps the error of a failed one
+    class DiscardSink : public SigFeather::ISampleSink
+    {
+    public:
+        std::string error;
+
+        bool onData(const uint8_t*, size_t) override { return !interrupted; }
+        void onError(const std::string& message) override { error=message; }
+    };
+
+    //! the sinks selected on the command line, hex dump unless decoding or writing a file
+    struct OutputSinks
+    {
+        HexDumpSink hexDump;
+        GapReporter gaps;
+        SegmentReporter segments;
+        DecodeSink decode;
+        std::unique_ptr<ICaptureWriter> file;
+        std::unique_ptr<SummaryPyramid> summary;
+        MultiSink all;
+
+        //! throws on invalid decoder specifications or if the output file cannot be created
+        void configure(const po::variables_map& vm)
+        {
+            if (vm.count("decode"))
+            {
+                for (const auto& spec : vm["decode"].as<std::vector<std::string>>()) decode.addDecoder(createDecoder(spec));
+                all.add(decode);
+            }
+            if (vm.count("output"))
+            {
+                file=createCaptureWriter(vm["output"].as<std::string>());
+                if (!file->supportsGaps() && (vm.count("framed") || vm.count("segments")))
+                {
+                    throw std::invalid_argument("the output format cannot hold the gaps of --framed or the segments of --segments");
+                }
+                all.add(*file);
+            }
+            if (vm.count("summary"))
+            {
+                summary=std::make_unique<SummaryPyramid>();
+                all.add(*summary);
+            }
+            if (all.isEmpty()) all.add(hexDump);
+            if (vm.count("framed") || vm.count("segments")) all.add(gaps);
+            if (vm.count("segments")) all.add(segments);
+        }
+
+        //! stores what was built during the capture, throws if that fails
+        void finish(const po::variables_map& vm)
+        {
+            if (summary) summary->save(vm["summary"].as<std::string>());
+        }
+    };
+}
+
 int main(int argc, char** argv)
 {
     SigFeather sf;
@@ -15,7 +331,32 @@ int main(int argc, char** argv)
         ("list,l", "list connected devices")
         ("serial", po::value<std::string>()->default_value(""), "select device by serial number")
         ("bench,b", po::value<size_t>(), "run benchmark")
+        ("bench-kernels", po::value<size_t>(), "benchmark the analysis kernels on this many MB of generated data, no device needed")
         ("sample,s", po::value<size_t>(), "acquire samples")
+        ("channels", po::value<unsigned>()->default_value(1), "number of channels to sample: 1, 2, 4, 8, 16 or 32")
+        ("base-pin", po::value<unsigned>()->default_value(2), "first GPIO to sample")
+        ("rate,r", po::value<uint32_t>()->default_value(0), "sample rate in Hz, 0 uses the device default")
+        ("continuous,c", "keep sampling until interrupted with ctrl-c")
+        ("compress,z", "run-length encode the sample stream on the device")
+        ("deep", "sample into the device's PSRAM, for captures beyond its SRAM buffer and USB bandwidth")
+        ("framed", "report data the device could not send in time as gaps instead of failing the capture")
+        ("repeat", po::value<size_t>(), "repeat the capture this many times, discarding the data, and print the time per capture")
+        ("trigger,t", po::value<std::string>(), "wait for a trigger: rising, falling, high, low or pattern")
+        ("trigger-pin", po::value<unsigned>()->default_value(2), "GPIO watched by the trigger, first one for a pattern")
+        ("trigger-width", po::value<unsigned>()->default_value(1), "number of pins compared by a pattern trigger")
+        ("trigger-pattern", po::value<std::string>()->default_value("0"), "pin levels of a pattern trigger, bit 0 is trigger-pin")
+        ("pretrigger", po::value<size_t>()->default_value(0), "samples to keep from before the trigger")
+        ("segments", po::value<size_t>(), "acquire this many windows of --sample samples without stopping, at every trigger or every --segment-interval samples")
+        ("segment-interval", po::value<size_t>()->default_value(0), "samples from the start of one untriggered segment to the next")
+        ("changes", "let the device send only pin changes and expand them to --rate, for slow or bursty signals")
+        ("queue-depth", po::value<size_t>(), "number of bulk transfers kept queued")
+        ("transfer-size", po::value<size_t>(), "size of each bulk transfer in bytes")
+        ("huge-pages", "back transfers of at least 2MB with huge pages if the kernel has no usbfs device memory")
+        ("stats", "print transfer queue and device statistics")
+        ("decode,d", po::value<std::vector<std::string>>()->composing(), "decode while sampling, e.g. uart:0:9600:8n, spi:0:1:2:3:0 or i2c:0:1")
+        ("output,o", po::value<std::string>(), "write the capture to a .sfcap, .vcd (value change dump) or .sr (sigrok session) file")
+        ("input,i", po::value<std::string>(), "read a .sfcap file instead of sampling, no device needed")
+        ("summary", po::value<std::string>(), "build a zoom summary of the capture and save it to this file")
     ;
 
     po::variables_map vm;
@@ -35,6 +376,40 @@ int main(int argc, char** argv)
         std::cout << desc << std::endl;
         return 0;
     }
+    else if (vm.count("bench-kernels"))
+    {
+        try
+        {
+            benchmarkKernels(vm["bench-kernels"].as<size_t>(), vm["channels"].as<unsigned>());
+        }
+        catch (const std::exception& ex)
+        {
+            std::cerr << "Error: " << ex.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    else if (vm.count("input"))
+    {
+        try
+        {
+            CaptureFileReader reader(vm["input"].as<std::string>());
+            const auto& info=reader.getInfo();
+            std::cout << "capture of " << reader.getSampleCount() << " samples of " << int(info.channels) << " channels from pin "
+                      << int(info.basePin) << " at " << info.sampleRate << " Hz in " << reader.getChunkCount() << " chunks"
+                      << (reader.isComplete() ? "" : ", index rebuilt") << std::endl;
+            OutputSinks sinks;
+            sinks.configure(vm);
+            reader.replay(sinks.all);
+            sinks.finish(vm);
+        }
+        catch (const std::exception& ex)
+        {
+            std::cerr << "Error: " << ex.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
     else if (vm.count("list"))
     {
         std::cout << "Connected SigFeather devices:" << std::endl;
@@ -65,6 +440,22 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    if (vm.count("queue-depth") || vm.count("transfer-size") || vm.count("huge-pages"))
+    {
+        // statistics stay zero until a capture ran, so keep the other value from the configuration
+        size_t depth=vm.count("queue-depth") ? vm["queue-depth"].as<size_t>() : device->getTransferQueueDepth();
+        size_t size=vm.count("transfer-size") ? vm["transfer-size"].as<size_t>() : device->getTransferSize();
+        try
+        {
+            device->setTransferQueue(depth, size, vm.count("huge-pages")>0);
+        }
+        catch (const std::exception& ex)
+        {
+            std::cerr << "Error: " << ex.what() << std::endl;
+            return 1;
+        }
+    }
+
     if (vm.count("bench"))
     {
         size_t requested=vm["bench"].as<size_t>();
@@ -75,19 +466,117 @@ int main(int argc, char** argv)
         double seconds=std::chrono::duration_cast<std::chrono::duration<double>>(end-start).count();
         std::cout << "transferred " << kilobytes << " kbytes in " << seconds << " seconds" << std::endl;
         std::cout << "effective rate: " << kilobytes/seconds << " kBps" << std::endl;
+        if (vm.count("stats"))
+        {
+            printTransferStatistics(device->getTransferStatistics());
+            printDeviceStatistics(device->getDeviceStatistics());
+        }
     }
     else if (vm.count("sample"))
     {
-        size_t requested=vm["sample"].as<size_t>();
-        auto result=device->sample(requested);
-        std::cout << "acquired " << result.size() << " bytes of sample data:" << std::endl;
-
-        for (size_t i=0;i<result.size();++i)
+        SigFeather::CaptureSettings settings;
+        settings.samples=vm["sample"].as<size_t>();
+        settings.unbounded=vm.count("continuous")>0;
+        settings.channels=static_cast<uint8_t>(vm["channels"].as<unsigned>());
+        settings.basePin=static_cast<uint8_t>(vm["base-pin"].as<unsigned>());
+        settings.sampleRate=vm["rate"].as<uint32_t>();
+        settings.compressed=vm.count("compress")>0;
+        settings.deep=vm.count("deep")>0;
+        settings.framed=vm.count("framed")>0;
+        settings.changesOnly=vm.count("changes")>0;
+        if (vm.count("segments"))
+        {
+            settings.segments=vm["segments"].as<size_t>();
+            settings.segmentInterval=vm["segment-interval"].as<size_t>();
+        }
+        if (vm.count("trigger"))
+        {
+            const std::string& type=vm["trigger"].as<std::string>();
+            if (type=="rising") settings.trigger.type=SigFeather::TriggerType::RisingEdge;
+            else if (type=="falling") settings.trigger.type=SigFeather::TriggerType::FallingEdge;
+            else if (type=="high") settings.trigger.type=SigFeather::TriggerType::High;
+            else if (type=="low") settings.trigger.type=SigFeather::TriggerType::Low;
+            else if (type=="pattern") settings.trigger.type=SigFeather::TriggerType::Pattern;
+            else
+            {
+                std::cerr << "Error: unknown trigger type " << type << std::endl;
+                return 1;
+            }
+            settings.trigger.pin=static_cast<uint8_t>(vm["trigger-pin"].as<unsigned>());
+            settings.trigger.width=static_cast<uint8_t>(vm["trigger-width"].as<unsigned>());
+            const std::string& pattern=vm["trigger-pattern"].as<std::string>();
+            try
+            {
+                size_t used=0;
+                unsigned long long value=std::stoull(pattern, &used, 0);
+                if (used!=pattern.size() || pattern.find('-')!=std::string::npos || value>std::numeric_limits<uint32_t>::max())
+                {
+                    throw std::out_of_range(pattern);
+                }
+                settings.trigger.pattern=static_cast<uint32_t>(value);
+            }
+            catch (const std::exception&)
+            {
+                std::cerr << "Error: invalid trigger pattern " << pattern << std::endl;
+                return 1;
+            }
+            settings.trigger.preTriggerSamples=vm["pretrigger"].as<size_t>();
+            // the trigger may take arbitrarily long to fire
+            settings.timeout=0;
+        }
+        // a capture that can wait forever ends cleanly on ctrl-c, a second one ends sftool even while no data arrives
+        if (settings.unbounded || settings.changesOnly || settings.timeout==0)
+        {
+            std::signal(SIGINT, [](int) { interrupted=true; std::signal(SIGINT, SIG_DFL); });
+        }
+        OutputSinks sinks;
+        try
+        {
+            sinks.configure(vm);
+        }
+        catch (const std::exception& ex)
+        {
+            std::cerr << "Error: " << ex.what() << std::endl;
+            return 1;
+        }
+        try
+        {
+            size_t received=device->stream(settings, sinks.all);
+            if (sinks.file && sinks.file->hasError()) std::cerr << "Error: writing the capture file failed" << std::endl;
+            sinks.finish(vm);
+            if (vm.count("stats"))
+            {
+                const auto& stats=device->getTransferStatistics();
+                printTransferStatistics(stats);
+                if (settings.compressed && stats.bytes>0)
+                {
+                    std::cout << "compression: " << received << " sample bytes in " << stats.bytes << " transferred bytes, ratio "
+                              << double(received)/double(stats.bytes) << std::endl;
+                }
+                printDeviceStatistics(device->getDeviceStatistics());
+            }
+            if (vm.count("repeat"))
+            {
+                size_t repetitions=vm["repeat"].as<size_t>();
+                DiscardSink discard;
+                auto start=std::chrono::steady_clock::now();
+                size_t done=0;
+                while (done<repetitions && !interrupted)
+                {
+                    device->rearm(discard);
+                    if (!discard.error.empty()) break;
+                    ++done;
+                }
+                double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+                if (!discard.error.empty()) std::cerr << "Error: repeated capture failed: " << discard.error << std::endl;
+                if (done>0) std::cout << done << " repeated captures, " << seconds/double(done)*1e3 << " ms each" << std::endl;
+            }
+        }
+        catch (const std::exception& ex)
         {
-            std::cout << std::hex << static_cast<int>(result[i]) << " ";
-            if ((i%16)==15) std::cout << std::endl;
+            std::cerr << "Error: " << ex.what() << std::endl;
+            return 1;
         }
-        std::cout << std::dec << std::endl;
     }
 
     device->close();